@@ -41,6 +41,9 @@ REGISTRY_COMMAND(Error,              "b18b98cc-b026-4bfe-8e33-e7afebfbe78b")
 REGISTRY_COMMAND(ProtocolCompatible, "173cbbeb-1d81-4e01-bf3c-5d06f9c878c3")
 REGISTRY_COMMAND(CloseConnection,    "e71921fd-e5b3-4f9b-8be7-283e8bb2a531")
 REGISTRY_COMMAND(EchoConnection,     "db702b07-7f5a-403f-963a-ec50d41c7305")
+REGISTRY_COMMAND(PayloadDedup,       "5e0b6b8e-61c6-4a5b-9c0d-8f3e2a7d1b94")
+REGISTRY_COMMAND(DeltaFrame,         "fe27b1ff-6d0f-4938-ab43-6c586ce9c7ec")
+REGISTRY_COMMAND(DictFrame,          "9c4d2a61-37e8-4b0f-a5d6-1e8b72f0c3a9")
 
 #undef REGISTRY_COMMAND
 } // namespace command
@@ -249,6 +252,96 @@ void CloseConnection::fromRaw(const bserial::RawVector& vect)
     B_QSTR_FROM_UTF8(stream, description);
     B_DESERIALIZE_END
 }
+
+bserial::RawVector PayloadDedup::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << mode;
+    stream << cacheSize;
+    stream << hash;
+    stream << header;
+    stream << content;
+    stream << hashes;
+    stream << refs;
+    B_SERIALIZE_RETURN
+}
+
+void PayloadDedup::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> mode;
+    stream >> cacheSize;
+    stream >> hash;
+    stream >> header;
+    stream >> content;
+    stream >> hashes;
+    stream >> refs;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector DeltaFrame::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << mode;
+    stream << command;
+    stream << key;
+    stream << baseChecksum;
+    stream << checksum;
+    stream << payload;
+    B_SERIALIZE_RETURN
+}
+
+void DeltaFrame::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> mode;
+    stream >> command;
+    stream >> key;
+    stream >> baseChecksum;
+    stream >> checksum;
+    stream >> payload;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector DictFrame::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << mode;
+    stream << command;
+    stream << version;
+    stream << size;
+    stream << payload;
+    stream << dictionary;
+    B_SERIALIZE_RETURN
+}
+
+void DictFrame::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> mode;
+    stream >> command;
+    stream >> version;
+    stream >> size;
+    stream >> payload;
+    stream >> dictionary;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector LoadReport::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << inflight;
+    stream << latency;
+    B_SERIALIZE_RETURN
+}
+
+void LoadReport::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> inflight;
+    stream >> latency;
+    B_DESERIALIZE_END
+}
 #endif // PPROTO_QBINARY_SERIALIZE
 
 } // namespace data
@@ -97,6 +97,29 @@ extern const QUuidEx CloseConnection;
 */
 extern const QUuidEx EchoConnection;
 
+/**
+  Служебная команда механизма дедупликации контента (см. transport/payload_dedup.h).
+  Используется только в том случае, если обе стороны  соединения  поддерживают
+  дедупликацию и обменялись сообщениями PayloadDedup с режимом Hello
+*/
+extern const QUuidEx PayloadDedup;
+
+/**
+  Служебная команда механизма дельта-кодирования сообщений (см. transport/
+  delta_codec.h). Используется только в том случае, если обе стороны  сое-
+  динения поддерживают дельта-кодирование и обменялись сообщениями DeltaFrame
+  с режимом Hello
+*/
+extern const QUuidEx DeltaFrame;
+
+/**
+  Служебная команда механизма сжатия сообщений со словарями (см. transport/
+  dict_codec.h). Используется только в том случае, если обе стороны соеди-
+  нения поддерживают сжатие со словарями и обменялись сообщениями DictFrame
+  с режимом Hello
+*/
+extern const QUuidEx DictFrame;
+
 } // namespace command
 
 //------------------------ Список базовых структур ---------------------------
@@ -318,6 +341,176 @@ struct CloseConnection : Data<&command::CloseConnection,
 #endif
 };
 
+/**
+  Служебная структура механизма дедупликации контента. Используется только
+  с бинарным форматом сериализации
+*/
+struct PayloadDedup : Data<&command::PayloadDedup,
+                            Message::Type::Event>
+{
+    enum class Mode : quint32
+    {
+        Hello = 0, // Сторона поддерживает дедупликацию, cacheSize содержит
+                   // размер кеша принимающей стороны
+        Store = 1, // Сообщение с контентом, контент нужно сохранить в кеше
+        Ref   = 2, // Сообщение без контента, контент нужно взять из кеша
+        Ack   = 3, // Подтверждение сохранения контента с хешами hashes
+        Miss  = 4, // Контент с хешем hash отсутствует в кеше
+        RefAck = 5 // Подтверждение обработки refs сообщений Ref
+    };
+
+    Mode mode = {Mode::Hello};
+    quint64 cacheSize = {0};
+
+    // Количество обработанных сообщений Ref для режима RefAck
+    quint32 refs = {0};
+
+    // Хеш контента
+    QByteArray hash;
+
+    // Сериализованное сообщение без контента
+    QByteArray header;
+
+    // Контент сообщения (в том виде, в котором он хранится в сообщении)
+    QByteArray content;
+
+    // Список хешей для режима Ack
+    QVector<QByteArray> hashes;
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( mode      )
+        J_SERIALIZE_ITEM( cacheSize )
+        J_SERIALIZE_OPT ( hash      )
+        J_SERIALIZE_OPT ( header    )
+        J_SERIALIZE_OPT ( content   )
+        J_SERIALIZE_OPT ( hashes    )
+        J_SERIALIZE_OPT ( refs      )
+    J_SERIALIZE_END
+#endif
+};
+
+/**
+  Служебная структура механизма дельта-кодирования сообщений. Используется
+  только с бинарным форматом сериализации
+*/
+struct DeltaFrame : Data<&command::DeltaFrame,
+                          Message::Type::Event>
+{
+    enum class Mode : quint32
+    {
+        Hello      = 0, // Сторона поддерживает дельта-кодирование
+        Key        = 1, // Опорный кадр, payload содержит сериализованное сообщение
+        Delta      = 2, // Разностный кадр относительно предыдущего кадра потока
+        KeyRequest = 3  // Запрос опорного кадра для потока
+    };
+
+    Mode mode = {Mode::Hello};
+
+    // Идентификатор потока: команда и ключ (значение tag(0) сообщения)
+    QUuidEx command;
+    quint64 key = {0};
+
+    // Контрольные суммы предыдущего (базового) и восстановленного кадров
+    quint32 baseChecksum = {0};
+    quint32 checksum = {0};
+
+    // Сериализованное сообщение (режим Key) или разность (режим Delta)
+    QByteArray payload;
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( mode         )
+        J_SERIALIZE_ITEM( command      )
+        J_SERIALIZE_ITEM( key          )
+        J_SERIALIZE_ITEM( baseChecksum )
+        J_SERIALIZE_ITEM( checksum     )
+        J_SERIALIZE_OPT ( payload      )
+    J_SERIALIZE_END
+#endif
+};
+
+/**
+  Служебная структура механизма сжатия сообщений со словарями. Используется
+  только с бинарным форматом сериализации
+*/
+struct DictFrame : Data<&command::DictFrame,
+                         Message::Type::Event>
+{
+    enum class Mode : quint32
+    {
+        Hello       = 0, // Сторона поддерживает сжатие со словарями
+        Dict        = 1, // Сжатое сообщение и словарь, которым оно сжато
+        Compressed  = 2, // Сжатое сообщение, словарь передан ранее
+        DictRequest = 3  // Запрос словаря, который не найден на принимающей
+                         // стороне
+    };
+
+    Mode mode = {Mode::Hello};
+
+    // Команда и версия словаря
+    QUuidEx command;
+    quint32 version = {0};
+
+    // Размер сериализованного сообщения до сжатия
+    quint32 size = {0};
+
+    // Сжатое сериализованное сообщение
+    QByteArray payload;
+
+    // Словарь (режим Dict)
+    QByteArray dictionary;
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( mode       )
+        J_SERIALIZE_ITEM( command    )
+        J_SERIALIZE_ITEM( version    )
+        J_SERIALIZE_ITEM( size       )
+        J_SERIALIZE_OPT ( payload    )
+        J_SERIALIZE_OPT ( dictionary )
+    J_SERIALIZE_END
+#endif
+};
+
+/**
+  Сведения о загруженности обработчиков на стороне сервера. Передаются в ответе
+  на команду EchoConnection, если для листенера задан измеритель загруженности
+  (см. Properties::loadMeter())
+*/
+struct LoadReport : Data<&command::EchoConnection,
+                          Message::Type::Answer>
+{
+    // Количество команд, переданных в обработчики и еще не получивших ответ
+    quint32 inflight = {0};
+
+    // Сглаженное время обработки команды (в микросекундах)
+    quint32 latency = {0};
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( inflight )
+        J_SERIALIZE_ITEM( latency  )
+    J_SERIALIZE_END
+#endif
+};
+
 //------------------------ Функции json-сериализации -------------------------
 
 #ifdef PPROTO_JSON_SERIALIZE
@@ -410,6 +603,8 @@ extern const QUuidEx MessageContentParse;
 DECL_ERROR_CODE(protocol_incompatible, 0, "afa4209c-bd5a-4791-9713-5c3f4ab3c52b", QObject::tr("Protocol versions incompatible"))
 DECL_ERROR_CODE(qbinary_parse,         0, "ed291487-d373-4aa1-93f5-c4d953e5d974", QObject::tr("QBinary parse error"))
 DECL_ERROR_CODE(json_parse,            0, "db5d018b-592f-4e80-850f-ebfccfe08986", QObject::tr("Json parse error"))
+DECL_ERROR_CODE(paging_cursor_abort,   0, "e14a7c93-5b2d-4f08-8c6e-93d1b27a5f40", QObject::tr("Page of streaming paging cannot be formed"))
+DECL_ERROR_CODE(single_flight_abort,   0, "3f7b6c1e-8a24-4d9e-b05c-2e61d4a9f873", QObject::tr("Identical command in progress was not completed"))
 
 } // namespace error
 
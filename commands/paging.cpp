@@ -24,27 +24,90 @@
 *****************************************************************************/
 
 #include "commands/paging.h"
+#include "commands/pool.h"
 
-namespace pproto::data {
+namespace pproto {
+namespace command {
+
+const QUuidEx PagingCredit =
+    command::Pool::Registry{"0f1ff74d-71fb-4e7d-b9e9-f66446828f4d", "PagingCredit", false};
+
+const QUuidEx PagingAbort =
+    command::Pool::Registry{"b6e3f18a-4c52-4a7d-9e21-7d05c8a4f2b6", "PagingAbort", false};
+
+} // namespace command
+
+namespace data {
 
 #ifdef PPROTO_QBINARY_SERIALIZE
 bserial::RawVector PagingInfo::toRaw() const
 {
+    //--- Version 1 ---
     B_SERIALIZE_V1(stream)
     stream << limit;
     stream << offset;
     stream << total;
+    //--- Version 2 ---
+    B_SERIALIZE_V2(stream)
+    stream << cursor;
+    stream << window;
+    stream << page;
+    stream << last;
     B_SERIALIZE_RETURN
 }
 
 void PagingInfo::fromRaw(const bserial::RawVector& vect)
 {
+    //--- Version 1 ---
     B_DESERIALIZE_V1(vect, stream)
     stream >> limit;
     stream >> offset;
     stream >> total;
+    //--- Version 2 ---
+    B_DESERIALIZE_V2(vect, stream)
+    stream >> cursor;
+    stream >> window;
+    stream >> page;
+    stream >> last;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector PagingCredit::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << cursor;
+    stream << pages;
+    stream << close;
+    B_SERIALIZE_RETURN
+}
+
+void PagingCredit::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> cursor;
+    stream >> pages;
+    stream >> close;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector PagingAbort::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << cursor;
+    stream << page;
+    stream << description;
+    B_SERIALIZE_RETURN
+}
+
+void PagingAbort::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> cursor;
+    stream >> page;
+    stream >> description;
     B_DESERIALIZE_END
 }
 #endif
 
-} // namespace pproto::data
+} // namespace data
+} // namespace pproto
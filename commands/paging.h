@@ -27,7 +27,26 @@
 
 #include "commands/base.h"
 
-namespace pproto::data {
+namespace pproto {
+namespace command {
+
+/**
+  Предоставляет серверу кредит на отправку очередных страниц  данных  для кур-
+  сора потоковой постраничной выборки.  Так же используется  для  досрочного
+  закрытия курсора. См. описание модуля paging_stream
+*/
+extern const QUuidEx PagingCredit;
+
+/**
+  Уведомляет клиента о прерывании потоковой постраничной выборки на стороне
+  сервера (страница данных не может быть сформирована). См. описание модуля
+  paging_stream
+*/
+extern const QUuidEx PagingAbort;
+
+} // namespace command
+
+namespace data {
 
 /**
   Структура общего назначения, используется для порционного получения данных
@@ -45,6 +64,21 @@ struct PagingInfo
     // равен -1
     qint32 total = {-1};
 
+    // Идентификатор  курсора  на стороне сервера,  используется  в  режиме
+    // потоковой постраничной выборки. Значение назначается сервером
+    QUuidEx cursor;
+
+    // Количество страниц, которые сервер может отправить  клиенту  без  его
+    // дополнительного запроса. Значение больше нуля в исходной команде озна-
+    // чает требование выполнить выборку в потоковом режиме
+    quint32 window = {0};
+
+    // Порядковый номер страницы в потоке (начиная с 0)
+    quint32 page = {0};
+
+    // Признак последней страницы в потоке
+    bool last = {false};
+
 #ifdef PPROTO_QBINARY_SERIALIZE
     DECLARE_B_SERIALIZE_FUNC
 #endif
@@ -54,8 +88,67 @@ struct PagingInfo
         J_SERIALIZE_ITEM( limit  )
         J_SERIALIZE_ITEM( offset )
         J_SERIALIZE_ITEM( total  )
+        J_SERIALIZE_OPT ( cursor )
+        J_SERIALIZE_OPT ( window )
+        J_SERIALIZE_OPT ( page   )
+        J_SERIALIZE_OPT ( last   )
+    J_SERIALIZE_END
+#endif
+};
+
+/**
+  Кредит на отправку страниц для курсора потоковой постраничной выборки
+*/
+struct PagingCredit : Data<&command::PagingCredit,
+                            Message::Type::Event>
+{
+    // Идентификатор курсора
+    QUuidEx cursor;
+
+    // Количество страниц, которые дополнительно может отправить сервер
+    quint32 pages = {0};
+
+    // Требование закрыть курсор на стороне сервера
+    bool close = {false};
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( cursor )
+        J_SERIALIZE_ITEM( pages  )
+        J_SERIALIZE_ITEM( close  )
+    J_SERIALIZE_END
+#endif
+};
+
+struct PagingAbort : Data<&command::PagingAbort,
+                           Message::Type::Event>
+{
+    // Идентификатор курсора
+    QUuidEx cursor;
+
+    // Номер страницы, которая не может быть сформирована. Предыдущие
+    // страницы были отправлены клиенту
+    quint32 page = {0};
+
+    // Описание причины прерывания выборки
+    QString description;
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( cursor      )
+        J_SERIALIZE_ITEM( page        )
+        J_SERIALIZE_ITEM( description )
     J_SERIALIZE_END
 #endif
 };
 
-} // namespace pproto::data
+} // namespace data
+} // namespace pproto
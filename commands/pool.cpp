@@ -83,12 +83,85 @@ quint32 Pool::commandExists(const QUuidEx& command) const
     return (*set.constBegin()).multiproc ? 2 : 1;
 }
 
+void Pool::setCacheTtl(const QUuidEx& command, quint32 ttl)
+{
+    if (ttl)
+        _cacheTtl[command] = ttl;
+    else
+        _cacheTtl.remove(command);
+}
+
+quint32 Pool::cacheTtl(const QUuidEx& command) const
+{
+    return _cacheTtl.value(command, 0);
+}
+
+void Pool::setSingleFlight(const QUuidEx& command, bool val)
+{
+    if (val)
+        _singleFlight.insert(command);
+    else
+        _singleFlight.remove(command);
+}
+
+bool Pool::singleFlight(const QUuidEx& command) const
+{
+    return _singleFlight.contains(command);
+}
+
+void Pool::setDeltaEncoding(const QUuidEx& command, bool val)
+{
+    if (val)
+        _deltaEncoding.insert(command);
+    else
+        _deltaEncoding.remove(command);
+}
+
+bool Pool::deltaEncoding(const QUuidEx& command) const
+{
+    return _deltaEncoding.contains(command);
+}
+
+void Pool::setDictCompression(const QUuidEx& command, bool val)
+{
+    if (val)
+        _dictCompression.insert(command);
+    else
+        _dictCompression.remove(command);
+}
+
+bool Pool::dictCompression(const QUuidEx& command) const
+{
+    return _dictCompression.contains(command);
+}
+
+void Pool::setEventHistory(const QUuidEx& command, bool val)
+{
+    if (val)
+        _eventHistory.insert(command);
+    else
+        _eventHistory.remove(command);
+}
+
+bool Pool::eventHistory(const QUuidEx& command) const
+{
+    return _eventHistory.contains(command);
+}
+
 Pool::Registry::Registry(const char* uuidStr, const char* commandName, bool multiproc)
     : QUuidEx(uuidStr)
 {
     pool().add(this, commandName, multiproc);
 }
 
+Pool::Registry::Registry(const char* uuidStr, const char* commandName, bool multiproc,
+                         quint32 cacheTtl)
+    : QUuidEx(uuidStr)
+{
+    pool().add(this, commandName, multiproc);
+    pool().setCacheTtl(*this, cacheTtl);
+}
+
 Pool::CommandTraits::CommandTraits(const char* commandName, bool multiproc)
     : commandName(commandName), multiproc(multiproc)
 {}
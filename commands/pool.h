@@ -59,6 +59,42 @@ public:
     // значение 1, если multiproc равен TRUE - будет возвращено значение 2
     quint32 commandExists(const QUuidEx& command) const;
 
+    // Помечает команду  как кешируемую.  Ответы на такие команды  сохраняются
+    // на стороне  сервера  и повторно отправляются на идентичные запросы  без
+    // вызова обработчика. Параметр ttl определяет время жизни ответа в кеше
+    // (в миллисекундах), значение 0 снимает признак кеширования.
+    // Кешировать можно только идемпотентные команды, ответ на которые зависит
+    // исключительно от контента запроса
+    void setCacheTtl(const QUuidEx& command, quint32 ttl);
+
+    // Возвращает время жизни ответа в кеше (в миллисекундах) или 0, если
+    // команда не является кешируемой
+    quint32 cacheTtl(const QUuidEx& command) const;
+
+    // Разрешает объединение идентичных  одновременно  выполняемых  команд.
+    // Обработчик вызывается только для первой команды, ответ на нее рассы-
+    // лается всем ожидающим запросам (см. transport::SingleFlight).
+    // Объединять можно только идемпотентные команды
+    void setSingleFlight(const QUuidEx& command, bool val);
+    bool singleFlight(const QUuidEx& command) const;
+
+    // Разрешает дельта-кодирование последовательных сообщений команды
+    // (см. transport/delta_codec.h). Имеет смысл для команд, которые
+    // периодически передают незначительно изменяющиеся данные
+    void setDeltaEncoding(const QUuidEx& command, bool val);
+    bool deltaEncoding(const QUuidEx& command) const;
+
+    // Разрешает сжатие сообщений команды со словарем, обученным на сообще-
+    // ниях этой команды (см. transport/dict_codec.h). Имеет смысл для команд
+    // с небольшими сообщениями одинаковой структуры
+    void setDictCompression(const QUuidEx& command, bool val);
+    bool dictCompression(const QUuidEx& command) const;
+
+    // Разрешает сохранение событий команды в истории событий листенера
+    // (см. transport/event_history.h)
+    void setEventHistory(const QUuidEx& command, bool val);
+    bool eventHistory(const QUuidEx& command) const;
+
     // Возвращает TRUE когда команда есть в пуле команд, и для нее установлен
     // признак singlproc
     bool commandIsSinglproc(const QUuidEx& command) const;
@@ -75,6 +111,10 @@ public:
     struct Registry : public QUuidEx
     {
         Registry(const char* uuidStr, const char* commandName, bool multiproc);
+
+        // Регистрирует кешируемую команду, см. описание setCacheTtl()
+        Registry(const char* uuidStr, const char* commandName, bool multiproc,
+                 quint32 cacheTtl);
     };
 
     struct CommandTraits
@@ -99,6 +139,21 @@ private:
     // содержать более одного значения
     QMap<QUuidEx, QSet<CommandTraits>> _map;
 
+    // Время жизни ответов для кешируемых команд
+    QHash<QUuidEx, quint32> _cacheTtl;
+
+    // Команды, для которых разрешено объединение идентичных запросов
+    QSet<QUuidEx> _singleFlight;
+
+    // Команды, для которых разрешено дельта-кодирование
+    QSet<QUuidEx> _deltaEncoding;
+
+    // Команды, для которых разрешено сжатие со словарем
+    QSet<QUuidEx> _dictCompression;
+
+    // Команды, события которых сохраняются в истории событий
+    QSet<QUuidEx> _eventHistory;
+
     template<typename T, int> friend T& safe::singleton();
 };
 
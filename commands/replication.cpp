@@ -0,0 +1,114 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "commands/replication.h"
+#include "commands/pool.h"
+
+namespace pproto {
+namespace command {
+
+const QUuidEx ReplicaSubscribe =
+    command::Pool::Registry{"4904a2f6-4dd3-4141-89f7-59ca53243787", "ReplicaSubscribe", false};
+
+const QUuidEx ReplicaSnapshot =
+    command::Pool::Registry{"8679c104-9c30-4f01-a361-0d2d0b6166cb", "ReplicaSnapshot", false};
+
+const QUuidEx ReplicaUpdate =
+    command::Pool::Registry{"52dd98ee-e566-4d60-87bb-71e8e3e5f0da", "ReplicaUpdate", false};
+
+} // namespace command
+
+namespace data {
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+bserial::RawVector ReplicaSubscribe::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << channel;
+    stream << unsubscribe;
+    stream << count;
+    B_SERIALIZE_RETURN
+}
+
+void ReplicaSubscribe::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> channel;
+    stream >> unsubscribe;
+    stream >> count;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector ReplicaSnapshot::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << channel;
+    stream << chunk;
+    stream << last;
+    stream << sequence;
+    stream << keys;
+    stream << values;
+    B_SERIALIZE_RETURN
+}
+
+void ReplicaSnapshot::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> channel;
+    stream >> chunk;
+    stream >> last;
+    stream >> sequence;
+    stream >> keys;
+    stream >> values;
+    B_DESERIALIZE_END
+}
+
+bserial::RawVector ReplicaUpdate::toRaw() const
+{
+    B_SERIALIZE_V1(stream)
+    stream << channel;
+    stream << sequence;
+    stream << key;
+    stream << value;
+    stream << removed;
+    stream << reset;
+    B_SERIALIZE_RETURN
+}
+
+void ReplicaUpdate::fromRaw(const bserial::RawVector& vect)
+{
+    B_DESERIALIZE_V1(vect, stream)
+    stream >> channel;
+    stream >> sequence;
+    stream >> key;
+    stream >> value;
+    stream >> removed;
+    stream >> reset;
+    B_DESERIALIZE_END
+}
+#endif
+
+} // namespace data
+} // namespace pproto
@@ -0,0 +1,158 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/base.h"
+
+namespace pproto {
+namespace command {
+
+/**
+  Подписка на канал репликации состояния (см. описание модуля replication).
+  В ответ на команду сервер отправляет снимок состояния канала в виде после-
+  довательности событий ReplicaSnapshot, после чего отправляет изменения
+  состояния в виде событий ReplicaUpdate.
+  Так же используется для отмены подписки
+*/
+extern const QUuidEx ReplicaSubscribe;
+
+/**
+  Часть снимка состояния канала репликации
+*/
+extern const QUuidEx ReplicaSnapshot;
+
+/**
+  Изменение состояния канала репликации
+*/
+extern const QUuidEx ReplicaUpdate;
+
+} // namespace command
+
+namespace data {
+
+struct ReplicaSubscribe : Data<&command::ReplicaSubscribe,
+                                Message::Type::Command,
+                                Message::Type::Answer>
+{
+    // Идентификатор канала репликации
+    QUuidEx channel;
+
+    // Требование отменить подписку
+    bool unsubscribe = {false};
+
+    // Возвращаемый параметр, содержит количество записей в состоянии канала
+    // на момент подписки
+    quint32 count = {0};
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( channel     )
+        J_SERIALIZE_ITEM( unsubscribe )
+        J_SERIALIZE_ITEM( count       )
+    J_SERIALIZE_END
+#endif
+};
+
+struct ReplicaSnapshot : Data<&command::ReplicaSnapshot,
+                               Message::Type::Event>
+{
+    // Идентификатор канала репликации
+    QUuidEx channel;
+
+    // Порядковый номер части снимка (начиная с 0)
+    quint32 chunk = {0};
+
+    // Признак последней части снимка
+    bool last = {false};
+
+    // Номер последнего изменения состояния, которое учтено в снимке.
+    // Заполняется только для последней части снимка. Все последующие
+    // изменения (ReplicaUpdate) будут иметь номера sequence + 1, +2...
+    quint64 sequence = {0};
+
+    // Ключи и значения записей состояния
+    QVector<QByteArray> keys;
+    QVector<QByteArray> values;
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( channel  )
+        J_SERIALIZE_ITEM( chunk    )
+        J_SERIALIZE_ITEM( last     )
+        J_SERIALIZE_ITEM( sequence )
+        J_SERIALIZE_ITEM( keys     )
+        J_SERIALIZE_ITEM( values   )
+    J_SERIALIZE_END
+#endif
+};
+
+struct ReplicaUpdate : Data<&command::ReplicaUpdate,
+                             Message::Type::Event>
+{
+    // Идентификатор канала репликации
+    QUuidEx channel;
+
+    // Номер изменения состояния
+    quint64 sequence = {0};
+
+    // Ключ и новое значение записи
+    QByteArray key;
+    QByteArray value;
+
+    // Признак удаления записи
+    bool removed = {false};
+
+    // Признак отмены подписки сервером  (например,  когда  клиент не успевает
+    // принимать изменения). Для восстановления состояния клиент должен заново
+    // подписаться на канал
+    bool reset = {false};
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    DECLARE_B_SERIALIZE_FUNC
+#endif
+
+#ifdef PPROTO_JSON_SERIALIZE
+    J_SERIALIZE_BEGIN
+        J_SERIALIZE_ITEM( channel  )
+        J_SERIALIZE_ITEM( sequence )
+        J_SERIALIZE_ITEM( key      )
+        J_SERIALIZE_ITEM( value    )
+        J_SERIALIZE_OPT ( removed  )
+        J_SERIALIZE_OPT ( reset    )
+    J_SERIALIZE_END
+#endif
+};
+
+} // namespace data
+} // namespace pproto
@@ -27,6 +27,7 @@
 
 #include "message.h"
 #include "logger_operators.h"
+#include "probes.h"
 
 #include "shared/list.h"
 #include "shared/defmac.h"
@@ -181,13 +182,19 @@ public:
     void call(const Message::Ptr& message)
     {
         if (lst::FindResult fr = _functions.findRef(message->command()))
-            _functions.item(fr.index())->call(message);
+            call(message, fr);
     }
 
     void call(const Message::Ptr& message, const lst::FindResult& fr)
     {
         if (fr.success())
+        {
+            PPROTO_PROBE_MESSAGE(invoke_begin, message, message->type(),
+                                 message->socketDescriptor());
             _functions.item(fr.index())->call(message);
+            PPROTO_PROBE_MESSAGE(invoke_end, message, message->type(),
+                                 message->socketDescriptor());
+        }
     }
 
 private:
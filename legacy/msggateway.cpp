@@ -0,0 +1,339 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "legacy/msggateway.h"
+#include "logger_operators.h"
+#include "utils.h"
+
+#include "ProductVersion.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#define log_error_m   alog::logger().error   (alog_line_location, "MsgGateway")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "MsgGateway")
+#define log_info_m    alog::logger().info    (alog_line_location, "MsgGateway")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "MsgGateway")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "MsgGateway")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "MsgGateway")
+
+namespace snd {
+
+using namespace pproto;
+
+namespace {
+
+// Размер кадра (в байтах), начиная с которого кадр сжимается
+// (соответствует CustomSrvCommunicator::send_())
+const int compressionSize = 1024;
+
+} // namespace
+
+MsgGateway::MsgGateway(const transport::tcp::Socket::Ptr& socket)
+    : _socket(socket)
+{
+    registrationQtMetatypes();
+    _timer.start();
+
+    chk_connect_q(_socket.get(), &transport::base::Socket::message,
+                  this,          &MsgGateway::message)
+
+    chk_connect_q(&_expireTimer, &QTimer::timeout,
+                  this,          &MsgGateway::expireAnswers)
+}
+
+MsgGateway::~MsgGateway()
+{
+    close();
+    QObject::disconnect(_socket.get(), nullptr, this, nullptr);
+}
+
+void MsgGateway::addCommand(const QUuidEx& legacyCommand, const QUuidEx& command,
+                            const ToMessage& toMessage, const FromMessage& fromMessage)
+{
+    Command cmd;
+    cmd.legacyCommand = legacyCommand;
+    cmd.command = command;
+    cmd.toMessage = toMessage;
+    cmd.fromMessage = fromMessage;
+
+    _commands.append(cmd);
+    _legacyIndex.insert(legacyCommand, _commands.count() - 1);
+    _commandIndex.insert(command, _commands.count() - 1);
+}
+
+bool MsgGateway::init(const QHostAddress& address, quint16 port)
+{
+    if (!listen(address, port))
+    {
+        log_error_m << "Start listener is failed"
+                    << ". Host: " << address << ":" << port
+                    << ". Detail: " << errorString();
+        return false;
+    }
+    _expireTimer.start(1000);
+
+    log_verbose_m << "Legacy gateway is started"
+                  << ". Host: " << address << ":" << port;
+    return true;
+}
+
+void MsgGateway::close()
+{
+    _expireTimer.stop();
+    QTcpServer::close();
+
+    for (QTcpSocket* client : _clients.keys())
+    {
+        QObject::disconnect(client, nullptr, this, nullptr);
+        client->abort();
+        client->deleteLater();
+    }
+    _clients.clear();
+    _pending.clear();
+}
+
+void MsgGateway::incomingConnection(SocketDescriptor socketDescriptor)
+{
+    QTcpSocket* client = new QTcpSocket(this);
+    if (!client->setSocketDescriptor(socketDescriptor))
+    {
+        log_error_m << "Failed set socket descriptor"
+                    << ". Detail: " << client->errorString();
+        delete client;
+        return;
+    }
+    chk_connect_d(client, &QTcpSocket::readyRead,
+                  this,   &MsgGateway::clientReadyRead)
+
+    chk_connect_d(client, &QTcpSocket::disconnected,
+                  this,   &MsgGateway::clientDisconnected)
+
+    _clients.insert(client, Client());
+
+    log_verbose_m << "Legacy client connected"
+                  << ". Host: " << client->peerAddress() << ":" << client->peerPort();
+}
+
+void MsgGateway::clientReadyRead()
+{
+    QTcpSocket* client = qobject_cast<QTcpSocket*>(sender());
+    auto it = _clients.find(client);
+    if (it == _clients.end())
+        return;
+
+    // Данные считываются из сокета по кадрам, без накопления во
+    // вспомогательном буфере
+    while (true)
+    {
+        if (it->frameSize < 0)
+        {
+            if (client->bytesAvailable() < qint64(sizeof(qint32)))
+                break;
+
+            // Размер кадра передается в порядке байт отправителя
+            // (см. CustomCommunicator::send_())
+            qint32 frameSize;
+            client->read((char*)&frameSize, sizeof(qint32));
+            it->compressed = (frameSize < 0);
+            it->frameSize = qAbs(frameSize);
+        }
+        if (client->bytesAvailable() < it->frameSize)
+            break;
+
+        QByteArray buff = client->read(it->frameSize);
+        if (it->compressed)
+            buff = qUncompress(buff);
+
+        it->frameSize = -1;
+        it->compressed = false;
+
+        ProcMessageCPtr msg = ProcMessage::fromByteArray(buff);
+        if (!msg)
+        {
+            log_error_m << "Failed decode legacy message"
+                        << ". Host: " << client->peerAddress();
+            continue;
+        }
+        msg->setAddress(client->peerAddress());
+        processMessage(client, msg);
+    }
+}
+
+void MsgGateway::clientDisconnected()
+{
+    QTcpSocket* client = qobject_cast<QTcpSocket*>(sender());
+    if (_clients.remove(client) == 0)
+        return;
+
+    log_verbose_m << "Legacy client disconnected"
+                  << ". Host: " << client->peerAddress() << ":" << client->peerPort();
+
+    client->deleteLater();
+}
+
+void MsgGateway::processMessage(QTcpSocket* client, const ProcMessageCPtr& msg)
+{
+    ++_stats.received;
+
+    if (msg->command() == PacketProcMessage::command())
+    {
+        QList<QByteArray> commands;
+        msg->readContent(commands);
+        for (const QByteArray& command : commands)
+        {
+            ProcMessageCPtr m = ProcMessage::fromByteArray(command);
+            if (!m)
+                continue;
+
+            m->setAddress(msg->address());
+            processMessage(client, m);
+        }
+        return;
+    }
+    if (msg->command() == CMD_SERVER_INFO)
+    {
+        processServerInfo(client, msg);
+        return;
+    }
+
+    auto index = _legacyIndex.constFind(msg->command());
+    if (index == _legacyIndex.constEnd())
+    {
+        ++_stats.unmapped;
+        log_warn_m << "Legacy command " << msg->command()
+                   << " has no mapping. Message discarded";
+        return;
+    }
+
+    const Command& cmd = _commands[index.value()];
+    Message::Ptr message = cmd.toMessage(msg);
+    if (message.empty())
+    {
+        log_error_m << "Failed convert legacy command " << msg->command()
+                    << " to command " << CommandNameLog(cmd.command);
+        return;
+    }
+
+    if (message->type() == Message::Type::Command)
+    {
+        Pending pending;
+        pending.client = client;
+        pending.time = _timer.elapsed();
+        _pending.insert(message->id(), pending);
+    }
+    if (_socket->send(message))
+        ++_stats.forwarded;
+    else
+        _pending.remove(message->id());
+}
+
+void MsgGateway::processServerInfo(QTcpSocket* client, const ProcMessageCPtr& msg)
+{
+    ProductVersion clientVersion;
+    QVector<QUuidEx> clientCommands;
+    msg->readContent(clientVersion.vers, clientCommands);
+
+    QVector<QUuidEx> commands;
+    for (const Command& cmd : _commands)
+        commands.append(cmd.legacyCommand);
+
+    msg->writeContent(productVersion().vers, commands);
+    sendToClient(client, msg);
+}
+
+void MsgGateway::message(const Message::Ptr& message)
+{
+    auto index = _commandIndex.constFind(message->command());
+
+    if (message->type() == Message::Type::Answer)
+    {
+        auto it = _pending.find(message->id());
+        if (it == _pending.end())
+            return;
+
+        QPointer<QTcpSocket> client = it->client;
+        _pending.erase(it);
+
+        if (client.isNull() || index == _commandIndex.constEnd())
+            return;
+
+        if (ProcMessageCPtr msg = _commands[index.value()].fromMessage(message))
+        {
+            sendToClient(client, msg);
+            ++_stats.answers;
+        }
+        return;
+    }
+
+    if (message->type() == Message::Type::Event
+        && index != _commandIndex.constEnd())
+    {
+        ProcMessageCPtr msg = _commands[index.value()].fromMessage(message);
+        if (!msg)
+            return;
+
+        for (QTcpSocket* client : _clients.keys())
+            sendToClient(client, msg);
+
+        ++_stats.events;
+    }
+}
+
+void MsgGateway::expireAnswers()
+{
+    const qint64 expire = _timer.elapsed() - qint64(_answerTimeout) * 1000;
+
+    auto it = _pending.begin();
+    while (it != _pending.end())
+    {
+        if (it->time < expire || it->client.isNull())
+        {
+            if (it->time < expire)
+                ++_stats.expired;
+            it = _pending.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void MsgGateway::sendToClient(QTcpSocket* client, const ProcMessageCPtr& msg)
+{
+    QByteArray buff = msg->toByteArray();
+
+    const bool compressed = (buff.size() > compressionSize);
+    if (compressed)
+        buff = qCompress(buff);
+
+    qint32 frameSize = buff.size();
+    if (compressed)
+        frameSize *= -1;
+
+    client->write((const char*)&frameSize, sizeof(qint32));
+    client->write(buff);
+}
+
+} // namespace snd
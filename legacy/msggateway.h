@@ -0,0 +1,170 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Шлюз для клиентов, использующих устаревший протокол msgtransport
+  (см. legacy/msgtransport.h).
+
+  Шлюз принимает подключения клиентов CustomCommunicator, преобразует
+  сообщения ProcMessage (в том числе пакеты PacketProcMessage) в сообщения
+  pproto по таблице соответствия команд и пересылает их через pproto-сокет.
+  Ответы сопоставляются с исходными запросами по идентификатору pproto-сооб-
+  щения асинхронно и возвращаются клиенту, отправившему запрос. События
+  pproto, для которых задано соответствие, рассылаются всем подключенным
+  клиентам. Команда CMD_SERVER_INFO обрабатывается шлюзом, в списке команд
+  сервера клиенту передаются команды из таблицы соответствия.
+*****************************************************************************/
+
+#pragma once
+
+#include "transport/tcp.h"
+
+#include "msgcmd.h"
+#include "msgproc.h"
+
+#include "shared/defmac.h"
+#include <QtCore>
+#include <QtNetwork>
+#include <functional>
+
+namespace snd {
+
+class MsgGateway : public QTcpServer
+{
+public:
+    // Функции преобразования сообщений. Если преобразование невозможно,
+    // функция должна вернуть пустой указатель
+    typedef std::function<pproto::Message::Ptr (const ProcMessageCPtr&)> ToMessage;
+    typedef std::function<ProcMessageCPtr (const pproto::Message::Ptr&)> FromMessage;
+
+    struct Stats
+    {
+        // Количество сообщений, принятых от клиентов
+        quint64 received = {0};
+
+        // Количество сообщений, переданных в pproto-сокет
+        quint64 forwarded = {0};
+
+        // Количество ответов, возвращенных клиентам
+        quint64 answers = {0};
+
+        // Количество событий, разосланных клиентам
+        quint64 events = {0};
+
+        // Количество сообщений без соответствия в таблице команд
+        quint64 unmapped = {0};
+
+        // Количество запросов, ответ на которые не получен в течении
+        // answerTimeout()
+        quint64 expired = {0};
+    };
+
+    // Параметр socket определяет pproto-сокет, через который пересылаются
+    // сообщения. Подключение сокета выполняется вызывающей стороной
+    MsgGateway(const pproto::transport::tcp::Socket::Ptr& socket);
+    ~MsgGateway();
+
+    // Добавляет в таблицу соответствие между командой legacyCommand устарев-
+    // шего протокола и pproto-командой command. Функция toMessage исполь-
+    // зуется для преобразования запросов клиента, функция fromMessage - для
+    // преобразования ответов и событий pproto
+    void addCommand(const QUuidEx& legacyCommand, const QUuidEx& command,
+                    const ToMessage& toMessage, const FromMessage& fromMessage);
+
+    // Запускает прием подключений клиентов
+    bool init(const QHostAddress& address, quint16 port);
+
+    // Закрывает подключения клиентов
+    void close();
+
+    // Время ожидания (в секундах) ответа на команду. По истечении этого
+    // времени запрос удаляется из списка ожидающих ответа.
+    // Значение параметра по умолчанию равно 60 сек.
+    int answerTimeout() const {return _answerTimeout;}
+    void setAnswerTimeout(int val) {_answerTimeout = val;}
+
+    // Количество подключенных клиентов
+    int clientsCount() const {return _clients.count();}
+
+    Stats stats() const {return _stats;}
+
+protected:
+    void incomingConnection(pproto::SocketDescriptor) override;
+
+private slots:
+    void clientReadyRead();
+    void clientDisconnected();
+    void message(const pproto::Message::Ptr&);
+    void expireAnswers();
+
+private:
+    Q_OBJECT
+    DISABLE_DEFAULT_FUNC(MsgGateway)
+
+    struct Command
+    {
+        QUuidEx legacyCommand;
+        QUuidEx command;
+        ToMessage toMessage;
+        FromMessage fromMessage;
+    };
+
+    // Состояние приема кадра от клиента
+    struct Client
+    {
+        qint32 frameSize = {-1}; // -1: ожидается заголовок кадра
+        bool compressed = {false};
+    };
+
+    // Запрос, ожидающий ответа
+    struct Pending
+    {
+        QPointer<QTcpSocket> client;
+        qint64 time = {0};
+    };
+
+    void processMessage(QTcpSocket* client, const ProcMessageCPtr&);
+    void processServerInfo(QTcpSocket* client, const ProcMessageCPtr&);
+
+    // Отправляет сообщение клиенту в формате кадра устаревшего протокола
+    void sendToClient(QTcpSocket* client, const ProcMessageCPtr&);
+
+private:
+    pproto::transport::tcp::Socket::Ptr _socket;
+
+    QList<Command> _commands;
+    QHash<QUuidEx, int> _legacyIndex;  // Индекс по командам клиентов
+    QHash<QUuidEx, int> _commandIndex; // Индекс по pproto-командам
+
+    QHash<QTcpSocket*, Client> _clients;
+    QHash<QUuidEx, Pending> _pending;
+
+    QElapsedTimer _timer;
+    QTimer _expireTimer;
+    int _answerTimeout = {60};
+
+    Stats _stats;
+};
+
+} // namespace snd
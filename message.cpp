@@ -25,6 +25,7 @@
 
 #include "message.h"
 #include "serialize/byte_array.h"
+#include "probes.h"
 
 #ifdef PPROTO_JSON_SERIALIZE
 #include "serialize/json.h"
@@ -95,10 +96,8 @@ Message::Ptr Message::cloneForAnswer() const
     message->_proxyId = _proxyId;
     message->_taskId = _taskId;
     message->_accessId = _accessId;
-    message->_socketType = _socketType;
-    message->_sourcePoint = _sourcePoint;
-    message->_socketDescriptor = _socketDescriptor;
-    message->_socketName = _socketName;
+    message->_trace = _trace;
+    message->_connection = _connection;
     message->_auxiliary = _auxiliary;
 
     // Инициализируемые параметры
@@ -109,6 +108,16 @@ Message::Ptr Message::cloneForAnswer() const
     return message;
 }
 
+SocketType Message::socketType() const
+{
+    return !_connection.empty() ? _connection->socketType() : SocketType::Unknown;
+}
+
+HostPoint Message::sourcePoint() const
+{
+    return !_connection.empty() ? _connection->peerPoint() : HostPoint();
+}
+
 HostPoint::Set& Message::destinationPoints()
 {
     return _destinationPoints;
@@ -119,6 +128,11 @@ void Message::appendDestinationPoint(const HostPoint& hostPoint)
     _destinationPoints.insert(hostPoint);
 }
 
+SocketDescriptor Message::socketDescriptor() const
+{
+    return !_connection.empty() ? _connection->socketDescriptor() : SocketDescriptor(-1);
+}
+
 SocketDescriptorSet& Message::destinationSockets()
 {
     return _destinationSockets;
@@ -129,6 +143,11 @@ void Message::appendDestinationSocket(SocketDescriptor descriptor)
     _destinationSockets.insert(descriptor);
 }
 
+QString Message::socketName() const
+{
+    return !_connection.empty() ? _connection->socketName() : QString();
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch-enum"
 
@@ -143,6 +162,8 @@ void Message::compress(int level, Compression compression)
         return;
     }
     level = qBound(-1, level, 9);
+    joinSegments();
+
     int sz = size()
 #ifdef UDP_LONGSIG
            + sizeof(quint64); // UDP long signature
@@ -156,6 +177,7 @@ void Message::compress(int level, Compression compression)
     // байт.
     if (level != 0 && sz > 508)
     {
+        PPROTO_PROBE_MESSAGE(content_compress_begin, this, _content.size(), compression);
         switch (compression)
         {
             case Compression::Zip:
@@ -190,6 +212,7 @@ void Message::compress(int level, Compression compression)
                 log_error_m << "Unsupported compression algorithm";
                 prog_abort();
         }
+        PPROTO_PROBE_MESSAGE(content_compress_end, this, _content.size(), this->compression());
     }
 }
 
@@ -199,7 +222,7 @@ void Message::decompress(QByteArray& content) const
     {
         case Compression::None:
         case Compression::Disable:
-            content = _content;
+            content = _segments.isEmpty() ? _content : joinedContent();
             break;
 
         case Compression::Zip:
@@ -243,6 +266,48 @@ QByteArray Message::content() const
     return content;
 }
 
+void Message::clearContent()
+{
+    _content.clear();
+    _segments.clear();
+    _segmentsSize = 0;
+}
+
+void Message::appendContentSegment(const QByteArray& segment)
+{
+    if (segment.isEmpty())
+        return;
+
+    if (compression() != Compression::None
+        && compression() != Compression::Disable)
+    {
+        log_error_m << "Impossible append segment to compressed content";
+        return;
+    }
+    _segments.append(segment);
+    _segmentsSize += segment.size();
+}
+
+void Message::joinSegments()
+{
+    if (_segments.isEmpty())
+        return;
+
+    _content = joinedContent();
+    _segments.clear();
+    _segmentsSize = 0;
+}
+
+QByteArray Message::joinedContent() const
+{
+    QByteArray content;
+    content.reserve(contentRawSize());
+    content.append(_content);
+    for (const QByteArray& segment : _segments)
+        content.append(segment);
+    return content;
+}
+
 int Message::size() const
 {
     initNotEmptyTraits();
@@ -268,21 +333,41 @@ int Message::size() const
     if (_flag.taskIdNotEmpty)
         sz += sizeof(_taskId);
 
+    if (_flag2.traceNotEmpty)
+        sz += sizeof(_trace.traceId) + sizeof(_trace.parentSpan) + sizeof(_trace.sendTime);
+
     if (_flag.accessIdNotEmpty)
         sz += sizeof(quint32) + _accessId.size();
 
     if (_flag.contentNotEmpty)
-        sz += sizeof(quint32) + _content.size();
+        sz += sizeof(quint32) + contentRawSize();
+
+    return sz;
+}
+
+qint64 Message::memorySize() const
+{
+    qint64 sz = sizeof(Message)
+                + _tags.capacity() * sizeof(quint64)
+                + _accessId.capacity()
+                + _content.capacity()
+                + _segments.capacity() * sizeof(QByteArray)
+                + _destinationPoints.count() * sizeof(HostPoint)
+                + _destinationSockets.count() * sizeof(SocketDescriptor);
+
+    for (const QByteArray& segment : _segments)
+        sz += segment.capacity();
 
     return sz;
 }
 
 void Message::initNotEmptyTraits() const
 {
+    _flag2.traceNotEmpty    = !_trace.isEmpty();
     _flag.flags2NotEmpty    = (_flags2 != 0);
     _flag.tagsNotEmpty      = !_tags.isEmpty();
     _flag.maxTimeLfNotEmpty = (_maxTimeLife != quint64(-1));
-    _flag.contentNotEmpty   = !_content.isEmpty();
+    _flag.contentNotEmpty   = !contentIsEmpty();
     _flag.proxyIdNotEmpty   = (_proxyId != 0);
     _flag.taskIdNotEmpty    = !_taskId.isNull();
     _flag.accessIdNotEmpty  = !_accessId.isEmpty();
@@ -301,6 +386,19 @@ QByteArray Message::toQBinary() const
     return ba;
 }
 
+QByteArray Message::toQBinary(QVector<QByteArray>& segments) const
+{
+    QByteArray ba;
+    ba.reserve(size() - _segmentsSize);
+    {
+        QDataStream stream {&ba, QIODevice::WriteOnly};
+        STREAM_INIT(stream);
+        toDataStream(stream, false);
+    }
+    segments += _segments;
+    return ba;
+}
+
 Message::Ptr Message::fromQBinary(const QByteArray& ba)
 {
     QDataStream stream {(QByteArray*)&ba, QIODevice::ReadOnly | QIODevice::Unbuffered};
@@ -309,6 +407,11 @@ Message::Ptr Message::fromQBinary(const QByteArray& ba)
 }
 
 void Message::toDataStream(QDataStream& stream) const
+{
+    toDataStream(stream, true);
+}
+
+void Message::toDataStream(QDataStream& stream, bool writeSegments) const
 {
     initNotEmptyTraits();
 
@@ -336,11 +439,31 @@ void Message::toDataStream(QDataStream& stream) const
     if (_flag.taskIdNotEmpty)
         stream << _taskId;
 
+    if (_flag2.traceNotEmpty)
+    {
+        stream << _trace.traceId;
+        stream << _trace.parentSpan;
+        stream << _trace.sendTime;
+    }
     if (_flag.accessIdNotEmpty)
         stream << _accessId;
 
     if (_flag.contentNotEmpty)
-        stream << _content;
+    {
+        if (_segments.isEmpty())
+        {
+            stream << _content;
+        }
+        else
+        {
+            // Формат записи совпадает с форматом записи QByteArray
+            stream << quint32(contentRawSize());
+            stream.writeRawData(_content.constData(), _content.size());
+            if (writeSegments)
+                for (const QByteArray& segment : _segments)
+                    stream.writeRawData(segment.constData(), segment.size());
+        }
+    }
 }
 
 Message::Ptr Message::fromDataStream(QDataStream& stream)
@@ -377,6 +500,13 @@ Message::Ptr Message::fromDataStream(QDataStream& stream)
     if (message->_flag.taskIdNotEmpty)
         stream >> message->_taskId;
 
+    if (message->_flag2.traceNotEmpty)
+    {
+        stream >> message->_trace.traceId;
+        stream >> message->_trace.parentSpan;
+        stream >> message->_trace.sendTime;
+    }
+
     if (message->_flag.accessIdNotEmpty)
     {
         //stream >> message->_accessId;
@@ -464,6 +594,15 @@ QByteArray Message::toJson(bool webFlags) const
         const QByteArray& taskId = _taskId.toByteArray();
         writer.String(taskId.constData() + 1, SizeType(taskId.length() - 2));
     }
+    if (_flag2.traceNotEmpty)
+    {
+        writer.Key("trace");
+        writer.StartArray();
+        writer.Uint64(_trace.traceId);
+        writer.Uint64(_trace.parentSpan);
+        writer.Int64(_trace.sendTime);
+        writer.EndArray();
+    }
     if (_flag.accessIdNotEmpty)
     {
         // stream << _accessId;
@@ -476,8 +615,9 @@ QByteArray Message::toJson(bool webFlags) const
     if (_flag.contentNotEmpty)
     {
         // stream << _content;
+        const QByteArray& content = _segments.isEmpty() ? _content : joinedContent();
         writer.Key("content");
-        writer.RawValue(_content.constData(), size_t(_content.length()), kObjectType);
+        writer.RawValue(content.constData(), size_t(content.length()), kObjectType);
     }
 
 #pragma GCC diagnostic push
@@ -619,6 +759,13 @@ Message::Ptr Message::fromJson(const QByteArray& ba)
                                                            member->value.GetStringLength());
             message->_taskId = QUuidEx(ba);
         }
+        else if (stringEqual("trace", member->name) && member->value.IsArray()
+                 && member->value.Size() == 3)
+        {
+            message->_trace.traceId    = member->value[0].GetUint64();
+            message->_trace.parentSpan = member->value[1].GetUint64();
+            message->_trace.sendTime   = member->value[2].GetInt64();
+        }
         else if (stringEqual("accessId", member->name) && member->value.IsString())
         {
             accessIdNotEmpty = true;
@@ -49,6 +49,7 @@
 namespace pproto {
 
 namespace transport {
+namespace base  {class Socket;}
 namespace local {class Socket;}
 namespace tcp   {class Socket;}
 namespace udp   {class Socket;}
@@ -76,6 +77,75 @@ enum class SerializeFormat
   //LastFormat = 7  Предполагается, что будет не больше 8 форматов
 };
 
+/**
+  Сведения о соединении, через которое было получено сообщение. Создаются один
+  раз при установке TCP/Local соединения и разделяются всеми сообщениями, при-
+  нятыми через это соединение, а также ответами на них (см. Message::clone-
+  ForAnswer()). После создания не изменяются, поэтому могут использоваться
+  из разных потоков без синхронизации
+*/
+class ConnectionContext : public clife_base
+{
+public:
+    typedef clife_ptr<ConnectionContext> Ptr;
+
+    ConnectionContext(SocketType socketType, SocketDescriptor socketDescriptor,
+                      const HostPoint& peerPoint, const QString& socketName,
+                      SerializeFormat messageFormat, bool encryption)
+        : _socketType(socketType),
+          _socketDescriptor(socketDescriptor),
+          _peerPoint(peerPoint),
+          _socketName(socketName),
+          _messageFormat(messageFormat),
+          _encryption(encryption)
+    {}
+
+    // Тип сокета
+    SocketType socketType() const {return _socketType;}
+
+    // Идентификатор сокета. Для UDP сокета равен -1
+    SocketDescriptor socketDescriptor() const {return _socketDescriptor;}
+
+    // Адрес и порт удаленного хоста. Имеет валидное значение только для
+    // SocketType::Tcp и SocketType::Udp
+    const HostPoint& peerPoint() const {return _peerPoint;}
+
+    // Наименование сокета. Имеет валидное значение только для SocketType::Local
+    const QString& socketName() const {return _socketName;}
+
+    // Согласованный с удаленной стороной формат сериализации сообщений
+    SerializeFormat messageFormat() const {return _messageFormat;}
+
+    // Признак шифрования сообщений
+    bool encryption() const {return _encryption;}
+
+private:
+    DISABLE_DEFAULT_FUNC(ConnectionContext)
+
+    const SocketType _socketType;
+    const SocketDescriptor _socketDescriptor;
+    const HostPoint _peerPoint;
+    const QString _socketName;
+    const SerializeFormat _messageFormat;
+    const bool _encryption;
+};
+
+/**
+  Контекст трассировки сообщения. Передается в заголовке сообщения и исполь-
+  зуется для измерения задержек при прохождении сообщения через цепочку
+  сервисов (см. trace.h)
+*/
+struct TraceContext
+{
+    quint64 traceId    = {0}; // Идентификатор трассы
+    quint64 parentSpan = {0}; // Идентификатор участка трассы, на котором
+                              // было создано (переслано) сообщение
+    qint64  sendTime   = {0}; // Время постановки сообщения в очередь
+                              // на отправку (мкс, UTC)
+
+    bool isEmpty() const {return (traceId == 0);}
+};
+
 class Message : public clife_base
 {
     struct Allocator {void destroy(Message* x) {if (x) x->release();}};
@@ -164,7 +234,8 @@ public:
     ExecStatus execStatus() const;
     void setExecStatus(ExecStatus);
 
-    // Приоритет сообщения
+    // Приоритет сообщения. Учитывается при отправке сообщения и при передаче
+    // принятого сообщения в обработчики
     Priority priority() const;
     void setPriority(Priority);
 
@@ -186,13 +257,17 @@ public:
     quint64 maxTimeLife() const {return _maxTimeLife;}
     void setMaxTimeLife(quint64 val) {_maxTimeLife = val;}
 
+    // Сведения о соединении, через которое было получено сообщение. Для
+    // сообщений, созданных локально, возвращает пустой указатель
+    const ConnectionContext::Ptr& connection() const {return _connection;}
+
     // Тип сокета из которого было получено сообщение
-    SocketType socketType() const {return _socketType;}
+    SocketType socketType() const;
 
     // Адрес и порт хоста с которого было получено сообщение. Поле имеет
     // валидное значение только если тип сокета соответствует значениям
     // SocketType::Tcp или SocketType::Udp
-    HostPoint sourcePoint() const {return _sourcePoint;}
+    HostPoint sourcePoint() const;
 
     // Адреса и порты хостов  назначения.  Параметр  используется  для отправки
     // сообщения  через UDP сокет.  В случае  если  параметр  destinationPoints
@@ -208,7 +283,7 @@ public:
     // для идентификации TCP (или Local) сокета принявшего сообщение.
     // Поле имеет валидное значение только если тип сокета соответствует значе-
     // ниям SocketType::Tcp или SocketType::Local
-    SocketDescriptor socketDescriptor() const {return _socketDescriptor;}
+    SocketDescriptor socketDescriptor() const;
 
     // Параметр содержит идентификаторы  сокетов  на  которые  нужно  отправить
     // сообщение.  Eсли  параметр  destinationSockets  не  содержит  ни  одного
@@ -222,7 +297,7 @@ public:
 
     // Наименование сокета  с которого  было  получено  сообщение.  Поле  имеет
     // валидное значение только если тип сокета соответствует SocketType::Local
-    QString socketName() const {return _socketName;}
+    QString socketName() const;
 
     // Вспомогательный параметр, используется для хранения произвольной инфор-
     // мации. Данный параметр не сериализуется, поэтому он не является частью
@@ -261,10 +336,26 @@ public:
     QByteArray content() const;
 
     // Удаляет контент сообщения
-    void clearContent() {_content.clear();}
+    void clearContent();
 
     // Возвращает TRUE если сообщение не содержит контент
-    bool contentIsEmpty() const {return _content.isEmpty();}
+    bool contentIsEmpty() const {return _content.isEmpty() && _segments.isEmpty();}
+
+    // Размер контента в том виде, в котором он хранится в сообщении (с учетом
+    // сжатия). Используется транспортным уровнем
+    int contentRawSize() const {return _content.size() + _segmentsSize;}
+
+    // Добавляет в конец контента сегмент данных. Данные сегмента не копируют-
+    // ся (используется механизм implicit sharing), поэтому после добавления
+    // сегмент не должен изменяться. При отправке сообщения в бинарном формате
+    // сегменты передаются в сокет без объединения в общий буфер.
+    // Сегменты используются совместно с функцией writeContent(): сначала
+    // записывается заголовок контента (например, размеры массивов), затем
+    // добавляются сегменты. Сжатие контента объединяет сегменты
+    void appendContentSegment(const QByteArray&);
+
+    // Возвращает TRUE если контент содержит сегменты
+    bool contentIsSegmented() const {return !_segments.isEmpty();}
 
     // Формат сериализации контента
     SerializeFormat contentFormat() const;
@@ -311,6 +402,14 @@ public:
     QByteArray accessId() const {return _accessId;}
     void setAccessId(const QByteArray& val) {_accessId = val;}
 
+    // !!! Экспериментальная функция !!!
+    // Контекст трассировки сообщения. Признак наличия контекста передается
+    // в поле _flags2. Узлы, использующие предыдущие версии библиотеки,  не
+    // смогут разобрать сообщение с контекстом трассировки, поэтому трасси-
+    // ровка должна использоваться только после обновления всех узлов цепочки
+    TraceContext trace() const {return _trace;}
+    void setTrace(const TraceContext& val) {_trace = val;}
+
 #ifdef PPROTO_QBINARY_SERIALIZE
     // Функция записи данных
     template<typename... Args>
@@ -325,6 +424,11 @@ public:
     QByteArray toQBinary() const;
     static Ptr fromQBinary(const QByteArray&);
 
+    // Сериализует сообщение без копирования сегментов контента. Возвращает
+    // начальную часть сообщения, сегменты контента добавляются в segments.
+    // Последовательность из результата и segments совпадает с toQBinary()
+    QByteArray toQBinary(QVector<QByteArray>& segments) const;
+
     void toDataStream(QDataStream&) const;
     static Ptr fromDataStream(QDataStream&);
 #endif
@@ -347,6 +451,11 @@ public:
     // UDP датаграммы
     int size() const;
 
+    // Возвращает приблизительный объем памяти (в байтах), занимаемый сообще-
+    // нием. Буферы контента, разделяемые с другими объектами (implicit sharing),
+    // учитываются полностью. Используется для учета памяти очередей сокета
+    qint64 memorySize() const;
+
 private:
     Message();
     DISABLE_DEFAULT_COPY(Message)
@@ -354,6 +463,10 @@ private:
     void initNotEmptyTraits() const;
     void decompress(QByteArray&) const;
 
+    // Объединяет сегменты контента с основным буфером
+    void joinSegments();
+    QByteArray joinedContent() const;
+
 #ifdef PPROTO_QBINARY_SERIALIZE
     template<typename T, typename... Args>
     void writeInternal(QDataStream& s, const T& t, const Args&... args);
@@ -362,12 +475,11 @@ private:
     template<typename T, typename... Args>
     void readInternal(QDataStream& s, T& t, Args&... args) const;
     void readInternal(QDataStream&) const {}
+
+    void toDataStream(QDataStream&, bool writeSegments) const;
 #endif
 
-    void setSocketType(SocketType val) {_socketType = val;}
-    void setSourcePoint(const HostPoint& val) {_sourcePoint = val;}
-    void setSocketDescriptor(SocketDescriptor val) {_socketDescriptor = val;}
-    void setSocketName(const QString& val) {_socketName = val;}
+    void setConnection(const ConnectionContext::Ptr& val) {_connection = val;}
 
     void setContentFormat(SerializeFormat);
 
@@ -426,24 +538,37 @@ private:
         } _flag;
     };
 
-    // Зарезервировано для будущего использования
-    quint32 _flags2;
+    // Дополнительные битовые флаги
+    union {
+        quint32 _flags2; // Поле содержит значения всех флагов, используется
+                         // при сериализации
+        struct {
+            // Признаки не пустых полей, используются для оптимизации размера
+            // сообщения при его сериализации
+            mutable quint32 traceNotEmpty: 1;
+            quint32 reserved: 31;
+        } _flag2;
+    };
 
     QVector<quint64> _tags;
     quint64 _maxTimeLife = {quint64(-1)};
     quint64 _proxyId = {0};
     QUuidEx _taskId;
     QByteArray _accessId;
+    TraceContext _trace;
     QByteArray _content;
-    SocketType _socketType = {SocketType::Unknown};
-    HostPoint _sourcePoint;
+
+    // Сегменты контента, следуют за _content
+    QVector<QByteArray> _segments;
+    int _segmentsSize = {0};
+
+    ConnectionContext::Ptr _connection;
     HostPoint::Set _destinationPoints;
-    SocketDescriptor _socketDescriptor = {-1};
     SocketDescriptorSet _destinationSockets;
-    QString _socketName;
     qint64 _auxiliary = {0};
     mutable std::atomic_bool _processed = {false};
 
+    friend class transport::base::Socket;
     friend class transport::local::Socket;
     friend class transport::tcp::Socket;
     friend class transport::udp::Socket;
@@ -456,7 +581,7 @@ private:
 template<typename... Args>
 SResult Message::writeContent(const Args&... args)
 {
-    _content.clear();
+    clearContent();
     setContentFormat(SerializeFormat::QBinary);
     QDataStream stream {&_content, QIODevice::WriteOnly};
     STREAM_INIT(stream);
@@ -504,6 +629,7 @@ template<typename T>
 SResult Message::writeJsonContent(const T& t)
 {
     setContentFormat(SerializeFormat::Json);
+    clearContent();
     _content = const_cast<T&>(t).toJson();
     return SResult(true);
 }
@@ -511,7 +637,7 @@ SResult Message::writeJsonContent(const T& t)
 template<typename T>
 SResult Message::readJsonContent(T& t) const
 {
-    return t.fromJson(_content);
+    return t.fromJson(_segments.isEmpty() ? _content : joinedContent());
 }
 #endif
 
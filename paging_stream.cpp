@@ -0,0 +1,480 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "paging_stream.h"
+#include "logger_operators.h"
+#include "serialize/functions.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <ctime>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Paging")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Paging")
+#define log_info_m    alog::logger().info    (alog_line_location, "Paging")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Paging")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Paging")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Paging")
+
+namespace pproto::paging {
+
+//------------------------------- CursorPool ---------------------------------
+
+CursorPool::CursorPool(transport::base::Listener* listener)
+    : _listener(listener)
+{
+    Q_ASSERT(_listener);
+}
+
+CursorPool::~CursorPool()
+{
+    stop();
+}
+
+bool CursorPool::open(const Message::Ptr& command, const data::PagingInfo& paging,
+                      const PageFunc& pageFunc, QUuidEx& cursorId)
+{
+    cursorId = QUuidEx();
+
+    Cursor cursor;
+    cursor.id = QUuid::createUuid();
+    cursor.command = command;
+    cursor.paging = paging;
+    cursor.paging.cursor = cursor.id;
+    cursor.paging.page = 0;
+    cursor.paging.last = false;
+    cursor.pageFunc = pageFunc;
+    cursor.credit = (paging.window > 1) ? (paging.window - 1) : 0;
+    cursor.activity = std::time(nullptr);
+
+    bool sent;
+    if (!sendPage(cursor, sent))
+        return sent;
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_cursorsLock}; (void) locker;
+        _cursors.insert(cursor.id, cursor);
+        if (cursor.credit)
+            _queue.append(cursor.id);
+    }
+    _cursorsCond.wakeAll();
+
+    log_debug_m << "Cursor " << cursor.id << " opened for command "
+                << CommandNameLog(command->command())
+                << "; Window: " << paging.window;
+
+    cursorId = cursor.id;
+    return true;
+}
+
+bool CursorPool::credit(const Message::Ptr& message)
+{
+    if (message->command() != command::PagingCredit)
+        return false;
+
+    data::PagingCredit pagingCredit;
+    readFromMessage(message, pagingCredit);
+    if (!pagingCredit.dataIsValid)
+        return true;
+
+    if (pagingCredit.close)
+    {
+        close(pagingCredit.cursor);
+        return true;
+    }
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_cursorsLock}; (void) locker;
+        auto it = _cursors.find(pagingCredit.cursor);
+        if (it == _cursors.end())
+        {
+            log_debug2_m << "Cursor " << pagingCredit.cursor << " not found";
+            return true;
+        }
+        Cursor& cursor = it.value();
+        if (cursor.command->socketDescriptor() != message->socketDescriptor())
+        {
+            log_error_m << "Credit for cursor " << cursor.id
+                        << " received from foreign socket";
+            return true;
+        }
+        if (cursor.credit == 0 && !cursor.busy)
+            _queue.append(cursor.id);
+
+        cursor.credit += pagingCredit.pages;
+        cursor.activity = std::time(nullptr);
+    }
+    _cursorsCond.wakeAll();
+    return true;
+}
+
+void CursorPool::close(const QUuidEx& cursor)
+{
+    QMutexLocker locker {&_cursorsLock}; (void) locker;
+    if (_cursors.remove(cursor))
+    {
+        _queue.removeAll(cursor);
+        log_debug_m << "Cursor " << cursor << " closed";
+    }
+}
+
+int CursorPool::cursorsCount() const
+{
+    QMutexLocker locker {&_cursorsLock}; (void) locker;
+    return _cursors.count();
+}
+
+bool CursorPool::sendPage(Cursor& cursor, bool& sent)
+{
+    sent = false;
+
+    transport::base::Socket::Ptr socket =
+        _listener->socketByDescriptor(cursor.command->socketDescriptor());
+
+    if (socket.empty() || !socket->isConnected())
+    {
+        log_debug_m << "Cursor " << cursor.id << " will be closed"
+                    << ". Socket is disconnected";
+        return false;
+    }
+
+    Message::Ptr page;
+    if (cursor.paging.page == 0)
+    {
+        page = cursor.command->cloneForAnswer();
+    }
+    else
+    {
+        page = Message::create(cursor.command->command(),
+                               cursor.command->contentFormat());
+        page->setType(Message::Type::Event);
+        page->appendDestinationSocket(cursor.command->socketDescriptor());
+    }
+
+    data::PagingInfo paging = cursor.paging;
+    paging.offset = cursor.paging.offset + cursor.paging.page * cursor.paging.limit;
+    paging.cursor = cursor.id;
+    paging.last = false;
+
+    if (!cursor.pageFunc(page, paging))
+    {
+        log_error_m << "Page " << cursor.paging.page << " of cursor " << cursor.id
+                    << " cannot be formed. Cursor aborted";
+
+        // Клиент должен получить ответ на исходную команду, либо уведомление
+        // о прерывании выборки, иначе он будет бесконечно ожидать страницу
+        if (cursor.paging.page == 0)
+        {
+            Message::Ptr answer = cursor.command->cloneForAnswer();
+            writeToMessage(error::paging_cursor_abort.asFailed(), answer,
+                           cursor.command->contentFormat());
+            socket->send(answer);
+        }
+        else
+        {
+            data::PagingAbort pagingAbort;
+            pagingAbort.cursor = cursor.id;
+            pagingAbort.page = cursor.paging.page;
+            pagingAbort.description = error::paging_cursor_abort.description;
+
+            Message::Ptr m = createMessage(pagingAbort, {Message::Type::Event,
+                                                         cursor.command->contentFormat()});
+            m->appendDestinationSocket(cursor.command->socketDescriptor());
+            socket->send(m);
+        }
+        return false;
+    }
+
+    socket->send(page);
+    sent = true;
+
+    ++cursor.paging.page;
+    cursor.paging.total = paging.total;
+    cursor.paging.last = paging.last;
+    return !paging.last;
+}
+
+void CursorPool::run()
+{
+    log_info_m << "Started";
+
+    while (true)
+    {
+        if (threadStop())
+            break;
+
+        Cursor cursor;
+        QList<QUuidEx> expired;
+
+        { //Block for QMutexLocker
+            QMutexLocker locker {&_cursorsLock}; (void) locker;
+
+            if (_queue.isEmpty())
+            {
+                _cursorsCond.wait(&_cursorsLock, 50);
+
+                qint64 curTime = std::time(nullptr);
+                for (auto it = _cursors.cbegin(); it != _cursors.cend(); ++it)
+                    if (!it->busy && (it->activity + _idleTimeout) < curTime)
+                        expired.append(it.key());
+
+                for (const QUuidEx& id : expired)
+                {
+                    _cursors.remove(id);
+                    _queue.removeAll(id);
+                }
+            }
+            if (!_queue.isEmpty())
+            {
+                auto it = _cursors.find(_queue.takeFirst());
+                if (it != _cursors.end())
+                {
+                    it->busy = true;
+                    cursor = it.value();
+                }
+            }
+        }
+
+        for (const QUuidEx& id : expired)
+            log_debug_m << "Cursor " << id << " closed by idle timeout";
+
+        if (cursor.id.isNull())
+            continue;
+
+        // Страница формируется вне блокировки
+        bool sent;
+        bool next = sendPage(cursor, sent);
+
+        QMutexLocker locker {&_cursorsLock}; (void) locker;
+        auto it = _cursors.find(cursor.id);
+        if (it == _cursors.end())
+            continue;
+
+        if (!next)
+        {
+            _cursors.erase(it);
+            if (sent)
+                log_debug_m << "Cursor " << cursor.id << " finished"
+                            << "; Pages: " << cursor.paging.page;
+            continue;
+        }
+
+        // Кредит мог быть увеличен пока формировалась страница
+        it->busy = false;
+        it->paging = cursor.paging;
+        it->credit -= 1;
+        if (it->credit)
+            _queue.append(cursor.id); // Round-robin между курсорами
+    }
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_cursorsLock}; (void) locker;
+        _cursors.clear();
+        _queue.clear();
+    }
+    log_info_m << "Stopped";
+}
+
+//------------------------------ CursorReader --------------------------------
+
+CursorReader::CursorReader(const transport::base::Socket::Ptr& socket, quint32 window)
+    : _socket(socket),
+      _window(window ? window : 1)
+{}
+
+data::PagingInfo CursorReader::initPaging(quint32 limit) const
+{
+    data::PagingInfo paging;
+    paging.limit = limit;
+    paging.window = _window;
+    return paging;
+}
+
+void CursorReader::append(const Message::Ptr& page, const data::PagingInfo& paging)
+{
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        if (_closed)
+            return;
+
+        if (_cursor.isNull())
+        {
+            _cursor = paging.cursor;
+            _command = page->command();
+            applyAbort();
+        }
+        else if (_cursor != paging.cursor)
+        {
+            log_error_m << "Page of foreign cursor " << paging.cursor
+                        << " rejected. Expected cursor: " << _cursor;
+            return;
+        }
+        if (paging.page < _nextPage)
+            return;
+
+        // Страницы-события могут обогнать страницу-ответ, поэтому порядок
+        // восстанавливается по номеру страницы
+        _pages.insert(paging.page, page);
+        if (paging.last || paging.cursor.isNull())
+            _lastPage = paging.page;
+    }
+    _cond.wakeAll();
+}
+
+Message::Ptr CursorReader::take(unsigned long timeout)
+{
+    Message::Ptr page;
+    quint32 credit = 0;
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        if (_closed || _nextPage > _lastPage)
+            return {};
+
+        while (!_pages.contains(_nextPage))
+        {
+            if (!_cond.wait(&_lock, timeout)
+                || _closed || _nextPage > _lastPage)
+            {
+                return {};
+            }
+        }
+
+        page = _pages.take(_nextPage++);
+
+        // Кредит возвращается пачками по половине окна, чтобы не отправлять
+        // отдельное сообщение на каждую обработанную страницу
+        if (_nextPage <= _lastPage && ++_consumed >= qMax(_window / 2, 1u))
+        {
+            credit = _consumed;
+            _consumed = 0;
+        }
+    }
+    if (credit)
+        sendCredit(credit, false);
+
+    return page;
+}
+
+bool CursorReader::abort(const Message::Ptr& message)
+{
+    if (message->command() != command::PagingAbort)
+        return false;
+
+    data::PagingAbort pagingAbort;
+    readFromMessage(message, pagingAbort);
+    if (!pagingAbort.dataIsValid || pagingAbort.page == 0)
+        return true;
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        if (!_cursor.isNull() && _cursor != pagingAbort.cursor)
+            return false;
+
+        _abortCursor = pagingAbort.cursor;
+        _abortPage = pagingAbort.page;
+        _abortDescription = pagingAbort.description;
+        applyAbort();
+    }
+    _cond.wakeAll();
+    return true;
+}
+
+bool CursorReader::aborted() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _aborted;
+}
+
+QString CursorReader::abortDescription() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _abortDescription;
+}
+
+bool CursorReader::finished() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return (_nextPage > _lastPage);
+}
+
+void CursorReader::close()
+{
+    bool closeCursor;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        if (_closed)
+            return;
+        closeCursor = !_cursor.isNull() && _nextPage <= _lastPage;
+        _closed = true;
+        _pages.clear();
+    }
+    // Ожидающий вызов take() должен завершиться  в  том  числе  когда
+    // курсор на стороне сервера еще не известен
+    _cond.wakeAll();
+
+    if (closeCursor)
+        sendCredit(0, true);
+}
+
+QUuidEx CursorReader::cursor() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _cursor;
+}
+
+void CursorReader::applyAbort()
+{
+    if (_cursor.isNull() || _abortCursor != _cursor)
+        return;
+
+    // Страницы, предшествующие прерванной, уже отправлены сервером
+    _aborted = true;
+    _lastPage = qMin(_lastPage, _abortPage - 1);
+    log_warn_m << "Cursor " << _cursor << " aborted on page " << _abortPage
+               << ". Detail: " << _abortDescription;
+}
+
+void CursorReader::sendCredit(quint32 pages, bool close)
+{
+    data::PagingCredit pagingCredit;
+    pagingCredit.cursor = cursor();
+    pagingCredit.pages = pages;
+    pagingCredit.close = close;
+
+    if (pagingCredit.cursor.isNull())
+        return;
+
+    Message::Ptr message =
+        createMessage(pagingCredit, {Message::Type::Event, _socket->messageFormat()});
+    message->setPriority(Message::Priority::High);
+    _socket->send(message);
+}
+
+} // namespace pproto::paging
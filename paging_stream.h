@@ -0,0 +1,208 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Потоковая постраничная выборка данных.
+
+  В классической схеме клиент  для получения  каждой  страницы  данных  отправ-
+  ляет отдельную команду с заполненной структурой PagingInfo (limit/offset),
+  что дает одну задержку (RTT) на каждую страницу. В потоковом режиме клиент
+  отправляет исходную команду один раз, указав в PagingInfo размер окна
+  (window), после чего сервер открывает курсор и самостоятельно  отправляет
+  страницы, не дожидаясь отдельных запросов.  Количество  страниц  в  пути
+  ограничено кредитом:  клиент  по мере обработки  полученных  страниц  воз-
+  вращает кредит командой PagingCredit.
+
+  Первая страница отправляется как ответ (Answer) на исходную команду, все
+  последующие страницы отправляются как события (Event) той же команды, но
+  только в сокет, из которого пришла исходная команда. Поэтому  структура
+  данных команды должна допускать тип сообщения Event.
+
+  Если страница не может быть сформирована, то выборка прерывается: вместо
+  первой страницы отправляется ответ с ошибкой error::paging_cursor_abort,
+  вместо последующих страниц - событие PagingAbort (см. CursorReader::
+  abort()).
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/paging.h"
+#include "transport/base.h"
+
+#include "shared/qt/qthreadex.h"
+#include "shared/qt/quuidex.h"
+
+#include <QtCore>
+#include <functional>
+
+namespace pproto::paging {
+
+/**
+  Серверная часть. Хранит открытые курсоры и отправляет страницы данных
+  в соответствии с выданным клиентом кредитом
+*/
+class CursorPool : public QThreadEx
+{
+public:
+    // Функция формирования страницы данных. Сообщение page уже имеет нужный
+    // идентификатор команды, тип и формат контента; функция должна записать
+    // в него контент (writeToMessage). Параметр paging содержит limit/offset
+    // для текущей страницы,  при формировании последней страницы  функция
+    // должна установить paging.last = true.
+    // Если функция возвращает FALSE, то курсор закрывается, а вместо стра-
+    // ницы клиенту отправляется уведомление о прерывании выборки
+    typedef std::function<bool (const Message::Ptr& page, data::PagingInfo&)> PageFunc;
+
+    CursorPool(transport::base::Listener*);
+    ~CursorPool();
+
+    // Открывает курсор для исходной команды command. Первая страница форми-
+    // руется и отправляется в рамках вызова функции. В параметре cursor
+    // возвращается идентификатор курсора, или пустой идентификатор, если
+    // выборка завершилась на первой странице.
+    // Возвращает FALSE если первая страница не была отправлена: функция
+    // pageFunc вернула FALSE (в этом случае на исходную команду отправлен
+    // ответ с ошибкой error::paging_cursor_abort), или сокет отключен
+    bool open(const Message::Ptr& command, const data::PagingInfo&,
+              const PageFunc& pageFunc, QUuidEx& cursor);
+
+    // Обрабатывает сообщение PagingCredit. Возвращает TRUE если сообщение
+    // было обработано
+    bool credit(const Message::Ptr&);
+
+    // Закрывает курсор
+    void close(const QUuidEx& cursor);
+
+    // Количество открытых курсоров
+    int cursorsCount() const;
+
+    // Время (в секундах) в течении которого курсор может не получать кредит.
+    // По истечении этого времени курсор будет закрыт
+    int idleTimeout() const {return _idleTimeout;}
+    void setIdleTimeout(int val) {_idleTimeout = val;}
+
+private:
+    DISABLE_DEFAULT_COPY(CursorPool)
+
+    void run() override;
+
+    // Формирует и отправляет очередную страницу курсора. Возвращает FALSE
+    // если курсор должен быть закрыт. Параметр sent принимает значение
+    // FALSE если страница не была отправлена
+    struct Cursor;
+    bool sendPage(Cursor&, bool& sent);
+
+private:
+    struct Cursor
+    {
+        QUuidEx id;
+        Message::Ptr command;
+        data::PagingInfo paging;
+        PageFunc pageFunc;
+        quint32 credit = {0};
+        qint64 activity = {0};
+        bool busy = {false};
+    };
+
+    transport::base::Listener* _listener;
+
+    QHash<QUuidEx, Cursor> _cursors;
+    QList<QUuidEx> _queue;
+    mutable QMutex _cursorsLock;
+    QWaitCondition _cursorsCond;
+
+    int _idleTimeout = {60};
+};
+
+/**
+  Клиентская часть. Принимает страницы данных, восстанавливает их порядок
+  и возвращает кредит серверу по мере обработки страниц
+*/
+class CursorReader
+{
+public:
+    CursorReader(const transport::base::Socket::Ptr&, quint32 window = 8);
+
+    // Возвращает структуру PagingInfo для исходной команды
+    data::PagingInfo initPaging(quint32 limit) const;
+
+    // Добавляет полученную страницу (ответ или событие исходной команды).
+    // Параметр paging должен быть прочитан из контента страницы
+    void append(const Message::Ptr& page, const data::PagingInfo& paging);
+
+    // Извлекает очередную страницу в порядке их следования. Если страница
+    // не была получена в течении timeout (мс), или чтение прервано вызовом
+    // close(), то возвращает пустой указатель
+    Message::Ptr take(unsigned long timeout = ULONG_MAX);
+
+    // Обрабатывает сообщение PagingAbort. После прерывания выборки функция
+    // take() возвращает только страницы, предшествующие прерванной. Возвра-
+    // щает TRUE если сообщение было обработано
+    bool abort(const Message::Ptr&);
+
+    // Возвращает TRUE если выборка была прервана на стороне сервера
+    bool aborted() const;
+
+    // Описание причины прерывания выборки
+    QString abortDescription() const;
+
+    // Возвращает TRUE если все страницы получены и извлечены (в том числе
+    // когда выборка была прервана)
+    bool finished() const;
+
+    // Закрывает курсор на стороне сервера
+    void close();
+
+    QUuidEx cursor() const;
+
+private:
+    DISABLE_DEFAULT_COPY(CursorReader)
+    void sendCredit(quint32 pages, bool close);
+    void applyAbort();
+
+private:
+    transport::base::Socket::Ptr _socket;
+    const quint32 _window;
+
+    QUuidEx _cursor;
+    QUuidEx _command;
+    QMap<quint32, Message::Ptr> _pages;
+    quint32 _nextPage = {0};
+    quint32 _lastPage = {quint32(-1)};
+    quint32 _consumed = {0};
+    bool _closed = {false};
+
+    // Прерывание выборки. Уведомление может быть получено раньше первой
+    // страницы, в этом случае оно применяется после получения идентифика-
+    // тора курсора
+    QUuidEx _abortCursor;
+    quint32 _abortPage = {0};
+    QString _abortDescription;
+    bool _aborted = {false};
+
+    mutable QMutex _lock;
+    QWaitCondition _cond;
+};
+
+} // namespace pproto::paging
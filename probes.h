@@ -0,0 +1,101 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Статические точки трассировки (USDT) для профилирования посредством perf,
+  bpftrace, SystemTap. Точки трассировки включаются параметром сборки
+  USDT_PROBES, для сборки требуется заголовочный файл sys/sdt.h (пакет
+  systemtap-sdt-dev). Без параметра сборки макросы не генерируют кода.
+  Неактивная точка трассировки представляет собой инструкцию NOP, при
+  этом аргументы точки вычисляются всегда, поэтому в качестве аргументов
+  передаются только поля, не требующие вычислений.
+
+  Точки трассировки провайдера pproto. Для точек, связанных с сообщением,
+  первые четыре аргумента: старшая и младшая половины идентификатора команды
+  (arg0, arg1), старшая и младшая половины идентификатора сообщения (arg2,
+  arg3). Назначение остальных аргументов:
+    message_enqueue   приоритет, размер очереди на отправку
+    message_dequeue   приоритет, дескриптор сокета
+    frame_write       размер кадра, дескриптор сокета
+    compress_begin    размер данных, дескриптор сокета
+    compress_end      размер сжатых данных, дескриптор сокета
+    encrypt_begin     размер данных, дескриптор сокета
+    encrypt_end       размер зашифрованных данных, дескриптор сокета
+    content_compress  размер контента, алгоритм сжатия (точки _begin/_end)
+    emit_message      тип сообщения, дескриптор сокета
+    invoke_begin      тип сообщения, дескриптор сокета
+    invoke_end        тип сообщения, дескриптор сокета
+    udp_send          размер датаграммы, количество адресов назначения
+                      (0 - ответ на адрес отправителя)
+    udp_receive       размер датаграммы, порт отправителя
+
+  Точки, не связанные с сообщением (аргументы: размер данных, дескриптор
+  сокета): frame_read, decrypt_begin, decrypt_end, decompress_begin,
+  decompress_end.
+
+  Пример построения гистограммы размеров отправляемых кадров по командам:
+    bpftrace -e 'usdt:./app:pproto:frame_write {@[arg0, arg1] = hist(arg4)}'
+*****************************************************************************/
+
+#pragma once
+
+#ifdef USDT_PROBES
+
+#include <QUuid>
+#include <sys/sdt.h>
+#include <cstring>
+
+namespace pproto::probe {
+
+inline quint64 uuidHi(const QUuid& uuid)
+{
+    return (quint64(uuid.data1) << 32) | (quint64(uuid.data2) << 16) | uuid.data3;
+}
+
+inline quint64 uuidLo(const QUuid& uuid)
+{
+    quint64 lo;
+    memcpy(&lo, uuid.data4, sizeof(lo));
+    return lo;
+}
+
+} // namespace pproto::probe
+
+#define PPROTO_PROBE2(NAME, ARG1, ARG2) \
+    DTRACE_PROBE2(pproto, NAME, qint64(ARG1), qint64(ARG2))
+
+#define PPROTO_PROBE_MESSAGE(NAME, MESSAGE, ARG1, ARG2) \
+    DTRACE_PROBE6(pproto, NAME, \
+                  pproto::probe::uuidHi((MESSAGE)->command()), \
+                  pproto::probe::uuidLo((MESSAGE)->command()), \
+                  pproto::probe::uuidHi((MESSAGE)->id()),      \
+                  pproto::probe::uuidLo((MESSAGE)->id()),      \
+                  qint64(ARG1), qint64(ARG2))
+
+#else // USDT_PROBES
+
+#define PPROTO_PROBE2(NAME, ARG1, ARG2) (void)0
+#define PPROTO_PROBE_MESSAGE(NAME, MESSAGE, ARG1, ARG2) (void)0
+
+#endif // USDT_PROBES
@@ -0,0 +1,497 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "replication.h"
+#include "logger_operators.h"
+#include "serialize/functions.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Replication")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Replication")
+#define log_info_m    alog::logger().info    (alog_line_location, "Replication")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Replication")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Replication")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Replication")
+
+namespace pproto::replication {
+
+namespace {
+
+// Очередная часть снимка формируется только когда количество  сообщений
+// в очереди сокета подписчика меньше этого значения
+const int snapshotQueueLimit = 2;
+
+} // namespace
+
+//--------------------------------- Channel ----------------------------------
+
+Channel::Channel(const QUuidEx& id, transport::base::Listener* listener)
+    : _id(id),
+      _listener(listener)
+{
+    Q_ASSERT(_listener);
+}
+
+Channel::~Channel()
+{
+    stop();
+}
+
+void Channel::update(const QByteArray& key, const QByteArray& value)
+{
+    publish(key, value, false);
+}
+
+void Channel::remove(const QByteArray& key)
+{
+    publish(key, QByteArray(), true);
+}
+
+bool Channel::value(const QByteArray& key, QByteArray& value) const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    auto it = _state.constFind(key);
+    if (it == _state.constEnd())
+        return false;
+
+    value = it.value();
+    return true;
+}
+
+int Channel::count() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _state.count();
+}
+
+quint64 Channel::sequence() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _sequence;
+}
+
+int Channel::subscribersCount() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _subscribers.count();
+}
+
+void Channel::publish(const QByteArray& key, const QByteArray& value, bool removed)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    auto record = _state.find(key);
+    if (removed)
+    {
+        if (record == _state.end())
+            return;
+        _state.erase(record);
+    }
+    else
+    {
+        if (record != _state.end() && record.value() == value)
+            return;
+        _state.insert(key, value);
+    }
+
+    data::ReplicaUpdate replicaUpdate;
+    replicaUpdate.channel = _id;
+    replicaUpdate.sequence = ++_sequence;
+    replicaUpdate.key = key;
+    replicaUpdate.value = value;
+    replicaUpdate.removed = removed;
+
+    // Сообщение создается один раз для каждого формата контента
+    Message::Ptr messages[2];
+
+    for (auto it = _subscribers.begin(); it != _subscribers.end(); )
+    {
+        Subscriber& subscriber = it.value();
+
+        // Запись еще не отправлена в составе снимка, ее актуальное значение
+        // будет отправлено в одной из последующих частей снимка
+        if (subscriber.snapshot
+            && (!subscriber.cursorValid || subscriber.cursor < key))
+        {
+            ++it;
+            continue;
+        }
+
+        if (!subscriber.socket->isConnected())
+        {
+            it = _subscribers.erase(it);
+            continue;
+        }
+        if (subscriber.socket->messagesCount() > _maxQueue)
+        {
+            log_warn_m << "Channel " << _id << ". Subscriber "
+                       << subscriber.socket->socketDescriptor()
+                       << " does not have time to receive updates"
+                       << ". Subscription cancelled";
+            sendReset(subscriber);
+            it = _subscribers.erase(it);
+            continue;
+        }
+
+        Message::Ptr& message =
+            messages[(subscriber.contentFormat == SerializeFormat::QBinary) ? 0 : 1];
+        if (message.empty())
+            message = createMessage(replicaUpdate, {Message::Type::Event,
+                                                    subscriber.contentFormat});
+        subscriber.socket->send(message);
+        ++it;
+    }
+}
+
+bool Channel::subscribe(const Message::Ptr& message)
+{
+    if (message->command() != command::ReplicaSubscribe
+        || message->type() != Message::Type::Command)
+        return false;
+
+    data::ReplicaSubscribe replicaSubscribe;
+    readFromMessage(message, replicaSubscribe);
+    if (!replicaSubscribe.dataIsValid)
+        return false;
+
+    if (replicaSubscribe.channel != _id)
+        return false;
+
+    transport::base::Socket::Ptr socket =
+        _listener->socketByDescriptor(message->socketDescriptor());
+
+    if (socket.empty() || !socket->isConnected())
+        return true;
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        // Повторная подписка начинает передачу снимка сначала
+        _subscribers.remove(socket->socketDescriptor());
+
+        replicaSubscribe.count = _state.count();
+
+        Message::Ptr answer = message->cloneForAnswer();
+        writeToMessage(replicaSubscribe, answer);
+
+        // Ответ отправляется под блокировкой, чтобы он гарантированно
+        // опередил первую часть снимка
+        socket->send(answer);
+
+        if (replicaSubscribe.unsubscribe)
+        {
+            log_debug_m << "Channel " << _id << ". Subscriber "
+                        << socket->socketDescriptor() << " unsubscribed";
+            return true;
+        }
+
+        Subscriber subscriber;
+        subscriber.socket = socket;
+        subscriber.contentFormat = message->contentFormat();
+        _subscribers.insert(socket->socketDescriptor(), subscriber);
+
+        log_debug_m << "Channel " << _id << ". Subscriber "
+                    << socket->socketDescriptor() << " subscribed"
+                    << "; Records: " << replicaSubscribe.count;
+    }
+    _cond.wakeAll();
+    return true;
+}
+
+void Channel::sendChunk(Subscriber& subscriber)
+{
+    data::ReplicaSnapshot replicaSnapshot;
+    replicaSnapshot.channel = _id;
+    replicaSnapshot.chunk = subscriber.chunk++;
+
+    auto it = subscriber.cursorValid
+              ? _state.upperBound(subscriber.cursor)
+              : _state.begin();
+
+    int size = 0;
+    for (; it != _state.end() && size < _chunkSize; ++it)
+    {
+        replicaSnapshot.keys.append(it.key());
+        replicaSnapshot.values.append(it.value());
+        size += it.key().size() + it.value().size();
+    }
+    if (!replicaSnapshot.keys.isEmpty())
+    {
+        subscriber.cursor = replicaSnapshot.keys.last();
+        subscriber.cursorValid = true;
+    }
+    if (it == _state.end())
+    {
+        replicaSnapshot.last = true;
+        replicaSnapshot.sequence = _sequence;
+        subscriber.snapshot = false;
+        subscriber.cursor.clear();
+    }
+
+    Message::Ptr message =
+        createMessage(replicaSnapshot, {Message::Type::Event, subscriber.contentFormat});
+    subscriber.socket->send(message);
+}
+
+void Channel::sendReset(Subscriber& subscriber)
+{
+    data::ReplicaUpdate replicaUpdate;
+    replicaUpdate.channel = _id;
+    replicaUpdate.sequence = _sequence;
+    replicaUpdate.reset = true;
+
+    Message::Ptr message =
+        createMessage(replicaUpdate, {Message::Type::Event, subscriber.contentFormat});
+    subscriber.socket->send(message);
+}
+
+void Channel::run()
+{
+    log_info_m << "Channel " << _id << ". Started";
+
+    while (true)
+    {
+        if (threadStop())
+            break;
+
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        bool snapshot = false;
+        for (auto it = _subscribers.begin(); it != _subscribers.end(); )
+        {
+            Subscriber& subscriber = it.value();
+            if (!subscriber.socket->isConnected())
+            {
+                log_debug_m << "Channel " << _id << ". Subscriber "
+                            << subscriber.socket->socketDescriptor()
+                            << " removed. Socket is disconnected";
+                it = _subscribers.erase(it);
+                continue;
+            }
+            if (subscriber.snapshot)
+            {
+                // Каждая часть снимка формируется при отдельном захвате
+                // блокировки, поэтому публикация изменений не блокируется
+                // на время передачи всего снимка
+                if (subscriber.socket->messagesCount() < snapshotQueueLimit)
+                    sendChunk(subscriber);
+                snapshot = true;
+            }
+            ++it;
+        }
+
+        // При передаче снимка ожидание выполняется с малым интервалом,
+        // так как освобождение очереди сокета не сопровождается сигналом
+        _cond.wait(&_lock, snapshot ? 5 : 500);
+    }
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        _subscribers.clear();
+    }
+    log_info_m << "Channel " << _id << ". Stopped";
+}
+
+//--------------------------------- Replica ----------------------------------
+
+Replica::Replica(const transport::base::Socket::Ptr& socket, const QUuidEx& channel)
+    : _socket(socket),
+      _channel(channel)
+{}
+
+void Replica::subscribe()
+{
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        _state.clear();
+        _sequence = 0;
+        _nextChunk = 0;
+        _subscribed = true;
+        _ready = false;
+    }
+
+    data::ReplicaSubscribe replicaSubscribe;
+    replicaSubscribe.channel = _channel;
+
+    Message::Ptr message =
+        createMessage(replicaSubscribe, {Message::Type::Command, _socket->messageFormat()});
+    _socket->send(message);
+}
+
+void Replica::unsubscribe()
+{
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        _subscribed = false;
+        _ready = false;
+    }
+
+    data::ReplicaSubscribe replicaSubscribe;
+    replicaSubscribe.channel = _channel;
+    replicaSubscribe.unsubscribe = true;
+
+    Message::Ptr message =
+        createMessage(replicaSubscribe, {Message::Type::Command, _socket->messageFormat()});
+    _socket->send(message);
+}
+
+bool Replica::process(const Message::Ptr& message)
+{
+    if (message->command() == command::ReplicaSubscribe)
+    {
+        data::ReplicaSubscribe replicaSubscribe;
+        readFromMessage(message, replicaSubscribe);
+        return replicaSubscribe.dataIsValid
+               && replicaSubscribe.channel == _channel;
+    }
+
+    if (message->command() == command::ReplicaSnapshot)
+    {
+        data::ReplicaSnapshot replicaSnapshot;
+        readFromMessage(message, replicaSnapshot);
+        if (!replicaSnapshot.dataIsValid
+            || replicaSnapshot.channel != _channel)
+            return false;
+
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        // Части снимка предыдущей подписки отбрасываются до тех пор,
+        // пока не будет получена первая часть нового снимка
+        if (!_subscribed || _ready)
+            return true;
+
+        if (replicaSnapshot.chunk != _nextChunk)
+        {
+            if (replicaSnapshot.chunk != 0)
+            {
+                log_warn_m << "Channel " << _channel
+                           << ". Unexpected snapshot chunk " << replicaSnapshot.chunk
+                           << ", expected " << _nextChunk;
+                return true;
+            }
+            _state.clear();
+        }
+        _nextChunk = replicaSnapshot.chunk + 1;
+
+        int count = qMin(replicaSnapshot.keys.count(), replicaSnapshot.values.count());
+        for (int i = 0; i < count; ++i)
+            _state.insert(replicaSnapshot.keys[i], replicaSnapshot.values[i]);
+
+        if (replicaSnapshot.last)
+        {
+            _sequence = replicaSnapshot.sequence;
+            _ready = true;
+            log_debug_m << "Channel " << _channel << ". Snapshot received"
+                        << "; Records: " << _state.count()
+                        << "; Sequence: " << _sequence;
+        }
+        return true;
+    }
+
+    if (message->command() == command::ReplicaUpdate)
+    {
+        data::ReplicaUpdate replicaUpdate;
+        readFromMessage(message, replicaUpdate);
+        if (!replicaUpdate.dataIsValid
+            || replicaUpdate.channel != _channel)
+            return false;
+
+        bool resubscribe = false;
+        { //Block for QMutexLocker
+            QMutexLocker locker {&_lock}; (void) locker;
+
+            if (!_subscribed)
+                return true;
+
+            if (replicaUpdate.reset)
+            {
+                log_warn_m << "Channel " << _channel
+                           << ". Subscription cancelled by server";
+                resubscribe = true;
+            }
+            else if (_ready && replicaUpdate.sequence != _sequence + 1)
+            {
+                // После получения снимка номера изменений должны следовать
+                // подряд
+                log_error_m << "Channel " << _channel
+                            << ". Gap in updates sequence: " << _sequence
+                            << " -> " << replicaUpdate.sequence;
+                resubscribe = true;
+            }
+            else if (_ready || _nextChunk != 0)
+            {
+                // Изменения, полученные до первой части снимка, относятся
+                // к предыдущей подписке
+                if (replicaUpdate.removed)
+                    _state.remove(replicaUpdate.key);
+                else
+                    _state.insert(replicaUpdate.key, replicaUpdate.value);
+
+                if (_ready)
+                    _sequence = replicaUpdate.sequence;
+            }
+        }
+        if (resubscribe)
+            subscribe();
+
+        return true;
+    }
+    return false;
+}
+
+bool Replica::ready() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _ready;
+}
+
+quint64 Replica::sequence() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _sequence;
+}
+
+bool Replica::value(const QByteArray& key, QByteArray& value) const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    auto it = _state.constFind(key);
+    if (it == _state.constEnd())
+        return false;
+
+    value = it.value();
+    return true;
+}
+
+QMap<QByteArray, QByteArray> Replica::state() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _state;
+}
+
+} // namespace pproto::replication
@@ -0,0 +1,195 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Репликация состояния (ключ-значение) для клиентов, подключающихся к сер-
+  веру в произвольный момент времени.
+
+  Серверная сторона хранит состояние канала и публикует его изменения.
+  Клиент, подписавшийся на канал (команда ReplicaSubscribe),  сначала
+  получает снимок состояния в виде последовательности частей (события
+  ReplicaSnapshot), а затем изменения состояния (события ReplicaUpdate).
+
+  Снимок не формируется целиком: каждая  часть  формируется  из  текущего
+  состояния непосредственно перед отправкой, начиная с ключа, следующего
+  за последним отправленным. Изменения записей, которые уже были отправлены
+  в составе снимка, передаются клиенту сразу, изменения остальных записей
+  попадут в последующие части снимка. Поэтому после получения последней
+  части снимка состояние клиента совпадает с состоянием сервера без  про-
+  пусков и повторов. Номера всех последующих изменений следуют подряд,
+  начиная с номера, указанного в последней части снимка.
+
+  Очередная часть снимка формируется только тогда, когда очередь сообщений
+  сокета почти пуста, поэтому объем памяти, необходимый для передачи снимка,
+  ограничен размером одной части. Если клиент не успевает принимать измене-
+  ния (очередь сокета превысила maxQueue), подписка отменяется, клиенту отп-
+  равляется уведомление ReplicaUpdate с признаком reset.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/replication.h"
+#include "transport/base.h"
+
+#include "shared/qt/qthreadex.h"
+#include "shared/qt/quuidex.h"
+
+#include <QtCore>
+
+namespace pproto::replication {
+
+/**
+  Серверная часть. Хранит состояние канала репликации и рассылает его
+  подписчикам
+*/
+class Channel : public QThreadEx
+{
+public:
+    Channel(const QUuidEx& id, transport::base::Listener*);
+    ~Channel();
+
+    // Идентификатор канала
+    QUuidEx id() const {return _id;}
+
+    // Изменяет значение записи и рассылает изменение подписчикам
+    void update(const QByteArray& key, const QByteArray& value);
+
+    // Удаляет запись и рассылает изменение подписчикам
+    void remove(const QByteArray& key);
+
+    // Возвращает значение записи
+    bool value(const QByteArray& key, QByteArray& value) const;
+
+    // Количество записей в состоянии
+    int count() const;
+
+    // Номер последнего изменения состояния
+    quint64 sequence() const;
+
+    // Обрабатывает команду ReplicaSubscribe. Возвращает TRUE если команда
+    // относится к данному каналу и была обработана
+    bool subscribe(const Message::Ptr&);
+
+    // Количество подписчиков
+    int subscribersCount() const;
+
+    // Максимальный размер (в байтах) части снимка. Значение по умолчанию
+    // равно 64 Кб
+    int chunkSize() const {return _chunkSize;}
+    void setChunkSize(int val) {_chunkSize = val;}
+
+    // Максимальное количество сообщений в очереди сокета подписчика, при
+    // превышении которого подписка отменяется. Значение по умолчанию
+    // равно 1000
+    int maxQueue() const {return _maxQueue;}
+    void setMaxQueue(int val) {_maxQueue = val;}
+
+private:
+    DISABLE_DEFAULT_COPY(Channel)
+
+    void run() override;
+
+    struct Subscriber;
+    void publish(const QByteArray& key, const QByteArray& value, bool removed);
+    void sendChunk(Subscriber&);
+    void sendReset(Subscriber&);
+
+private:
+    struct Subscriber
+    {
+        transport::base::Socket::Ptr socket;
+        SerializeFormat contentFormat = {SerializeFormat::QBinary};
+
+        // Состояние передачи снимка
+        bool snapshot = {true};
+        bool cursorValid = {false};
+        QByteArray cursor; // Последний отправленный ключ
+        quint32 chunk = {0};
+    };
+
+    const QUuidEx _id;
+    transport::base::Listener* _listener;
+
+    QMap<QByteArray, QByteArray> _state;
+    quint64 _sequence = {0};
+
+    QHash<SocketDescriptor, Subscriber> _subscribers;
+    mutable QMutex _lock;
+    QWaitCondition _cond;
+
+    int _chunkSize = {64*1024};
+    int _maxQueue = {1000};
+};
+
+/**
+  Клиентская часть. Восстанавливает состояние канала репликации из снимка
+  и последующих изменений. При обнаружении пропуска изменений или отмене
+  подписки сервером выполняет повторную подписку
+*/
+class Replica
+{
+public:
+    Replica(const transport::base::Socket::Ptr&, const QUuidEx& channel);
+
+    // Отправляет серверу команду подписки на канал
+    void subscribe();
+
+    // Отправляет серверу команду отмены подписки
+    void unsubscribe();
+
+    // Обрабатывает сообщения ReplicaSubscribe, ReplicaSnapshot и ReplicaUpdate.
+    // Возвращает TRUE если сообщение относится к данному каналу
+    bool process(const Message::Ptr&);
+
+    // Возвращает TRUE если снимок состояния получен полностью
+    bool ready() const;
+
+    // Номер последнего полученного изменения состояния
+    quint64 sequence() const;
+
+    // Возвращает значение записи
+    bool value(const QByteArray& key, QByteArray& value) const;
+
+    // Возвращает копию состояния
+    QMap<QByteArray, QByteArray> state() const;
+
+    QUuidEx channel() const {return _channel;}
+
+private:
+    DISABLE_DEFAULT_COPY(Replica)
+
+private:
+    transport::base::Socket::Ptr _socket;
+    const QUuidEx _channel;
+
+    QMap<QByteArray, QByteArray> _state;
+    quint64 _sequence = {0};
+    quint32 _nextChunk = {0};
+    bool _subscribed = {false};
+    bool _ready = {false};
+
+    mutable QMutex _lock;
+};
+
+} // namespace pproto::replication
@@ -24,6 +24,7 @@
 *****************************************************************************/
 
 #include "routing.h"
+#include "pproto/trace.h"
 
 #include "shared/logger/logger.h"
 #include "shared/qt/logger_operators.h"
@@ -73,6 +74,7 @@ bool RouteCommands::forwarding(const Message::Ptr& message)
                                         ". Socket is not available";
 
                     Message::Ptr m = createMessage(error, {message->contentFormat()});
+                    trace::propagate(message, m);
                     p1.socket->send(m);
                     return 0;
                 }
@@ -114,6 +116,7 @@ bool RouteCommands::forwarding(const Message::Ptr& message)
                                         ". Timeout for this message has expired";
 
                     Message::Ptr m = createMessage(error, {message->contentFormat()});
+                    trace::propagate(message, m);
                     p1.socket->send(m);
                     return 0;
                 }
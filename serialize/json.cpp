@@ -24,6 +24,7 @@
 *****************************************************************************/
 
 #include "serialize/json.h"
+#include "message.h"
 #include "rapidjson/error/en.h"
 #include <atomic>
 
@@ -968,4 +969,455 @@ Writer& Writer::operator& (const std::string& s)
     return *this;
 }
 
+//------------------------------ Field projection ----------------------------
+
+QByteArray FieldView::raw() const
+{
+    if (!isFound())
+        return QByteArray();
+
+    return QByteArray::fromRawData(_source.constData() + _offset, _length);
+}
+
+bool FieldView::toBool(bool* ok) const
+{
+    bool res = (_type == Type::Bool);
+    if (ok) *ok = res;
+    return res && (_length == 4 /*sizeof 'true'*/);
+}
+
+qint64 FieldView::toInt64(bool* ok) const
+{
+    bool res = false;
+    qint64 val = 0;
+    if (_type == Type::Number)
+        val = raw().toLongLong(&res);
+    if (ok) *ok = res;
+    return val;
+}
+
+quint64 FieldView::toUInt64(bool* ok) const
+{
+    bool res = false;
+    quint64 val = 0;
+    if (_type == Type::Number)
+        val = raw().toULongLong(&res);
+    if (ok) *ok = res;
+    return val;
+}
+
+double FieldView::toDouble(bool* ok) const
+{
+    bool res = false;
+    double val = 0;
+    if (_type == Type::Number)
+        val = raw().toDouble(&res);
+    if (ok) *ok = res;
+    return val;
+}
+
+QString FieldView::toString(bool* ok) const
+{
+    if (ok) *ok = false;
+    if (_type != Type::String)
+        return QString();
+
+    const QByteArray& ba = raw();
+    if (ba.indexOf('\\') == -1)
+    {
+        // Быстрый вариант: строка не содержит escape-символов
+        if (ok) *ok = true;
+        return QString::fromUtf8(ba.constData() + 1, ba.length() - 2);
+    }
+
+    Document doc;
+    doc.Parse(ba.constData(), size_t(ba.length()));
+    if (doc.HasParseError() || !doc.IsString())
+        return QString();
+
+    if (ok) *ok = true;
+    return QString::fromUtf8(doc.GetString(), int(doc.GetStringLength()));
+}
+
+QUuidEx FieldView::toUuid(bool* ok) const
+{
+    bool res;
+    const QString& s = toString(&res);
+    QUuidEx uuid;
+    if (res)
+        uuid = QUuidEx(s.toUtf8());
+    if (ok) *ok = res && !uuid.isNull();
+    return uuid;
+}
+
+/**
+  Потоковый токенайзер для функции extract(). Разбирает только те узлы json,
+  через которые проходят запрошенные пути, остальные значения пропускаются
+  посимвольно без какого-либо разбора
+*/
+class FieldScanner
+{
+public:
+    struct Path
+    {
+        QList<QByteArray> tokens;
+        QVector<int> indexes; // Числовое представление токенов для массивов
+    };
+
+    FieldScanner(const QByteArray& json, const QVector<Path>& paths, FieldViews& views)
+        : _json(json), _paths(paths), _views(views)
+    {
+        _cur = json.constData();
+        _end = _cur + json.length();
+        _remaining = paths.count();
+    }
+
+    // Возвращает FALSE если json содержит ошибку. Досрочная остановка
+    // сканирования ошибкой не является
+    bool run()
+    {
+        QVector<int> candidates;
+        for (int i = 0; i < _paths.count(); ++i)
+            candidates.append(i);
+
+        return scanValue(0, candidates) || _stop;
+    }
+
+private:
+    static bool isSpace(char c)
+    {
+        return (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t');
+    }
+
+    static bool isNumberChar(char c)
+    {
+        return (c >= '0' && c <= '9')
+               || (c == '-') || (c == '+') || (c == '.')
+               || (c == 'e') || (c == 'E');
+    }
+
+    void skipSpaces()
+    {
+        while (_cur < _end && isSpace(*_cur))
+            ++_cur;
+    }
+
+    bool skipString()
+    {
+        ++_cur; // '"'
+        while (_cur < _end)
+        {
+            if (*_cur == '\\')
+            {
+                _cur += 2;
+                continue;
+            }
+            if (*_cur == '"')
+            {
+                ++_cur;
+                return true;
+            }
+            ++_cur;
+        }
+        return false;
+    }
+
+    bool skipLiteral(const char* literal, int length)
+    {
+        if ((_end - _cur) < length || std::memcmp(_cur, literal, size_t(length)) != 0)
+            return false;
+        _cur += length;
+        return true;
+    }
+
+    bool skipValue(FieldView::Type& type)
+    {
+        skipSpaces();
+        if (_cur >= _end)
+            return false;
+
+        switch (*_cur)
+        {
+            case '"':
+                type = FieldView::Type::String;
+                return skipString();
+
+            case '{':
+            case '[':
+            {
+                type = (*_cur == '{') ? FieldView::Type::Object
+                                      : FieldView::Type::Array;
+                int level = 0;
+                while (_cur < _end)
+                {
+                    char c = *_cur;
+                    if (c == '"')
+                    {
+                        if (!skipString())
+                            return false;
+                        continue;
+                    }
+                    if (c == '{' || c == '[')
+                    {
+                        ++level;
+                    }
+                    else if (c == '}' || c == ']')
+                    {
+                        if (--level == 0)
+                        {
+                            ++_cur;
+                            return true;
+                        }
+                    }
+                    ++_cur;
+                }
+                return false;
+            }
+            case 't':
+                type = FieldView::Type::Bool;
+                return skipLiteral("true", 4);
+
+            case 'f':
+                type = FieldView::Type::Bool;
+                return skipLiteral("false", 5);
+
+            case 'n':
+                type = FieldView::Type::Null;
+                return skipLiteral("null", 4);
+
+            default:
+                if (!isNumberChar(*_cur))
+                    return false;
+
+                type = FieldView::Type::Number;
+                while (_cur < _end && isNumberChar(*_cur))
+                    ++_cur;
+                return true;
+        }
+    }
+
+    // Параметр depth - количество токенов пути уже сопоставленных с json,
+    // candidates - индексы путей, проходящих через текущее значение
+    bool scanValue(int depth, const QVector<int>& candidates)
+    {
+        skipSpaces();
+        if (_cur >= _end)
+            return false;
+
+        bool matched = false;
+        QVector<int> nested;
+        for (int i : candidates)
+        {
+            if (_paths[i].tokens.count() == depth)
+                matched = true;
+            else
+                nested.append(i);
+        }
+
+        const char* begin = _cur;
+        FieldView::Type type;
+        bool res;
+        if (!nested.isEmpty() && *_cur == '{')
+        {
+            type = FieldView::Type::Object;
+            res = scanObject(depth, nested);
+        }
+        else if (!nested.isEmpty() && *_cur == '[')
+        {
+            type = FieldView::Type::Array;
+            res = scanArray(depth, nested);
+        }
+        else
+            res = skipValue(type);
+
+        if (!res)
+            return false;
+
+        if (matched)
+            for (int i : candidates)
+                if (_paths[i].tokens.count() == depth && !_views[i].isFound())
+                {
+                    FieldView& view = _views[i];
+                    view._source = _json;
+                    view._offset = int(begin - _json.constData());
+                    view._length = int(_cur - begin);
+                    view._type = type;
+                    --_remaining;
+                }
+        return true;
+    }
+
+    bool scanObject(int depth, const QVector<int>& candidates)
+    {
+        ++_cur; // '{'
+        skipSpaces();
+        if (_cur < _end && *_cur == '}')
+        {
+            ++_cur;
+            return true;
+        }
+        while (true)
+        {
+            skipSpaces();
+            if (_cur >= _end || *_cur != '"')
+                return false;
+
+            const char* keyBegin = _cur + 1;
+            if (!skipString())
+                return false;
+
+            const QByteArray& key =
+                QByteArray::fromRawData(keyBegin, int(_cur - 1 - keyBegin));
+
+            skipSpaces();
+            if (_cur >= _end || *_cur != ':')
+                return false;
+            ++_cur;
+
+            QVector<int> sub;
+            for (int i : candidates)
+                if (_paths[i].tokens[depth] == key)
+                    sub.append(i);
+
+            if (!scanMember(depth, sub))
+                return false;
+
+            skipSpaces();
+            if (_cur >= _end)
+                return false;
+
+            if (*_cur == ',')
+            {
+                ++_cur;
+                continue;
+            }
+            if (*_cur == '}')
+            {
+                ++_cur;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    bool scanArray(int depth, const QVector<int>& candidates)
+    {
+        ++_cur; // '['
+        skipSpaces();
+        if (_cur < _end && *_cur == ']')
+        {
+            ++_cur;
+            return true;
+        }
+        for (int index = 0; ; ++index)
+        {
+            QVector<int> sub;
+            for (int i : candidates)
+                if (_paths[i].indexes[depth] == index)
+                    sub.append(i);
+
+            if (!scanMember(depth, sub))
+                return false;
+
+            skipSpaces();
+            if (_cur >= _end)
+                return false;
+
+            if (*_cur == ',')
+            {
+                ++_cur;
+                continue;
+            }
+            if (*_cur == ']')
+            {
+                ++_cur;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    bool scanMember(int depth, const QVector<int>& sub)
+    {
+        if (sub.isEmpty())
+        {
+            FieldView::Type type;
+            return skipValue(type);
+        }
+        if (!scanValue(depth + 1, sub))
+            return false;
+
+        if (_remaining == 0)
+        {
+            // Все запрошенные поля найдены, дальнейшее сканирование
+            // не требуется
+            _stop = true;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const QByteArray& _json;
+    const QVector<Path>& _paths;
+    FieldViews& _views;
+
+    const char* _cur;
+    const char* _end;
+    int  _remaining;
+    bool _stop = {false};
+};
+
+FieldViews extract(const QByteArray& json, const QVector<QByteArray>& paths)
+{
+    FieldViews views(paths.count());
+    QVector<FieldScanner::Path> scanPaths(paths.count());
+
+    for (int i = 0; i < paths.count(); ++i)
+    {
+        const QByteArray& path = paths[i];
+        views[i]._path = path;
+
+        FieldScanner::Path& scanPath = scanPaths[i];
+        if (path.isEmpty())
+            continue; // Корневой элемент
+
+        if (path[0] != '/')
+        {
+            log_error_m << "Json pointer must start with '/'. Path: " << path;
+            return views;
+        }
+        scanPath.tokens = path.mid(1).split('/');
+        for (QByteArray& token : scanPath.tokens)
+        {
+            token.replace("~1", "/");
+            token.replace("~0", "~");
+
+            bool ok;
+            int index = token.toInt(&ok);
+            scanPath.indexes.append((ok && index >= 0) ? index : -1);
+        }
+    }
+
+    FieldScanner scanner {json, scanPaths, views};
+    if (!scanner.run())
+    {
+        log_error_m << "Failed scan json for fields extraction"
+                    << ". Content: " << json.left(64);
+    }
+    return views;
+}
+
+FieldViews extract(const clife_ptr<Message>& message, const QVector<QByteArray>& paths)
+{
+    if (message.empty() || message->contentFormat() != SerializeFormat::Json)
+    {
+        FieldViews views(paths.count());
+        for (int i = 0; i < paths.count(); ++i)
+            views[i]._path = paths[i];
+        return views;
+    }
+    return extract(message->content(), paths);
+}
+
 } // namespace pproto::serialize::json
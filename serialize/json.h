@@ -58,6 +58,8 @@
 #include <vector>
 #include <type_traits>
 
+namespace pproto {class Message;}
+
 namespace pproto::serialize::json {
 
 using namespace rapidjson;
@@ -661,6 +663,68 @@ bool stringEqual(const typename GenericValueT::Ch* a, const GenericValueT& b)
     return (std::memcmp(a, b_, sizeof(typename GenericValueT::Ch) * l1) == 0);
 }
 
+//------------------------------ Field projection ----------------------------
+
+/**
+  Легковесное представление значения json-поля,  полученного при помощи функ-
+  ции extract(). Представление не копирует данные, а ссылается на исходный json-
+  буфер (буфер разделяется через механизм implicit sharing QByteArray)
+*/
+class FieldView
+{
+public:
+    enum class Type {Undefined, Null, Bool, Number, String, Object, Array};
+
+    // Запрошенный путь к полю в формате json pointer (RFC 6901)
+    QByteArray path() const {return _path;}
+
+    // Тип значения. Для ненайденного поля возвращается Type::Undefined
+    Type type() const {return _type;}
+
+    bool isFound() const {return (_type != Type::Undefined);}
+    bool isNull()  const {return (_type == Type::Null);}
+
+    // Сырое json-представление значения. Для строк значение возвращается
+    // вместе с обрамляющими кавычками и без обработки escape-символов
+    QByteArray raw() const;
+
+    bool    toBool  (bool* ok = nullptr) const;
+    qint64  toInt64 (bool* ok = nullptr) const;
+    quint64 toUInt64(bool* ok = nullptr) const;
+    double  toDouble(bool* ok = nullptr) const;
+    QString toString(bool* ok = nullptr) const;
+    QUuidEx toUuid  (bool* ok = nullptr) const;
+
+private:
+    QByteArray _path;
+    QByteArray _source;
+    int  _offset = {0};
+    int  _length = {0};
+    Type _type = {Type::Undefined};
+
+    friend class FieldScanner;
+    friend QVector<FieldView> extract(const QByteArray&, const QVector<QByteArray>&);
+    friend QVector<FieldView> extract(const clife_ptr<Message>&, const QVector<QByteArray>&);
+};
+typedef QVector<FieldView> FieldViews;
+
+/**
+  Извлекает значения полей по списку путей без полной десериализации json.
+  Пути задаются в формате json pointer, например: {"/tenant", "/items/0/id"}.
+  Json сканируется  потоковым  токенайзером,  поддеревья не попадающие в пути
+  пропускаются без разбора, сканирование прекращается  как только все запро-
+  шенные поля найдены.  Порядок элементов в результате соответствует порядку
+  путей в списке paths. Имена полей сравниваются в сыром виде (без обработки
+  escape-символов)
+*/
+FieldViews extract(const QByteArray& json, const QVector<QByteArray>& paths);
+
+/**
+  Выполняет extract() для контента сообщения. Если формат контента сообщения
+  не json, то все поля в результате будут иметь тип Type::Undefined
+*/
+FieldViews extract(const clife_ptr<Message>&, const QVector<QByteArray>& paths);
+
 } // namespace pproto::serialize::json
 
 /**
@@ -0,0 +1,259 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "trace.h"
+#include "logger_operators.h"
+
+#include "shared/spin_locker.h"
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <random>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Trace")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Trace")
+#define log_info_m    alog::logger().info    (alog_line_location, "Trace")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Trace")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Trace")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Trace")
+
+namespace pproto::trace {
+
+namespace {
+
+std::atomic_flag sinkLock = ATOMIC_FLAG_INIT;
+SpanSink::Ptr globalSink;
+
+quint64 randomId()
+{
+    thread_local std::mt19937_64 generator {std::random_device{}()};
+
+    quint64 id;
+    do {id = generator();} while (id == 0);
+    return id;
+}
+
+} // namespace
+
+//--------------------------------- RingSink ---------------------------------
+
+RingSink::RingSink(int capacity)
+    : _capacity(qMax(capacity, 1))
+{
+    _spans.reserve(_capacity);
+}
+
+void RingSink::write(const Span& span)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (_spans.count() < _capacity)
+    {
+        _spans.append(span);
+        return;
+    }
+    _spans[_next] = span;
+    _next = (_next + 1) % _capacity;
+}
+
+QVector<Span> RingSink::spans(quint64 traceId) const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    QVector<Span> spans;
+    spans.reserve(_spans.count());
+    for (int i = 0; i < _spans.count(); ++i)
+    {
+        const Span& span = _spans[(_next + i) % _spans.count()];
+        if (traceId == 0 || span.traceId == traceId)
+            spans.append(span);
+    }
+    return spans;
+}
+
+void RingSink::clear()
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    _spans.clear();
+    _next = 0;
+}
+
+//--------------------------------- FileSink ---------------------------------
+
+FileSink::~FileSink()
+{
+    close();
+}
+
+bool FileSink::open(const QString& filePath)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (_file.isOpen())
+        _file.close();
+
+    _file.setFileName(filePath);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    {
+        log_error_m << "Failed open file " << filePath
+                    << ". Detail: " << _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void FileSink::close()
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    if (_file.isOpen())
+        _file.close();
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch-enum"
+
+void FileSink::write(const Span& span)
+{
+    const char* type;
+    switch (span.messageType)
+    {
+        case Message::Type::Command: type = "command"; break;
+        case Message::Type::Answer:  type = "answer";  break;
+        case Message::Type::Event:   type = "event";   break;
+        default:                     type = "unknown";
+    }
+    QString peer = span.socketName;
+    if (span.socketType != SocketType::Local)
+        peer = span.peerPoint.address().toString() + ":"
+               + QString::number(span.peerPoint.port());
+
+    QByteArray line;
+    line.reserve(256);
+    line.append(QByteArray::number(span.traceId, 16)).append('\t');
+    line.append(QByteArray::number(span.spanId, 16)).append('\t');
+    line.append(QByteArray::number(span.parentSpan, 16)).append('\t');
+    line.append(span.command.toByteArray()).append('\t');
+    line.append(span.messageId.toByteArray()).append('\t');
+    line.append(type).append('\t');
+    line.append(peer.toUtf8()).append('\t');
+    line.append(QByteArray::number(span.sendTime)).append('\t');
+    line.append(QByteArray::number(span.receiveTime)).append('\t');
+    line.append(QByteArray::number(span.receiveTime - span.sendTime)).append('\n');
+
+    QMutexLocker locker {&_lock}; (void) locker;
+    if (_file.isOpen())
+    {
+        _file.write(line);
+        _file.flush();
+    }
+}
+
+#pragma GCC diagnostic pop
+
+//-------------------------------- Functions ---------------------------------
+
+qint64 now()
+{
+    return QDateTime::currentMSecsSinceEpoch() * 1000;
+}
+
+void start(const Message::Ptr& message)
+{
+    TraceContext trace;
+    trace.traceId = randomId();
+    message->setTrace(trace);
+}
+
+void propagate(const Message::Ptr& source, const Message::Ptr& message)
+{
+    TraceContext trace = source->trace();
+    trace.sendTime = 0;
+    message->setTrace(trace);
+}
+
+void setSink(const SpanSink::Ptr& sink)
+{
+    SpinLocker locker {sinkLock}; (void) locker;
+    globalSink = sink;
+}
+
+SpanSink::Ptr sink()
+{
+    SpinLocker locker {sinkLock}; (void) locker;
+    return globalSink;
+}
+
+void send(Message* message)
+{
+    // Одно сообщение может отправляться в несколько сокетов, которые сериа-
+    // лизуют его в своих потоках. Поэтому время отправки устанавливается
+    // только один раз, до постановки сообщения в первую очередь на отправку
+    TraceContext trace = message->trace();
+    if (trace.isEmpty() || trace.sendTime != 0)
+        return;
+
+    trace.sendTime = now();
+    message->setTrace(trace);
+}
+
+quint64 receive(Message* message)
+{
+    TraceContext trace = message->trace();
+    if (trace.isEmpty())
+        return 0;
+
+    Span span;
+    span.traceId = trace.traceId;
+    span.spanId = randomId();
+    span.parentSpan = trace.parentSpan;
+    span.sendTime = trace.sendTime;
+    span.receiveTime = now();
+
+    // Ответы и производные сообщения ссылаются на участок получения. Время
+    // отправки сбрасывается, чтобы при пересылке сообщения оно было уста-
+    // новлено заново
+    trace.parentSpan = span.spanId;
+    trace.sendTime = 0;
+    message->setTrace(trace);
+
+    SpanSink::Ptr sink = trace::sink();
+    if (sink.empty())
+        return span.spanId;
+
+    span.command = message->command();
+    span.messageId = message->id();
+    span.messageType = message->type();
+    const ConnectionContext::Ptr& connection = message->connection();
+    if (!connection.empty())
+    {
+        span.socketType = connection->socketType();
+        span.peerPoint = connection->peerPoint();
+        span.socketName = connection->socketName();
+    }
+    sink->write(span);
+    return span.spanId;
+}
+
+} // namespace pproto::trace
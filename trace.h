@@ -0,0 +1,172 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Трассировка задержек при прохождении сообщений через цепочку сервисов.
+
+  Контекст трассировки (см. TraceContext) передается в заголовке сообщения
+  и содержит идентификатор трассы, идентификатор участка трассы, на котором
+  было создано сообщение, и время постановки сообщения в очередь на отправ-
+  ку. Контекст копируется в ответ функцией Message::cloneForAnswer(), пере-
+  сылаемые через RouteCommands сообщения получают новый участок трассы.
+  Для передачи контекста в сообщения, создаваемые при обработке входящего
+  сообщения, используется функция propagate().
+
+  При получении сообщения с контекстом трассировки транспорт формирует запись
+  об участке трассы (Span) и передает ее в локальный приемник (SpanSink).
+  Идентификатор нового участка записывается в контекст полученного сообщения,
+  поэтому ответы и производные сообщения ссылаются на него как на родитель-
+  ский участок. По записям всех узлов восстанавливается дерево участков
+  трассы, разница между временем получения и временем отправки показывает
+  задержку в очереди и в сети, разница между временем получения команды и
+  временем отправки ответа - время обработки на узле. Время измеряется по
+  системным часам узлов, поэтому для сопоставления записей разных узлов часы
+  должны быть синхронизированы.
+*****************************************************************************/
+
+#pragma once
+
+#include "message.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+#include "shared/qt/quuidex.h"
+
+#include <QtCore>
+
+namespace pproto::trace {
+
+struct Span
+{
+    quint64 traceId    = {0};
+    quint64 spanId     = {0};
+    quint64 parentSpan = {0};
+
+    QUuidEx command;
+    QUuidEx messageId;
+    Message::Type messageType = {Message::Type::Unknown};
+
+    // Соединение, через которое было получено сообщение
+    SocketType socketType = {SocketType::Unknown};
+    HostPoint peerPoint;
+    QString socketName;
+
+    qint64 sendTime    = {0}; // Время отправки на предыдущем узле (мкс, UTC)
+    qint64 receiveTime = {0}; // Время получения (мкс, UTC)
+};
+
+/**
+  Базовый класс приемника участков трассы. Функция write() вызывается из
+  потоков сокетов и должна быть потокобезопасной
+*/
+class SpanSink : public clife_base
+{
+public:
+    typedef clife_ptr<SpanSink> Ptr;
+
+    virtual ~SpanSink() = default;
+    virtual void write(const Span&) = 0;
+};
+
+/**
+  Приемник, хранящий последние участки трассы в кольцевом буфере
+*/
+class RingSink : public SpanSink
+{
+public:
+    typedef clife_ptr<RingSink> Ptr;
+
+    explicit RingSink(int capacity = 4096);
+
+    void write(const Span&) override;
+
+    // Возвращает накопленные участки трассы в порядке их поступления.
+    // Если параметр traceId отличен от нуля, то возвращаются только
+    // участки указанной трассы
+    QVector<Span> spans(quint64 traceId = 0) const;
+
+    void clear();
+
+private:
+    DISABLE_DEFAULT_FUNC(RingSink)
+
+    const int _capacity;
+    QVector<Span> _spans;
+    int _next = {0};
+    mutable QMutex _lock;
+};
+
+/**
+  Приемник, записывающий участки трассы в текстовый файл, одна строка на
+  участок. Поля строки разделены символом табуляции: traceId, spanId,
+  parentSpan, command, messageId, messageType, peer, sendTime, receiveTime,
+  latency (мкс)
+*/
+class FileSink : public SpanSink
+{
+public:
+    typedef clife_ptr<FileSink> Ptr;
+
+    FileSink() = default;
+    ~FileSink();
+
+    bool open(const QString& filePath);
+    void close();
+
+    void write(const Span&) override;
+
+private:
+    DISABLE_DEFAULT_COPY(FileSink)
+
+private:
+    QFile _file;
+    QMutex _lock;
+};
+
+// Текущее время (мкс, UTC)
+qint64 now();
+
+// Начинает новую трассу для сообщения
+void start(const Message::Ptr&);
+
+// Передает контекст трассировки из полученного сообщения source в создавае-
+// мое сообщение message
+void propagate(const Message::Ptr& source, const Message::Ptr& message);
+
+// Устанавливает/возвращает приемник участков трассы. Если приемник не задан,
+// то записи об участках трассы не формируются, при этом контекст трасси-
+// ровки продолжает передаваться по цепочке сервисов
+void setSink(const SpanSink::Ptr&);
+SpanSink::Ptr sink();
+
+// Функции вызываются транспортом. Функция send() устанавливает время
+// отправки сообщения, если оно еще не установлено (при отправке одного
+// сообщения в несколько сокетов время устанавливается один раз), функция
+// receive() формирует запись об участке трассы для полученного сообщения
+// и возвращает идентификатор участка
+void send(Message*);
+quint64 receive(Message*);
+
+} // namespace pproto::trace
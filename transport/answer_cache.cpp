@@ -0,0 +1,260 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/answer_cache.h"
+#include "commands/pool.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/stream_init.h"
+
+#include <cstring>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "AnswerCache")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "AnswerCache")
+#define log_info_m    alog::logger().info    (alog_line_location, "AnswerCache")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "AnswerCache")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "AnswerCache")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "AnswerCache")
+
+namespace pproto::transport {
+
+namespace {
+
+// Префикс json-сообщения, за которым следует идентификатор сообщения
+// (см. Message::toJson())
+const char jsonIdPrefix[] = "{\"id\":\"";
+const int  jsonIdPrefixLen = sizeof(jsonIdPrefix) - 1;
+const int  jsonIdLen = 36;
+
+// Длина идентификатора сообщения в QBinary-формате
+const int  binaryIdLen = 16;
+
+} // namespace
+
+bool AnswerCache::Key::operator== (const Key& key) const
+{
+    return (hash == key.hash)
+           && (traits == key.traits)
+           && (command == key.command)
+           && (content == key.content);
+}
+
+uint qHash(const AnswerCache::Key& key)
+{
+    return uint(key.hash) ^ uint(key.hash >> 32) ^ qHash(key.command);
+}
+
+qint64 AnswerCache::Entry::memory() const
+{
+    return qint64(sizeof(Entry)) + key.content.size() + frame.size();
+}
+
+AnswerCache::AnswerCache(qint64 maxMemory)
+    : _maxMemory(maxMemory)
+{
+    _timer.start();
+}
+
+bool AnswerCache::makeKey(const Message::Ptr& command, SerializeFormat messageFormat,
+                          bool messageWebFlags, Key& key)
+{
+    if (command->type() != Message::Type::Command)
+        return false;
+
+    // Параметры, которые клонируются в ответ функцией cloneForAnswer()
+    // и делают сериализованный ответ уникальным для каждого запроса
+    if (!command->tags().isEmpty()
+        || command->maxTimeLife() != quint64(-1)
+        || command->proxyId() != 0
+        || !command->taskId().isNull()
+        || !command->accessId().isEmpty()
+        || !command->trace().isEmpty())
+    {
+        return false;
+    }
+
+    key.command = command->command();
+    key.ttl = pproto::command::pool().cacheTtl(command->command());
+    key.content = command->content();
+    key.traits = quint64(messageFormat)
+                 | (quint64(messageWebFlags) << 3)
+                 | (quint64(command->priority()) << 4)
+                 | (quint64(command->contentFormat()) << 6)
+                 | (quint64(command->protocolVersionLow()) << 16)
+                 | (quint64(command->protocolVersionHigh()) << 32);
+
+    const char* data = key.content.constData();
+    const int size = key.content.size();
+    key.hash = (quint64(qHashBits(data, size, 0x9E3779B9)) << 32)
+               | quint64(qHashBits(data, size, quint32(size)));
+    return true;
+}
+
+QByteArray AnswerCache::find(const Key& key, const QUuidEx& messageId)
+{
+    QByteArray frame;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        auto it = _index.find(key);
+        if (it == _index.end())
+        {
+            ++_stats.misses;
+            return {};
+        }
+        EntryList::iterator entry = it.value();
+        if (entry->expire < _timer.elapsed())
+        {
+            removeEntry(entry);
+            ++_stats.misses;
+            return {};
+        }
+        // Перемещаем запись в начало списка
+        if (entry != _entries.begin())
+            _entries.splice(_entries.begin(), _entries, entry);
+
+        ++_stats.hits;
+        frame = entry->frame;
+    }
+
+    return setFrameId(frame, SerializeFormat(key.traits & 0x7), messageId);
+}
+
+QByteArray AnswerCache::setFrameId(const QByteArray& frame, SerializeFormat messageFormat,
+                                   const QUuidEx& messageId)
+{
+    // При изменении буфер будет скопирован (механизм implicit sharing),
+    // исходный кадр не изменится
+    QByteArray result = frame;
+    if (messageFormat == SerializeFormat::Json)
+    {
+        const QByteArray& id = messageId.toByteArray();
+        memcpy(result.data() + jsonIdPrefixLen, id.constData() + 1, jsonIdLen);
+    }
+    else
+    {
+        QByteArray id;
+        { //Block for QDataStream
+            QDataStream stream {&id, QIODevice::WriteOnly};
+            STREAM_INIT(stream);
+            stream << messageId;
+        }
+        memcpy(result.data(), id.constData(), binaryIdLen);
+    }
+    return result;
+}
+
+bool AnswerCache::checkFrame(const QByteArray& frame, SerializeFormat messageFormat)
+{
+    if (messageFormat == SerializeFormat::Json)
+        return frame.startsWith(jsonIdPrefix)
+               && frame.size() >= (jsonIdPrefixLen + jsonIdLen);
+
+    return (frame.size() >= binaryIdLen);
+}
+
+void AnswerCache::insert(const Key& key, const QByteArray& frame)
+{
+    if (!checkFrame(frame, SerializeFormat(key.traits & 0x7)))
+    {
+        log_error_m << "Unexpected frame of answer. Answer not cached";
+        return;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.frame = frame;
+    entry.expire = _timer.elapsed() + key.ttl;
+
+    if (entry.memory() > _maxMemory / 4)
+    {
+        log_debug2_m << "Answer is too large for caching. Size: " << frame.size();
+        return;
+    }
+
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    auto it = _index.find(key);
+    if (it != _index.end())
+        removeEntry(it.value());
+
+    _entries.push_front(entry);
+    _index.insert(key, _entries.begin());
+
+    ++_stats.inserts;
+    ++_stats.count;
+    _stats.memory += entry.memory();
+
+    evict();
+}
+
+void AnswerCache::clear()
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    _entries.clear();
+    _index.clear();
+    _stats.memory = 0;
+    _stats.count = 0;
+}
+
+AnswerCache::Stats AnswerCache::stats() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _stats;
+}
+
+qint64 AnswerCache::maxMemory() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _maxMemory;
+}
+
+void AnswerCache::setMaxMemory(qint64 val)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    _maxMemory = val;
+    evict();
+}
+
+void AnswerCache::removeEntry(EntryList::iterator entry)
+{
+    _stats.memory -= entry->memory();
+    --_stats.count;
+
+    _index.remove(entry->key);
+    _entries.erase(entry);
+}
+
+void AnswerCache::evict()
+{
+    while (_stats.memory > _maxMemory && !_entries.empty())
+    {
+        removeEntry(std::prev(_entries.end()));
+        ++_stats.evictions;
+    }
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,143 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Кеш ответов для идемпотентных команд.
+
+  Кеш хранит ответы в сериализованном виде (кадр сообщения до сжатия и шиф-
+  рования). Ключом является идентификатор команды, хеш контента запроса  и
+  параметры сериализации. При попадании в кеш  в  сохраненном  кадре  заме-
+  няется только идентификатор сообщения, обработчик команды и сериализация
+  ответа не выполняются.  Кешируемые команды и время жизни ответов задаются
+  в пуле команд, см. command::Pool::setCacheTtl()
+*****************************************************************************/
+
+#pragma once
+
+#include "message.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+#include "shared/qt/quuidex.h"
+
+#include <QtCore>
+#include <list>
+
+namespace pproto::transport {
+
+class AnswerCache : public clife_base
+{
+public:
+    typedef clife_ptr<AnswerCache> Ptr;
+
+    struct Key
+    {
+        QUuidEx command;
+        quint64 hash = {0};
+
+        // Параметры сериализации сообщения-запроса и сокета, влияющие
+        // на сериализованное представление ответа
+        quint64 traits = {0};
+
+        // Контент запроса, используется для исключения коллизий хеша
+        QByteArray content;
+
+        quint32 ttl = {0};
+        bool operator== (const Key&) const;
+    };
+
+    struct Stats
+    {
+        quint64 hits = {0};
+        quint64 misses = {0};
+        quint64 inserts = {0};
+        quint64 evictions = {0};
+
+        // Память (в байтах) занимаемая записями кеша
+        qint64 memory = {0};
+        int count = {0};
+    };
+
+    // Параметр maxMemory ограничивает память (в байтах) занимаемую кешем
+    AnswerCache(qint64 maxMemory = 16*1024*1024);
+
+    // Формирует ключ для сообщения. Возвращает FALSE если сообщение содержит
+    // параметры, которые переносятся в ответ (tags, taskId и т.д.)  и  делают
+    // ответ уникальным. Время жизни ответа (Key::ttl) берется из пула команд
+    static bool makeKey(const Message::Ptr& command, SerializeFormat messageFormat,
+                        bool messageWebFlags, Key&);
+
+    // Заменяет идентификатор сообщения в сериализованном сообщении frame
+    static QByteArray setFrameId(const QByteArray& frame, SerializeFormat messageFormat,
+                                 const QUuidEx& messageId);
+
+    // Проверяет, что в сериализованном сообщении возможна замена идентификатора
+    static bool checkFrame(const QByteArray& frame, SerializeFormat messageFormat);
+
+    // Возвращает сериализованный ответ с идентификатором messageId. Если ответ
+    // не найден или время его жизни истекло - возвращает пустой буфер
+    QByteArray find(const Key&, const QUuidEx& messageId);
+
+    // Сохраняет сериализованный ответ
+    void insert(const Key&, const QByteArray& frame);
+
+    // Удаляет все записи
+    void clear();
+
+    Stats stats() const;
+
+    qint64 maxMemory() const;
+    void setMaxMemory(qint64);
+
+private:
+    DISABLE_DEFAULT_COPY(AnswerCache)
+
+    struct Entry
+    {
+        Key key;
+        QByteArray frame;
+        qint64 expire = {0};
+        qint64 memory() const;
+    };
+    typedef std::list<Entry> EntryList;
+
+    void removeEntry(EntryList::iterator);
+    void evict();
+
+private:
+    // Элементы упорядочены по времени последнего обращения: в начале списка
+    // находятся наиболее востребованные элементы
+    EntryList _entries;
+    QHash<Key, EntryList::iterator> _index;
+    mutable QMutex _lock;
+
+    QElapsedTimer _timer;
+    qint64 _maxMemory;
+    Stats _stats;
+};
+
+uint qHash(const AnswerCache::Key&);
+
+} // namespace pproto::transport
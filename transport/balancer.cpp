@@ -0,0 +1,410 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/balancer.h"
+#include "logger_operators.h"
+#include "utils.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <climits>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Balancer")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Balancer")
+#define log_info_m    alog::logger().info    (alog_line_location, "Balancer")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Balancer")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Balancer")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Balancer")
+
+namespace pproto::transport {
+
+namespace {
+
+// Время (в микросекундах), в течении которого локальное измерение времени
+// выполнения команд считается актуальным. Если ответы от реплики не полу-
+// чены в течении этого времени, используется значение, переданное репликой
+const qint64 latencyActual = 1000*1000;
+
+// Ограничение количества команд, ожидающих ответа от реплики, на случай,
+// если реплика не отправляет ответы
+const int maxPending = 10000;
+
+} // namespace
+
+Balancer::Balancer()
+{
+    registrationQtMetatypes();
+    _timer.start();
+    _random = quint64(QDateTime::currentMSecsSinceEpoch());
+
+    chk_connect_q(&_reconnectTimer, &QTimer::timeout,
+                  this, &Balancer::reconnect)
+}
+
+Balancer::~Balancer()
+{
+    disconnect();
+    for (const Replica& replica : _replicas)
+        QObject::disconnect(replica.socket.get(), nullptr, this, nullptr);
+}
+
+void Balancer::addReplica(const tcp::Socket::Ptr& socket)
+{
+    if (socket.empty())
+        return;
+
+    chk_connect_d(socket.get(), &base::Socket::message,
+                  this,         &Balancer::socketMessage)
+
+    chk_connect_d(socket.get(), &base::Socket::connected,
+                  this,         &Balancer::socketConnected)
+
+    chk_connect_d(socket.get(), &base::Socket::disconnected,
+                  this,         &Balancer::socketDisconnected)
+
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    Replica replica;
+    replica.socket = socket;
+    _replicas.append(replica);
+}
+
+void Balancer::connect()
+{
+    QVector<tcp::Socket::Ptr> sockets;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        for (const Replica& replica : _replicas)
+            sockets.append(replica.socket);
+    }
+    for (const tcp::Socket::Ptr& socket : sockets)
+        socket->connect();
+
+    _reconnectTimer.start(_reconnectInterval * 1000);
+}
+
+void Balancer::disconnect(unsigned long time)
+{
+    _reconnectTimer.stop();
+
+    QVector<tcp::Socket::Ptr> sockets;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        for (Replica& replica : _replicas)
+        {
+            clearPending(replica);
+            sockets.append(replica.socket);
+        }
+    }
+    for (const tcp::Socket::Ptr& socket : sockets)
+        socket->disconnect(time);
+}
+
+bool Balancer::isConnected() const
+{
+    return (connectedCount() > 0);
+}
+
+int Balancer::connectedCount() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    int count = 0;
+    for (const Replica& replica : _replicas)
+        if (replica.socket->isConnected())
+            ++count;
+    return count;
+}
+
+bool Balancer::send(const Message::Ptr& message)
+{
+    if (message->type() == Message::Type::Answer)
+    {
+        tcp::Socket::Ptr socket;
+        { //Block for QMutexLocker
+            QMutexLocker locker {&_lock}; (void) locker;
+            for (const Replica& replica : _replicas)
+                if (replica.socket->socketDescriptor() == message->socketDescriptor())
+                {
+                    socket = replica.socket;
+                    break;
+                }
+        }
+        if (socket.empty())
+        {
+            log_error_m << "Socket for answer not found"
+                        << ". Command " << CommandNameLog(message->command())
+                        << " discarded";
+            return false;
+        }
+        return socket->send(message);
+    }
+    if (message->type() == Message::Type::Command)
+        return sendCommand(message, false, 0);
+
+    return send(message, _roundRobin++);
+}
+
+bool Balancer::send(const Message::Ptr& message, quint64 orderKey)
+{
+    if (message->type() == Message::Type::Answer)
+        return send(message);
+
+    if (message->type() == Message::Type::Command)
+        return sendCommand(message, true, orderKey);
+
+    tcp::Socket::Ptr socket;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        // Пока за ключом закреплена реплика, сообщение отправляется ей,
+        // иначе реплика определяется ключом
+        auto it = _routes.find(orderKey);
+        if (it != _routes.end()
+            && _replicas[it->replica].socket->isConnected())
+        {
+            socket = _replicas[it->replica].socket;
+        }
+        else
+        {
+            QVector<int> connected;
+            for (int i = 0; i < _replicas.count(); ++i)
+                if (_replicas[i].socket->isConnected())
+                    connected.append(i);
+
+            if (!connected.isEmpty())
+            {
+                int index = connected[int(orderKey % quint64(connected.count()))];
+                socket = _replicas[index].socket;
+            }
+        }
+    }
+    if (socket.empty())
+    {
+        log_error_m << "No connected replicas"
+                    << ". Message " << CommandNameLog(message->command())
+                    << " discarded";
+        return false;
+    }
+    return socket->send(message);
+}
+
+bool Balancer::sendCommand(const Message::Ptr& message, bool ordered, quint64 orderKey)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    int index = -1;
+    if (ordered)
+    {
+        auto it = _routes.find(orderKey);
+        if (it != _routes.end())
+        {
+            Replica& replica = _replicas[it->replica];
+            if (replica.socket->isConnected())
+                index = it->replica;
+            else
+                clearPending(replica);
+        }
+    }
+    if (index < 0)
+        index = chooseReplica();
+
+    if (index < 0)
+    {
+        log_error_m << "No connected replicas"
+                    << ". Command " << CommandNameLog(message->command())
+                    << " discarded";
+        return false;
+    }
+
+    Replica& replica = _replicas[index];
+    if (replica.pending.count() > maxPending)
+    {
+        log_warn_m << "Too many commands awaiting answer from replica"
+                   << ". Socket descriptor: " << replica.socket->socketDescriptor();
+        clearPending(replica);
+    }
+
+    if (!replica.socket->send(message))
+        return false;
+
+    if (!replica.pending.contains(message->id()))
+    {
+        Pending pending;
+        pending.time = _timer.nsecsElapsed() / 1000;
+        pending.orderKey = orderKey;
+        pending.ordered = ordered;
+        replica.pending.insert(message->id(), pending);
+
+        if (ordered)
+        {
+            Route& route = _routes[orderKey];
+            route.replica = index;
+            ++route.pending;
+        }
+    }
+    return true;
+}
+
+quint64 Balancer::replicaCost(const Replica& replica) const
+{
+    const data::LoadReport remote = replica.socket->remoteLoad();
+
+    const qint64 now = _timer.nsecsElapsed() / 1000;
+
+    // Локальное измерение учитывает сетевую задержку и очередь на стороне
+    // реплики, поэтому имеет приоритет над значением, переданным репликой
+    quint64 latency = remote.latency;
+    if (replica.latency > 0
+        && (!replica.pending.isEmpty() || (now - replica.lastAnswer) < latencyActual))
+    {
+        latency = replica.latency;
+    }
+
+    quint64 inflight = quint64(replica.pending.count()) + remote.inflight;
+    return (inflight + 1) * (latency + 1);
+}
+
+int Balancer::chooseReplica()
+{
+    QVector<int> connected;
+    connected.reserve(_replicas.count());
+    for (int i = 0; i < _replicas.count(); ++i)
+        if (_replicas[i].socket->isConnected())
+            connected.append(i);
+
+    if (connected.isEmpty())
+        return -1;
+
+    if (connected.count() == 1)
+        return connected[0];
+
+    // Выбор из двух случайных реплик
+    const quint64 count = quint64(connected.count());
+    int a = int(random() % count);
+    int b = int(random() % (count - 1));
+    if (b >= a)
+        ++b;
+
+    const Replica& replicaA = _replicas[connected[a]];
+    const Replica& replicaB = _replicas[connected[b]];
+    return (replicaCost(replicaA) <= replicaCost(replicaB)) ? connected[a] : connected[b];
+}
+
+void Balancer::clearPending(Replica& replica)
+{
+    for (const Pending& pending : replica.pending)
+    {
+        if (!pending.ordered)
+            continue;
+
+        auto it = _routes.find(pending.orderKey);
+        if (it != _routes.end() && --it->pending <= 0)
+            _routes.erase(it);
+    }
+    replica.pending.clear();
+}
+
+quint64 Balancer::random()
+{
+    // Генератор SplitMix64
+    quint64 z = (_random += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void Balancer::reconnect()
+{
+    QVector<tcp::Socket::Ptr> sockets;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        for (const Replica& replica : _replicas)
+            if (!replica.socket->isRunning())
+                sockets.append(replica.socket);
+    }
+    for (const tcp::Socket::Ptr& socket : sockets)
+    {
+        log_debug_m << "Reconnect to replica " << socket->peerPoint();
+        socket->connect();
+    }
+
+    if (_reconnectTimer.interval() != _reconnectInterval * 1000)
+        _reconnectTimer.start(_reconnectInterval * 1000);
+}
+
+void Balancer::socketMessage(const Message::Ptr& message)
+{
+    // Обработчик вызывается в потоке сокета
+    if (message->type() == Message::Type::Answer)
+    {
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        for (Replica& replica : _replicas)
+        {
+            auto it = replica.pending.find(message->id());
+            if (it == replica.pending.end())
+                continue;
+
+            const qint64 now = _timer.nsecsElapsed() / 1000;
+            const qint64 sample = qMin(now - it->time, qint64(INT_MAX));
+            replica.lastAnswer = now;
+            replica.latency = (replica.latency == 0)
+                ? quint32(sample)
+                : quint32(qint64(replica.latency) + (sample - qint64(replica.latency)) / 8);
+
+            if (it->ordered)
+            {
+                auto route = _routes.find(it->orderKey);
+                if (route != _routes.end() && --route->pending <= 0)
+                    _routes.erase(route);
+            }
+            replica.pending.erase(it);
+            break;
+        }
+    }
+    emit this->message(message);
+}
+
+void Balancer::socketConnected(SocketDescriptor socketDescriptor)
+{
+    emit connected(socketDescriptor);
+}
+
+void Balancer::socketDisconnected(SocketDescriptor socketDescriptor)
+{
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        // Ответы на команды, отправленные реплике, получены не будут
+        for (Replica& replica : _replicas)
+            if (!replica.pending.isEmpty() && !replica.socket->isConnected())
+                clearPending(replica);
+    }
+    emit disconnected(socketDescriptor);
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,165 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Балансировка команд между репликами сервиса на клиентской стороне.
+
+  Балансировщик содержит TCP-сокеты, подключенные к нескольким репликам
+  сервиса. Каждая команда отправляется наименее загруженной реплике, реплика
+  выбирается методом "двух случайных выборов" (power of two choices): из двух
+  случайно выбранных подключенных реплик выбирается реплика  с  меньшей
+  оценкой загруженности. Оценка загруженности вычисляется по количеству
+  команд, ожидающих ответа, и по времени выполнения команд. Используются
+  как локальные измерения (команды, отправленные балансировщиком), так и
+  сведения, которые реплика передает в ответе на команду EchoConnection
+  (см. transport/load_meter.h). Для получения сведений от реплик сокетам
+  необходимо задать таймаут EchoConnection (см. Socket::setEchoTimeout()),
+  а на стороне реплик - измеритель загруженности (см. Properties::
+  setLoadMeter()).
+
+  Для сообщений с ключом упорядочивания реплика закрепляется за ключом на
+  время, пока есть команды с этим ключом, ожидающие ответа. Таким образом,
+  команды с одинаковым ключом не могут быть обработаны разными репликами
+  одновременно, и порядок их выполнения сохраняется.
+*****************************************************************************/
+
+#pragma once
+
+#include "transport/tcp.h"
+
+#include "shared/defmac.h"
+#include <QtCore>
+#include <atomic>
+
+namespace pproto::transport {
+
+class Balancer : public QObject
+{
+public:
+    Balancer();
+    ~Balancer();
+
+    // Добавляет сокет реплики. Сокет должен быть инициализирован (см. tcp::
+    // Socket::init()), подключение выполняется функцией connect()
+    void addReplica(const tcp::Socket::Ptr&);
+
+    // Выполняет подключение ко всем репликам
+    void connect();
+
+    // Разрывает соединения со всеми репликами
+    void disconnect(unsigned long time = ULONG_MAX);
+
+    // Возвращает TRUE если установлено соединение хотя бы с одной репликой
+    bool isConnected() const;
+
+    // Количество реплик, с которыми установлено соединение
+    int connectedCount() const;
+
+    // Отправляет сообщение. Ответы отправляются через соединение, из которого
+    // была получена команда. Команды отправляются наименее загруженной реп-
+    // лике, остальные сообщения распределяются по репликам циклически
+    bool send(const Message::Ptr&);
+
+    // Отправляет сообщение с сохранением порядка выполнения для ключа orderKey
+    bool send(const Message::Ptr&, quint64 orderKey);
+
+    // Интервал (в секундах) между попытками восстановления соединений.
+    // Значение параметра по умолчанию равно 1
+    int reconnectInterval() const {return _reconnectInterval;}
+    void setReconnectInterval(int val) {_reconnectInterval = val;}
+
+signals:
+    // Сигнал эмитируется при получении сообщения от любой реплики
+    void message(const pproto::Message::Ptr&);
+
+    // Сигналы эмитируются при установке и разрыве соединения с репликой
+    void connected(pproto::SocketDescriptor);
+    void disconnected(pproto::SocketDescriptor);
+
+private slots:
+    void reconnect();
+    void socketMessage(const pproto::Message::Ptr&);
+    void socketConnected(pproto::SocketDescriptor);
+    void socketDisconnected(pproto::SocketDescriptor);
+
+private:
+    Q_OBJECT
+    DISABLE_DEFAULT_COPY(Balancer)
+
+    // Команда, ожидающая ответа
+    struct Pending
+    {
+        qint64 time = {0}; // Время отправки (в микросекундах)
+        quint64 orderKey = {0};
+        bool ordered = {false};
+    };
+
+    struct Replica
+    {
+        tcp::Socket::Ptr socket;
+        QHash<QUuidEx, Pending> pending;
+
+        // Сглаженное время выполнения команды (в микросекундах), измеренное
+        // на стороне балансировщика
+        quint32 latency = {0};
+
+        // Время получения последнего ответа (в микросекундах)
+        qint64 lastAnswer = {0};
+    };
+
+    // Реплика, закрепленная за ключом упорядочивания
+    struct Route
+    {
+        int replica = {-1};
+        int pending = {0};
+    };
+
+    // Оценка загруженности реплики
+    quint64 replicaCost(const Replica&) const;
+
+    // Выбор реплики для отправки команды
+    int chooseReplica();
+
+    // Отправка команды выбранной реплике
+    bool sendCommand(const Message::Ptr&, bool ordered, quint64 orderKey);
+
+    // Удаляет команды, ожидающие ответа от реплики
+    void clearPending(Replica&);
+
+    quint64 random();
+
+private:
+    QVector<Replica> _replicas;
+    QHash<quint64, Route> _routes;
+    mutable QMutex _lock;
+
+    QElapsedTimer _timer;
+    std::atomic<quint64> _random = {0};
+    std::atomic<quint64> _roundRobin = {0};
+
+    QTimer _reconnectTimer;
+    int _reconnectInterval = {1};
+};
+
+} // namespace pproto::transport
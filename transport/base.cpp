@@ -30,6 +30,8 @@
 
 #include "logger_operators.h"
 #include "utils.h"
+#include "probes.h"
+#include "trace.h"
 
 #include "shared/break_point.h"
 #include "shared/prog_abort.h"
@@ -39,6 +41,7 @@
 #include "shared/qt/stream_init.h"
 #include "shared/qt/version_number.h"
 
+#include <memory>
 #include <utility>
 #include <stdexcept>
 
@@ -46,6 +49,16 @@
 #include <sodium.h>
 #endif
 
+#if defined(Q_OS_LINUX)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#endif
+
 #define log_error_m   alog::logger().error   (alog_line_location, "Transport")
 #define log_warn_m    alog::logger().warn    (alog_line_location, "Transport")
 #define log_info_m    alog::logger().info    (alog_line_location, "Transport")
@@ -55,6 +68,197 @@
 
 namespace pproto::transport {
 
+namespace {
+
+// Подсказка процессору о выполнении цикла активного ожидания
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile ("yield");
+#endif
+}
+
+// Извлекает сообщение из очередей с учетом приоритетов: сообщения с высоким
+// приоритетом извлекаются первыми, на каждые пять сообщений с нормальным при-
+// оритетом извлекается одно сообщение с низким приоритетом.  Возвращает
+// nullptr если очереди пусты
+Message* releaseByPriority(Message::List& high, Message::List& norm,
+                           Message::List& low, int& normCounter)
+{
+    if (!high.empty())
+        return high.release(0);
+
+    if (!norm.empty())
+    {
+        if (normCounter < 5)
+        {
+            ++normCounter;
+            return norm.release(0);
+        }
+        normCounter = 0;
+        if (!low.empty())
+            return low.release(0);
+        return norm.release(0);
+    }
+    if (!low.empty())
+        return low.release(0);
+
+    return nullptr;
+}
+
+// Очередь принятых сообщений. Сообщения обрабатываются в порядке, определя-
+// емом их приоритетом, с той же политикой, что и при отправке (см. функцию
+// releaseByPriority()). Это позволяет обработать срочные команды раньше
+// большого количества ранее принятых сообщений с низким приоритетом
+class AcceptQueue
+{
+public:
+    void add(Message* m)
+    {
+        if (m->priority() == Message::Priority::High)
+            _high.add(m);
+        else if (m->priority() == Message::Priority::Low)
+            _low.add(m);
+        else
+            _norm.add(m);
+    }
+    Message* release()
+    {
+        return releaseByPriority(_high, _norm, _low, _normCounter);
+    }
+    bool empty() const
+    {
+        return _high.empty() && _norm.empty() && _low.empty();
+    }
+
+private:
+    Message::List _high;
+    Message::List _norm;
+    Message::List _low;
+    int _normCounter = {0};
+};
+
+// Проверяет размер данных после декомпрессии по заголовку сжатого буфера
+// (см. qCompress()) до выполнения декомпрессии
+bool uncompressedSizeValid(const QByteArray& buff, qint32 maxSize)
+{
+    if (maxSize <= 0 || buff.size() < int(sizeof(quint32)))
+        return true;
+
+    quint32 size = qFromBigEndian<quint32>((const uchar*)buff.constData());
+    if (size <= quint32(maxSize))
+        return true;
+
+    log_error_m << "Uncompressed frame size " << size
+                << " exceeds limit " << maxSize
+                << ". Connection will be closed";
+    return false;
+}
+
+// Выполняет расшифровку и декомпрессию принятого кадра. Возвращает FALSE
+// если кадр не может быть обработан, в этом случае соединение должно быть
+// закрыто. Функция выполняется в потоке сокета или в пуле потоков конвейера
+// (см. transport/pipeline.h)
+bool decodeFrame(QByteArray& frame, bool compressed, bool encryption,
+                 const uchar* sharedSecretKey, qint32 maxUncompressedSize,
+                 SocketDescriptor socketDescriptor)
+{
+#ifdef SODIUM_ENCRYPTION
+    if (encryption)
+    {
+        PPROTO_PROBE2(decrypt_begin, frame.size(), socketDescriptor);
+
+        QByteArray mac;
+        QByteArray nonce;
+        QByteArray paddingBuff;
+
+        { //Block for QDataStream
+            QDataStream stream {&frame, QIODevice::ReadOnly | QIODevice::Unbuffered};
+            STREAM_INIT(stream);
+            mac = serialize::readByteArray(stream);
+            nonce = serialize::readByteArray(stream);
+            paddingBuff = serialize::readByteArray(stream);
+        }
+
+        int res = crypto_box_open_detached_afternm((uchar*) paddingBuff.constData(), // message
+                                                   (uchar*) paddingBuff.constData(), // cript
+                                                   (uchar*) mac.constData(),         // mac
+                                                            paddingBuff.size(),      // cript size
+                                                   (uchar*) nonce.constData(),       // nonce
+                                                            sharedSecretKey);
+        if (res != 0)
+        {
+            log_error_m << "Failed message decryption";
+            return false;
+        }
+
+        quint8 isCompressed;
+        { //Block for QDataStream
+            QDataStream stream {&paddingBuff, QIODevice::ReadOnly | QIODevice::Unbuffered};
+            STREAM_INIT(stream);
+            stream >> isCompressed;
+            frame = serialize::readByteArray(stream);
+        }
+        PPROTO_PROBE2(decrypt_end, frame.size(), socketDescriptor);
+
+        compressed = isCompressed;
+    }
+#else
+    (void) encryption;
+    (void) sharedSecretKey;
+#endif // SODIUM_ENCRYPTION
+
+    if (compressed)
+    {
+        if (!uncompressedSizeValid(frame, maxUncompressedSize))
+            return false;
+
+        PPROTO_PROBE2(decompress_begin, frame.size(), socketDescriptor);
+        frame = qUncompress(frame);
+        PPROTO_PROBE2(decompress_end, frame.size(), socketDescriptor);
+    }
+    return true;
+}
+
+// Задание конвейера для обработки принятого кадра (см. decodeFrame())
+class FrameJob : public Pipeline::Job
+{
+public:
+    typedef clife_ptr<FrameJob> Ptr;
+
+    FrameJob(const QByteArray& frame, bool compressed, bool encryption,
+             const uchar* sharedSecretKey, qint32 maxUncompressedSize,
+             SocketDescriptor socketDescriptor)
+        : frame(frame),
+          _compressed(compressed),
+          _encryption(encryption),
+          _sharedSecretKey(sharedSecretKey),
+          _maxUncompressedSize(maxUncompressedSize),
+          _socketDescriptor(socketDescriptor)
+    {}
+
+    QByteArray frame;
+    bool failed = {false};
+
+protected:
+    void process() override
+    {
+        failed = !decodeFrame(frame, _compressed, _encryption, _sharedSecretKey,
+                              _maxUncompressedSize, _socketDescriptor);
+    }
+
+private:
+    const bool _compressed;
+    const bool _encryption;
+    const uchar* _sharedSecretKey;
+    const qint32 _maxUncompressedSize;
+    const SocketDescriptor _socketDescriptor;
+};
+
+} // namespace
+
 namespace base {
 
 //----------------------------- SocketCommon ---------------------------------
@@ -90,6 +294,8 @@ bool SocketCommon::send(const Message::Ptr& message)
         }
     }
 
+    trace::send(message.get());
+
     message->add_ref();
     { //Block for QMutexLocker
         QMutexLocker locker {&_messagesLock}; (void) locker;
@@ -105,6 +311,8 @@ bool SocketCommon::send(const Message::Ptr& message)
             default:
                 _messagesNorm.add(message.get());
         }
+        PPROTO_PROBE_MESSAGE(message_enqueue, message, message->priority(),
+                             _messagesHigh.count() + _messagesNorm.count() + _messagesLow.count());
 
         if (alog::logger().level() == alog::Level::Debug2)
         {
@@ -143,11 +351,34 @@ int SocketCommon::messagesCount() const
 {
     QMutexLocker locker {&_messagesLock}; (void) locker;
 
-    return _messagesHigh.count()
+    return _messagesEncoded.count()
+           + _messagesHigh.count()
            + _messagesNorm.count()
            + _messagesLow.count();
 }
 
+qint64 SocketCommon::messagesMemory() const
+{
+    QMutexLocker locker {&_messagesLock}; (void) locker;
+
+    qint64 memory = 0;
+    for (const QPair<Message::Ptr, QByteArray>& encoded : _messagesEncoded)
+        memory += encoded.first->memorySize() + encoded.second.capacity();
+
+    for (Message* m : _messagesHigh) memory += m->memorySize();
+    for (Message* m : _messagesNorm) memory += m->memorySize();
+    for (Message* m : _messagesLow)  memory += m->memorySize();
+
+    return memory;
+}
+
+void SocketCommon::sendEncoded(const Message::Ptr& message, const QByteArray& frame)
+{
+    QMutexLocker locker {&_messagesLock}; (void) locker;
+    _messagesEncoded.append({message, frame});
+    _messagesCond.wakeAll();
+}
+
 //-------------------------------- Socket ------------------------------------
 
 Socket::Socket(SocketType type) : _type(type)
@@ -180,24 +411,12 @@ bool Socket::isConnected() const
 
 bool Socket::socketIsConnected() const
 {
-    bool res = false;
-    if (_socketLock.tryLock(10))
-    {
-        res = socketIsConnectedInternal();
-        _socketLock.unlock();
-    }
-    return res;
+    return _socketConnected;
 }
 
 bool Socket::isLocal() const
 {
-    bool res = false;
-    if (_socketLock.tryLock(10))
-    {
-        res = isLocalInternal();
-        _socketLock.unlock();
-    }
-    return res;
+    return _socketLocal;
 }
 
 Socket::ProtocolCompatible Socket::protocolCompatible() const
@@ -207,13 +426,7 @@ Socket::ProtocolCompatible Socket::protocolCompatible() const
 
 SocketDescriptor Socket::socketDescriptor() const
 {
-    SocketDescriptor res = -1;
-    if (_socketLock.tryLock(10))
-    {
-        res = socketDescriptorInternal();
-        _socketLock.unlock();
-    }
-    return res;
+    return _socketDescriptor;
 }
 
 void Socket::connect()
@@ -228,6 +441,7 @@ void Socket::disconnect(unsigned long time)
 
 void Socket::socketDisconnected()
 {
+    _socketConnected = false;
     emit disconnected(_initSocketDescriptor);
     _initSocketDescriptor = -1;
 }
@@ -256,6 +470,7 @@ void Socket::setMessageFormat(SerializeFormat val)
         return;
 
     _messageFormat = val;
+    _socketMessageFormat = val;
 }
 
 void Socket::setEncryption(bool val)
@@ -279,6 +494,46 @@ void Socket::setEchoTimeout(int val)
     _echoTimeout = val * 1000; // переводим в миллисекунды
 }
 
+Timestamping::Stats Socket::timestampingStats() const
+{
+    return _timestamping.stats();
+}
+
+data::LoadReport Socket::remoteLoad() const
+{
+    SpinLocker locker {_remoteLoadLock}; (void) locker;
+    return _remoteLoad;
+}
+
+qint64 Socket::MemoryUsage::total() const
+{
+    return sendQueue + writeBuffer + readBuffer
+           + pendingAnswers + payloadDedup + deltaCodec + dictCodec;
+}
+
+Socket::MemoryUsage& Socket::MemoryUsage::operator+= (const MemoryUsage& mu)
+{
+    sendQueue      += mu.sendQueue;
+    writeBuffer    += mu.writeBuffer;
+    readBuffer     += mu.readBuffer;
+    pendingAnswers += mu.pendingAnswers;
+    payloadDedup   += mu.payloadDedup;
+    deltaCodec     += mu.deltaCodec;
+    dictCodec      += mu.dictCodec;
+    return *this;
+}
+
+Socket::MemoryUsage Socket::memoryUsage() const
+{
+    MemoryUsage memoryUsage;
+    { //Block for SpinLocker
+        SpinLocker locker {_memoryUsageLock}; (void) locker;
+        memoryUsage = _memoryUsage;
+    }
+    memoryUsage.sendQueue = messagesMemory();
+    return memoryUsage;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch-enum"
 
@@ -310,25 +565,125 @@ void Socket::run()
     uchar* sharedSecretKey = externPublicKey + crypto_box_PUBLICKEYBYTES;
 #endif // SODIUM_ENCRYPTION
 
-    { //Block for QMutexLocker
-        QMutexLocker locker {&_socketLock}; (void) locker;
-
-        socketCreate();
-        if (!socketInit())
-        {
-            socketClose();
-            _initSocketDescriptor = -1;
+    socketCreate();
+    if (!socketInit())
+    {
+        socketClose();
+        publishSocketState();
+        _initSocketDescriptor = -1;
 
 #ifdef SODIUM_ENCRYPTION
-            sodium_free(cryptoKeysBuff);
+        sodium_free(cryptoKeysBuff);
 #endif
-            return;
-        }
+        return;
     }
     _initSocketDescriptor = socketDescriptorInternal();
+    publishSocketState();
+    _connectionContext = ConnectionContext::Ptr();
 
     Message::List internalMessages;
-    Message::List acceptMessages;
+    AcceptQueue acceptMessages;
+
+    // Ключи команд (кешируемых или объединяемых), ответы на которые еще
+    // не отправлены
+    struct PendingAnswer
+    {
+        AnswerCache::Key key;
+        bool cache = {false};
+        bool flight = {false};
+    };
+    QHash<QUuidEx, PendingAnswer> pendingAnswers;
+
+    // Прерывает объединенные команды, ответы на которые не будут отправлены
+    auto abortFlights = [&]()
+    {
+        if (_singleFlight.empty())
+            return;
+
+        for (const PendingAnswer& pending : pendingAnswers)
+            if (pending.flight)
+                _singleFlight->abort(pending.key, this);
+    };
+
+    // Время получения (в микросекундах) команд, переданных в обработчики,
+    // используется измерителем загруженности
+    QHash<QUuidEx, qint64> meterCommands;
+    QElapsedTimer meterTimer;
+    meterTimer.start();
+
+    // Периодичность обновления сведений об объеме занимаемой памяти
+    QElapsedTimer memoryTimer;
+    memoryTimer.start();
+
+    { //Block for SpinLocker
+        SpinLocker locker {_remoteLoadLock}; (void) locker;
+        _remoteLoad = data::LoadReport();
+    }
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+    // Дедупликация контента
+    std::unique_ptr<PayloadDedup> payloadDedup;
+    if (_payloadDedupSize > 0)
+        payloadDedup.reset(new PayloadDedup(_payloadDedupSize, _payloadDedupCache));
+    bool payloadDedupHello = false;
+
+    // Дельта-кодирование
+    std::unique_ptr<DeltaCodec> deltaCodec;
+    if (_deltaKeyframe > 0)
+        deltaCodec.reset(new DeltaCodec(_deltaKeyframe));
+    bool deltaCodecHello = false;
+
+    // Сжатие со словарями
+    std::unique_ptr<DictCodec> dictCodec;
+    if (!_dictStore.empty() && DictCodec::supported())
+        dictCodec.reset(new DictCodec(_dictStore, _compressionSize, _maxUncompressedSize));
+    bool dictCodecHello = false;
+
+    // Возвращает TRUE если сегменты контента сообщения могут быть переданы
+    // в сокет без объединения. Это возможно только в том случае, когда
+    // сериализованное сообщение не требует последующей обработки целиком
+    // (кеширование ответа, дельта-кодирование, дедупликация, сжатие или
+    // шифрование)
+    auto segmentedFrame = [&](const Message::Ptr& message) -> bool
+    {
+        if (!message->contentIsSegmented())
+            return false;
+
+        if (pendingAnswers.contains(message->id()))
+            return false;
+#ifdef SODIUM_ENCRYPTION
+        if (_encryption)
+            return false;
+#endif
+        if (deltaCodec
+            && deltaCodec->active()
+            && pproto::command::pool().deltaEncoding(message->command()))
+        {
+            return false;
+        }
+        if (payloadDedup
+            && payloadDedup->active()
+            && message->contentRawSize() >= _payloadDedupSize)
+        {
+            return false;
+        }
+        if (dictCodec
+            && dictCodec->active()
+            && pproto::command::pool().dictCompression(message->command())
+            && message->size() <= _compressionSize)
+        {
+            return false;
+        }
+        if (!isLocal()
+            && message->compression() == Message::Compression::None
+            && message->size() > _compressionSize
+            && _compressionLevel != 0)
+        {
+            return false;
+        }
+        return true;
+    };
+#endif
 
     QElapsedTimer timer;
     QElapsedTimer echoTimer;
@@ -341,6 +696,22 @@ void Socket::run()
     char*  readBuffCur  = nullptr;
     char*  readBuffEnd  = nullptr;
 
+    // Память, зарезервированная для принимаемого кадра, и память, зарезерви-
+    // рованная для принятых кадров, сообщения которых еще не переданы в об-
+    // работчики (см. Properties::connectionMemory(), memoryBudget())
+    qint64 frameReserved = 0;
+    qint64 acceptReserved = 0;
+
+    // Кадры, обрабатываемые в пуле потоков конвейера, в порядке приема
+    // (см. Properties::pipeline())
+    QList<FrameJob::Ptr> pipelineFrames;
+
+#ifdef SODIUM_ENCRYPTION
+    const uchar* frameKey = sharedSecretKey;
+#else
+    const uchar* frameKey = nullptr;
+#endif
+
     // Сигнатура формата сериализации
     QUuidEx serializeSignature;
     for (const ProtocolSign& sign : _protocolMap)
@@ -356,7 +727,6 @@ void Socket::run()
     if (!isListenerSide() && serializeSignature.isNull())
     {
         log_error_m << "Message serialize format signature undefined";
-        QMutexLocker locker {&_socketLock}; (void) locker;
         socketClose();
         prog_abort();
     }
@@ -468,6 +838,9 @@ void Socket::run()
 
             // Отправляем ответ
             Message::Ptr answer = message->cloneForAnswer();
+            if (!_loadMeter.empty())
+                writeToMessage(_loadMeter->report(), answer);
+
             internalMessages.add(answer.detach());
             echoTimer.start();
         }
@@ -475,6 +848,18 @@ void Socket::run()
                  && message->id() == commandEchoConnectionId)
         {
             commandEchoConnectionId = QUuidEx();
+
+            // Ответ содержит сведения о загруженности удаленной стороны
+            if (message->contentRawSize() > 0)
+            {
+                data::LoadReport loadReport;
+                readFromMessage(message, loadReport);
+                if (loadReport.dataIsValid)
+                {
+                    SpinLocker locker {_remoteLoadLock}; (void) locker;
+                    _remoteLoad = loadReport;
+                }
+            }
         }
     };
 
@@ -541,6 +926,7 @@ void Socket::run()
 
     #define CHECK_SOCKET_ERROR \
         if (!socketIsConnectedInternal()) { \
+            _socketConnected = false; \
             printSocketError(alog_line_location, "Transport"); \
             loopBreak = true; \
             break; \
@@ -662,6 +1048,7 @@ void Socket::run()
                     {
                         signatureFound = true;
                         _messageFormat = sign.messageFormat;
+                        _socketMessageFormat = sign.messageFormat;
                         _encryption = sign.encryption;
                         break;
                     }
@@ -805,6 +1192,13 @@ void Socket::run()
             internalMessages.add(m.detach());
         }
 
+        const bool busyPoll = (_busyPollCpu >= 0);
+        if (busyPoll)
+            busyPollInit();
+
+        _timestamping.reset((type() == SocketType::Tcp) ? _timestampingMode
+                                                        : Timestamping::Mode::None);
+
         if ((_echoTimeout > 0) && !isListenerSide())
         {
             Message::Ptr m = Message::create(command::EchoConnection, _messageFormat);
@@ -826,6 +1220,7 @@ void Socket::run()
             while (messagesCount() == 0
                    && readBuffSize == 0
                    && acceptMessages.empty()
+                   && pipelineFrames.isEmpty()
                    && internalMessages.empty()
                    && socketBytesAvailable() == 0)
             {
@@ -840,6 +1235,30 @@ void Socket::run()
                     CHECK_SOCKET_ERROR
                 }
 
+                if (busyPoll)
+                {
+                    // Режим busy-poll: поток не засыпает, после заданного
+                    // количества итераций ожидания уступает ядро
+                    if (_busyPollSpin > 0)
+                    {
+                        for (int i = 0; i < _busyPollSpin; ++i)
+                            cpuRelax();
+                        QThread::yieldCurrentThread();
+                    }
+                    socketWaitForReadyRead(0);
+                    CHECK_SOCKET_ERROR
+
+                    if (_echoTimeout > 0)
+                    {
+                        int timeout = _echoTimeout;
+                        if (isListenerSide())
+                            timeout += 5*1000; // +5 сек
+                        if (echoTimer.hasExpired(timeout))
+                            break;
+                    }
+                    continue;
+                }
+
                 ++sleepCount;
                 int condDelay = 1;
 
@@ -904,13 +1323,82 @@ void Socket::run()
                 CHECK_SOCKET_ERROR
             }
 
+#ifdef PPROTO_QBINARY_SERIALIZE
+            // Уведомление противоположной стороны о поддержке дедупликации
+            if (payloadDedup
+                && !payloadDedupHello
+                && _protocolCompatible == ProtocolCompatible::Yes)
+            {
+                if (_messageFormat == SerializeFormat::QBinary)
+                    internalMessages.add(payloadDedup->hello().detach());
+                payloadDedupHello = true;
+            }
+
+            // Уведомление противоположной стороны о поддержке дельта-кодирования
+            if (deltaCodec
+                && !deltaCodecHello
+                && _protocolCompatible == ProtocolCompatible::Yes)
+            {
+                if (_messageFormat == SerializeFormat::QBinary)
+                    internalMessages.add(deltaCodec->hello().detach());
+                deltaCodecHello = true;
+            }
+
+            // Уведомление противоположной стороны о поддержке сжатия со словарями
+            if (dictCodec
+                && !dictCodecHello
+                && _protocolCompatible == ProtocolCompatible::Yes)
+            {
+                if (_messageFormat == SerializeFormat::QBinary)
+                    internalMessages.add(dictCodec->hello().detach());
+                dictCodecHello = true;
+            }
+#endif
+
+            if (memoryTimer.hasExpired(200))
+            {
+                MemoryUsage memoryUsage;
+                memoryUsage.writeBuffer = socketBytesToWrite();
+                memoryUsage.readBuffer = readBuff.capacity();
+                memoryUsage.pendingAnswers =
+                    pendingAnswers.count() * qint64(sizeof(QUuidEx) + sizeof(PendingAnswer))
+                    + meterCommands.count() * qint64(sizeof(QUuidEx) + sizeof(qint64));
+#ifdef PPROTO_QBINARY_SERIALIZE
+                if (payloadDedup)
+                    memoryUsage.payloadDedup = payloadDedup->memory();
+                if (deltaCodec)
+                    memoryUsage.deltaCodec = deltaCodec->memory();
+                if (dictCodec)
+                    memoryUsage.dictCodec = dictCodec->memory();
+#endif
+                { //Block for SpinLocker
+                    SpinLocker locker {_memoryUsageLock}; (void) locker;
+                    _memoryUsage = memoryUsage;
+                }
+                memoryTimer.start();
+            }
+
             //--- Отправка сообщений ---
             if (socketBytesToWrite() == 0)
             {
+                // Метки времени включаются только при пустом буфере записи
+                // (см. Timestamping::enable())
+                if (_timestampingMode != Timestamping::Mode::None
+                    && !_timestamping.active())
+                {
+                    _timestamping.enable(int(socketDescriptorInternal()), true);
+                }
+
                 timer.start();
                 while (true)
                 {
                     Message::Ptr message;
+                    QByteArray buff;
+
+                    // Сегменты контента, следующие за buff (см. Message::
+                    // appendContentSegment())
+                    QVector<QByteArray> segments;
+
                     if (!internalMessages.empty())
                         message.attach(internalMessages.release(0));
 
@@ -920,32 +1408,24 @@ void Socket::run()
                     {
                         QMutexLocker locker {&_messagesLock}; (void) locker;
 
-                        //--- Приоритизация сообщений ---
-                        if (!_messagesHigh.empty())
-                            message.attach(_messagesHigh.release(0));
-
-                        if (message.empty() && !_messagesNorm.empty())
+                        if (!_messagesEncoded.isEmpty())
                         {
-                            if (_messagesNormCounter < 5)
-                            {
-                                ++_messagesNormCounter;
-                                message.attach(_messagesNorm.release(0));
-                            }
-                            else
-                            {
-                                _messagesNormCounter = 0;
-                                if (!_messagesLow.empty())
-                                    message.attach(_messagesLow.release(0));
-                                else
-                                    message.attach(_messagesNorm.release(0));
-                            }
+                            message = _messagesEncoded.first().first;
+                            buff = _messagesEncoded.first().second;
+                            _messagesEncoded.removeFirst();
                         }
-                        if (message.empty() && !_messagesLow.empty())
-                            message.attach(_messagesLow.release(0));
+
+                        //--- Приоритизация сообщений ---
+                        if (message.empty())
+                            message.attach(releaseByPriority(_messagesHigh, _messagesNorm,
+                                                             _messagesLow, _messagesNormCounter));
                     }
                     if (loopBreak || message.empty())
                         break;
 
+                    PPROTO_PROBE_MESSAGE(message_dequeue, message, message->priority(),
+                                         _initSocketDescriptor);
+
 #ifdef PPROTO_JSON_SERIALIZE
                     if (_messageFormat == SerializeFormat::Json
                         && !message->contentIsEmpty())
@@ -982,29 +1462,119 @@ void Socket::run()
                                      << ". Command: " << CommandNameLog(message->command());
                     }
 
-                    QByteArray buff;
-                    switch (_messageFormat)
-                    {
+                    if (buff.isEmpty())
+                        switch (_messageFormat)
+                        {
 #ifdef PPROTO_QBINARY_SERIALIZE
-                        case SerializeFormat::QBinary:
-                            buff = message->toQBinary();
-                            break;
+                            case SerializeFormat::QBinary:
+                                if (segmentedFrame(message))
+                                    buff = message->toQBinary(segments);
+                                else
+                                    buff = message->toQBinary();
+                                break;
 #endif
 #ifdef PPROTO_JSON_SERIALIZE
-                        case SerializeFormat::Json:
-                            buff = message->toJson(_messageWebFlags);
-                            if (alog::logger().level() == alog::Level::Debug2)
+                            case SerializeFormat::Json:
+                                buff = message->toJson(_messageWebFlags);
+                                if (alog::logger().level() == alog::Level::Debug2)
+                                {
+                                    log_debug2_m << "Message json before sending: " << buff;
+                                }
+                                break;
+#endif
+                            default:
+                                log_error_m << "Unsupported message serialize format: "
+                                            << _messageFormat;
+                                prog_abort();
+                        }
+
+                    if (!_capture.empty())
+                        _capture->write(Capture::Direction::Out, _initSocketDescriptor,
+                                        _messageFormat, buff, segments);
+
+                    if (!meterCommands.isEmpty()
+                        && message->type() == Message::Type::Answer)
+                    {
+                        auto it = meterCommands.find(message->id());
+                        if (it != meterCommands.end())
+                        {
+                            qint64 latency = meterTimer.nsecsElapsed() / 1000 - it.value();
+                            _loadMeter->answerSent(latency);
+                            meterCommands.erase(it);
+                        }
+                    }
+
+                    // Сохраняем сериализованный ответ в кеше ответов и рассылаем
+                    // его запросам, ожидающим завершения идентичной команды
+                    if (!pendingAnswers.isEmpty()
+                        && message->type() == Message::Type::Answer)
+                    {
+                        auto it = pendingAnswers.find(message->id());
+                        if (it != pendingAnswers.end())
+                        {
+                            const PendingAnswer& pending = it.value();
+                            if (pending.cache && !_answerCache.empty()
+                                && message->execStatus() == Message::ExecStatus::Success)
                             {
-                                log_debug2_m << "Message json before sending: " << buff;
+                                _answerCache->insert(pending.key, buff);
                             }
-                            break;
-#endif
-                        default:
-                            log_error_m << "Unsupported message serialize format: "
-                                        << _messageFormat;
-                            prog_abort();
+                            if (pending.flight && !_singleFlight.empty())
+                            {
+                                SingleFlight::Waiters waiters = _singleFlight->complete(pending.key);
+                                if (!waiters.isEmpty()
+                                    && AnswerCache::checkFrame(buff, _messageFormat))
+                                {
+                                    for (const SingleFlight::Waiter& w : waiters)
+                                    {
+                                        QByteArray frame =
+                                            AnswerCache::setFrameId(buff, _messageFormat, w.answer->id());
+                                        w.socket->sendEncoded(w.answer, frame);
+                                    }
+                                }
+                            }
+                            pendingAnswers.erase(it);
+                        }
                     }
 
+#ifdef PPROTO_QBINARY_SERIALIZE
+                    bool deltaEncoded = false;
+                    if (deltaCodec
+                        && deltaCodec->active()
+                        && message->command() != command::DeltaFrame)
+                    {
+                        QByteArray deltaBuff = deltaCodec->encode(message, buff);
+                        if (!deltaBuff.isEmpty())
+                        {
+                            buff = deltaBuff;
+                            deltaEncoded = true;
+                        }
+                    }
+                    bool dedupEncoded = false;
+                    if (payloadDedup
+                        && payloadDedup->active()
+                        && !deltaEncoded
+                        && message->command() != command::PayloadDedup)
+                    {
+                        QByteArray dedupBuff = payloadDedup->encode(message, buff);
+                        if (!dedupBuff.isEmpty())
+                        {
+                            buff = dedupBuff;
+                            dedupEncoded = true;
+                        }
+                    }
+                    if (dictCodec
+                        && dictCodec->active()
+                        && !deltaEncoded
+                        && !dedupEncoded
+                        && !isLocal()
+                        && message->command() != command::DictFrame)
+                    {
+                        QByteArray dictBuff = dictCodec->encode(message, buff);
+                        if (!dictBuff.isEmpty())
+                            buff = dictBuff;
+                    }
+#endif
+
                     qint32 buffSize = buff.size();
                     quint8 isCompressed = false;
 
@@ -1013,8 +1583,12 @@ void Socket::run()
                         && buffSize > _compressionSize
                         && _compressionLevel != 0)
                     {
+                        PPROTO_PROBE_MESSAGE(compress_begin, message, buff.size(),
+                                             _initSocketDescriptor);
                         buff = qCompress(buff, _compressionLevel);
                         isCompressed = true;
+                        PPROTO_PROBE_MESSAGE(compress_end, message, buff.size(),
+                                             _initSocketDescriptor);
 
                         if (alog::logger().level() == alog::Level::Debug2)
                         {
@@ -1028,6 +1602,9 @@ void Socket::run()
 #ifdef SODIUM_ENCRYPTION
                     if (_encryption)
                     {
+                        PPROTO_PROBE_MESSAGE(encrypt_begin, message, buff.size(),
+                                             _initSocketDescriptor);
+
                         buffSize = buff.size()
                                  + sizeof(quint32) // Поле для хранения размера buff в QDataStream
                                  + sizeof(quint8); // Поле для хранения isCompressed в QDataStream
@@ -1095,6 +1672,9 @@ void Socket::run()
 
                         // Уточняем размер буфера
                         buffSize = buff.size();
+
+                        PPROTO_PROBE_MESSAGE(encrypt_end, message, buffSize,
+                                             _initSocketDescriptor);
                     }
                     else
 #endif // SODIUM_ENCRYPTION
@@ -1102,6 +1682,8 @@ void Socket::run()
                     {
                         // Уточняем размер буфера
                         buffSize = buff.size();
+                        for (const QByteArray& segment : segments)
+                            buffSize += segment.size();
 
                         // Передаем признак сжатия потока через знаковый бит
                         // параметра buffSize
@@ -1109,13 +1691,34 @@ void Socket::run()
                             buffSize *= -1;
                     }
 
+                    PPROTO_PROBE_MESSAGE(frame_write, message, qAbs(buffSize),
+                                         _initSocketDescriptor);
+
                     if ((QSysInfo::ByteOrder != QSysInfo::BigEndian))
                         buffSize = qbswap(buffSize);
 
-                    socketWrite((const char*)&buffSize, sizeof(qint32));
-                    CHECK_SOCKET_ERROR
+                    // Префикс размера, сообщение и сегменты контента передаются
+                    // в сокет одним вызовом
+                    // Буфер префикса принадлежит списку сегментов: при отправке
+                    // с нулевым копированием память кадра должна оставаться
+                    // неизменной до уведомления ядра о завершении отправки
+                    QByteArray sizePrefix {int(sizeof(qint32)), Qt::Uninitialized};
+                    memcpy(sizePrefix.data(), &buffSize, sizeof(qint32));
+
+                    segments.prepend(buff);
+                    segments.prepend(sizePrefix);
+                    if (_timestamping.active())
+                    {
+                        qint64 frameSize = 0;
+                        for (const QByteArray& segment : segments)
+                            frameSize += segment.size();
 
-                    socketWrite(buff.constData(), buff.size());
+                        const qint64 writeTime = Timestamping::now();
+                        socketWriteV(segments);
+                        _timestamping.frameSent(frameSize, writeTime);
+                    }
+                    else
+                        socketWriteV(segments);
                     CHECK_SOCKET_ERROR
 
                     while (socketBytesToWrite())
@@ -1143,112 +1746,187 @@ void Socket::run()
             }
 
             //--- Прием сообщений ---
+            if (_timestamping.active())
+            {
+                _timestamping.processErrorQueue();
+                _timestamping.peekReceive();
+            }
             socketWaitForReadyRead(0);
             CHECK_SOCKET_ERROR
             timer.start();
-            while (socketBytesAvailable() || readBuffSize)
+            while (socketBytesAvailable() || readBuffSize || !pipelineFrames.isEmpty())
             {
-                if (readBuffSize == 0)
+                // Кадры, переданные в пул потоков конвейера, извлекаются строго
+                // в порядке приема. Буфер чтения используется для извлеченного
+                // кадра, поэтому извлечение выполняется только между кадрами
+                bool pipelineFrame = false;
+                if (!pipelineFrames.isEmpty() && readBuffSize == 0)
                 {
-                    while (socketBytesAvailable() < qint64(sizeof(qint32)))
+                    bool idle = (socketBytesAvailable() == 0);
+                    if (pipelineFrames.first()->done()
+                        || (idle && pipelineFrames.first()->wait(5)))
+                    {
+                        FrameJob::Ptr job = pipelineFrames.takeFirst();
+                        if (job->failed)
+                        {
+                            loopBreak = true;
+                            break;
+                        }
+                        readBuff = job->frame;
+                        pipelineFrame = true;
+                    }
+                    else if (idle)
                     {
-                        socketWaitForReadyRead(1);
-                        CHECK_SOCKET_ERROR
                         if (timer.hasExpired(3 * delay))
                             break;
+                        continue;
                     }
-                    if (loopBreak
-                        || timer.hasExpired(3 * delay))
-                        break;
-
-                    socketRead((char*)&readBuffSize, sizeof(qint32));
-                    CHECK_SOCKET_ERROR
-
-                    if ((QSysInfo::ByteOrder != QSysInfo::BigEndian))
-                        readBuffSize = qbswap(readBuffSize);
-
-                    readBuff.resize(qAbs(readBuffSize));
-                    readBuffCur = (char*)readBuff.constData();
-                    readBuffEnd = readBuffCur + readBuff.size();
                 }
 
-                while (readBuffCur < readBuffEnd)
+                if (!pipelineFrame)
                 {
-                    qint64 bytesAvailable = socketBytesAvailable();
-                    if (bytesAvailable == 0)
+                    if (readBuffSize == 0)
                     {
-                        socketWaitForReadyRead(5);
+                        while (socketBytesAvailable() < qint64(sizeof(qint32)))
+                        {
+                            socketWaitForReadyRead(1);
+                            CHECK_SOCKET_ERROR
+                            if (timer.hasExpired(3 * delay))
+                                break;
+                        }
+                        if (loopBreak
+                            || timer.hasExpired(3 * delay))
+                            break;
+
+                        socketRead((char*)&readBuffSize, sizeof(qint32));
                         CHECK_SOCKET_ERROR
-                        bytesAvailable = socketBytesAvailable();
+
+                        if ((QSysInfo::ByteOrder != QSysInfo::BigEndian))
+                            readBuffSize = qbswap(readBuffSize);
+
+                        if (_maxFrameSize > 0 && qAbs(readBuffSize) > _maxFrameSize)
+                        {
+                            log_error_m << "Frame size " << qAbs(readBuffSize)
+                                        << " exceeds limit " << _maxFrameSize
+                                        << ". Connection will be closed";
+                            loopBreak = true;
+                            break;
+                        }
+                        readBuffCur = nullptr;
+                        readBuffEnd = nullptr;
                     }
-                    qint64 readBytes = qMin(bytesAvailable,
-                                            qint64(readBuffEnd - readBuffCur));
-                    if (readBytes != 0)
+
+                    // Буфер для кадра выделяется только после резервирования памяти,
+                    // до этого момента чтение данных из сокета приостанавливается
+                    if (readBuffCur == nullptr)
                     {
-                        if (socketRead(readBuffCur, readBytes) != readBytes)
+                        const qint64 frameSize = qAbs(readBuffSize);
+                        if (_connectionMemory > 0
+                            && acceptReserved > 0
+                            && acceptReserved + frameSize > _connectionMemory)
                         {
-                            log_error_m << "Socket error: failed read data from socket";
-                            loopBreak = true;
                             break;
                         }
-                        readBuffCur += readBytes;
+                        if (!_memoryBudget.empty())
+                        {
+                            if (frameSize > _memoryBudget->limit())
+                            {
+                                log_error_m << "Frame size " << frameSize
+                                            << " exceeds memory budget " << _memoryBudget->limit()
+                                            << ". Connection will be closed";
+                                loopBreak = true;
+                                break;
+                            }
+                            if (!_memoryBudget->acquire(frameSize))
+                            {
+                                // Ожидание освобождения памяти другими сокетами
+                                if (acceptMessages.empty())
+                                    QThread::msleep(1);
+                                break;
+                            }
+                        }
+                        frameReserved = frameSize;
+
+                        readBuff.resize(frameSize);
+                        readBuffCur = (char*)readBuff.constData();
+                        readBuffEnd = readBuffCur + readBuff.size();
                     }
-                    if (timer.hasExpired(3 * delay))
+
+                    while (readBuffCur < readBuffEnd)
+                    {
+                        qint64 bytesAvailable = socketBytesAvailable();
+                        if (bytesAvailable == 0)
+                        {
+                            socketWaitForReadyRead(5);
+                            CHECK_SOCKET_ERROR
+                            bytesAvailable = socketBytesAvailable();
+                        }
+                        qint64 readBytes = qMin(bytesAvailable,
+                                                qint64(readBuffEnd - readBuffCur));
+                        if (readBytes != 0)
+                        {
+                            if (socketRead(readBuffCur, readBytes) != readBytes)
+                            {
+                                log_error_m << "Socket error: failed read data from socket";
+                                loopBreak = true;
+                                break;
+                            }
+                            readBuffCur += readBytes;
+                        }
+                        if (timer.hasExpired(3 * delay))
+                            break;
+                    }
+                    if (loopBreak
+                        || timer.hasExpired(3 * delay))
                         break;
-                }
-                if (loopBreak
-                    || timer.hasExpired(3 * delay))
-                    break;
 
-#ifdef SODIUM_ENCRYPTION
-                if (_encryption)
-                {
-                    QByteArray mac;
-                    QByteArray nonce;
-                    QByteArray paddingBuff;
-
-                    { //Block for QDataStream
-                        QDataStream stream {&readBuff, QIODevice::ReadOnly | QIODevice::Unbuffered};
-                        STREAM_INIT(stream);
-                        mac = serialize::readByteArray(stream);
-                        nonce = serialize::readByteArray(stream);
-                        paddingBuff = serialize::readByteArray(stream);
+                    PPROTO_PROBE2(frame_read, readBuff.size(), _initSocketDescriptor);
+
+                    if (_timestamping.active())
+                        _timestamping.frameReceived();
+
+                    // Большие кадры обрабатываются в пуле потоков конвейера. Пока
+                    // в конвейере есть необработанные кадры, все последующие кадры
+                    // также помещаются в очередь конвейера для сохранения порядка
+                    if (!_pipeline.empty()
+                        && (readBuff.size() >= _pipelineSize || !pipelineFrames.isEmpty()))
+                    {
+                        FrameJob::Ptr job {new FrameJob(readBuff, (readBuffSize < 0), _encryption,
+                                                        frameKey, _maxUncompressedSize,
+                                                        _initSocketDescriptor)};
+                        if (readBuff.size() >= _pipelineSize)
+                            _pipeline->submit(Pipeline::Job::Ptr(job.get()));
+                        else
+                            job->run();
+
+                        pipelineFrames.append(job);
+                        readBuff.clear();
+                        readBuffSize = 0;
+                        acceptReserved += frameReserved;
+                        frameReserved = 0;
+                        continue;
                     }
 
-                    int res = crypto_box_open_detached_afternm((uchar*) paddingBuff.constData(), // message
-                                                               (uchar*) paddingBuff.constData(), // cript
-                                                               (uchar*) mac.constData(),         // mac
-                                                                        paddingBuff.size(),      // cript size
-                                                               (uchar*) nonce.constData(),       // nonce
-                                                               (uchar*) sharedSecretKey);
-                    if (res != 0)
+                    if (!decodeFrame(readBuff, (readBuffSize < 0), _encryption, frameKey,
+                                     _maxUncompressedSize, _initSocketDescriptor))
                     {
-                        log_error_m << "Failed message decryption";
                         loopBreak = true;
                         break;
                     }
 
-                    quint8 isCompressed;
-                    { //Block for QDataStream
-                        QDataStream stream {&paddingBuff, QIODevice::ReadOnly | QIODevice::Unbuffered};
-                        STREAM_INIT(stream);
-                        stream >> isCompressed;
-                        readBuff = serialize::readByteArray(stream);
-                    }
-                    if (isCompressed)
-                        readBuff = qUncompress(readBuff);
-                }
-                else
-#endif // SODIUM_ENCRYPTION
-                //--- Без шифрования ---
-                {
-                    if (readBuffSize < 0)
-                        readBuff = qUncompress(readBuff);
+                    // Обнуляем размер буфера для того, чтобы можно было начать
+                    // считывать новое сообщение
+                    readBuffSize = 0;
+
+                    // Резерв памяти кадра освобождается после передачи сообщений
+                    // в обработчики
+                    acceptReserved += frameReserved;
+                    frameReserved = 0;
                 }
 
-                // Обнуляем размер буфера для того, чтобы можно было начать
-                // считывать новое сообщение
-                readBuffSize = 0;
+                if (!_capture.empty() && !readBuff.isEmpty())
+                    _capture->write(Capture::Direction::In, _initSocketDescriptor,
+                                    _messageFormat, readBuff);
 
                 if (!readBuff.isEmpty())
                 {
@@ -1307,6 +1985,54 @@ void Socket::run()
                         processingEchoConnectionCommand(message);
                         break;
                     }
+                    else if (message->command() == command::PayloadDedup)
+                    {
+#ifdef PPROTO_QBINARY_SERIALIZE
+                        if (payloadDedup && _messageFormat == SerializeFormat::QBinary)
+                        {
+                            QList<QByteArray> frames;
+                            payloadDedup->process(message, frames, internalMessages);
+                            for (const QByteArray& frame : frames)
+                            {
+                                Message::Ptr m = Message::fromQBinary(frame);
+                                messageInit(m);
+                                acceptMessages.add(m.detach());
+                            }
+                        }
+#endif
+                    }
+                    else if (message->command() == command::DeltaFrame)
+                    {
+#ifdef PPROTO_QBINARY_SERIALIZE
+                        if (deltaCodec && _messageFormat == SerializeFormat::QBinary)
+                        {
+                            QList<QByteArray> frames;
+                            deltaCodec->process(message, frames, internalMessages);
+                            for (const QByteArray& frame : frames)
+                            {
+                                Message::Ptr m = Message::fromQBinary(frame);
+                                messageInit(m);
+                                acceptMessages.add(m.detach());
+                            }
+                        }
+#endif
+                    }
+                    else if (message->command() == command::DictFrame)
+                    {
+#ifdef PPROTO_QBINARY_SERIALIZE
+                        if (dictCodec && _messageFormat == SerializeFormat::QBinary)
+                        {
+                            QList<QByteArray> frames;
+                            dictCodec->process(message, frames, internalMessages);
+                            for (const QByteArray& frame : frames)
+                            {
+                                Message::Ptr m = Message::fromQBinary(frame);
+                                messageInit(m);
+                                acceptMessages.add(m.detach());
+                            }
+                        }
+#endif
+                    }
                     else
                     {
                         if (_protocolCompatible == ProtocolCompatible::Yes)
@@ -1348,7 +2074,7 @@ void Socket::run()
                 while (!acceptMessages.empty())
                 {
                     Message::Ptr m;
-                    m.attach(acceptMessages.release(0));
+                    m.attach(acceptMessages.release());
 
                     if (_checkUnknownCommands)
                     {
@@ -1402,11 +2128,86 @@ void Socket::run()
                         }
                     }
 
+                    // Поиск ответа в кеше ответов и объединение идентичных команд
+                    if ((!_answerCache.empty() || !_singleFlight.empty())
+                        && m->type() == Message::Type::Command)
+                    {
+                        PendingAnswer pending;
+                        pending.cache = !_answerCache.empty()
+                                        && command::pool().cacheTtl(m->command());
+                        pending.flight = !_singleFlight.empty()
+                                         && command::pool().singleFlight(m->command());
+
+                        if ((pending.cache || pending.flight)
+                            && AnswerCache::makeKey(m, _messageFormat, _messageWebFlags, pending.key))
+                        {
+                            if (pending.cache)
+                            {
+                                QByteArray frame = _answerCache->find(pending.key, m->id());
+                                if (!frame.isEmpty())
+                                {
+                                    if (alog::logger().level() == alog::Level::Debug2)
+                                    {
+                                        log_debug2_m << "Answer found in cache"
+                                                     << ". Id: " << m->id()
+                                                     << ". Command: " << CommandNameLog(m->command());
+                                    }
+                                    sendEncoded(m->cloneForAnswer(), frame);
+                                    continue;
+                                }
+                            }
+                            if (pending.flight
+                                && _singleFlight->join(pending.key, this, m))
+                            {
+                                if (alog::logger().level() == alog::Level::Debug2)
+                                {
+                                    log_debug2_m << "Command joined to identical command in progress"
+                                                 << ". Id: " << m->id()
+                                                 << ". Command: " << CommandNameLog(m->command());
+                                }
+                                continue;
+                            }
+                            // Ограничиваем количество ожидающих ответов на случай,
+                            // если обработчик команды не отправляет ответ
+                            if (pendingAnswers.count() > 1000)
+                            {
+                                abortFlights();
+                                pendingAnswers.clear();
+                            }
+
+                            pendingAnswers.insert(m->id(), pending);
+                        }
+                    }
+
+                    if (!_loadMeter.empty()
+                        && m->type() == Message::Type::Command
+                        && !meterCommands.contains(m->id()))
+                    {
+                        // Ограничиваем количество учитываемых команд на случай,
+                        // если обработчик команды не отправляет ответ
+                        if (meterCommands.count() > 10000)
+                        {
+                            _loadMeter->discard(meterCommands.count());
+                            meterCommands.clear();
+                        }
+                        meterCommands.insert(m->id(), meterTimer.nsecsElapsed() / 1000);
+                        _loadMeter->commandReceived();
+                    }
+
                     emitMessage(m);
                     if (timer.hasExpired(3 * delay))
                         break;
                 }
             }
+
+            if (acceptReserved
+                && acceptMessages.empty()
+                && pipelineFrames.isEmpty())
+            {
+                if (!_memoryBudget.empty())
+                    _memoryBudget->release(acceptReserved);
+                acceptReserved = 0;
+            }
         } // while (true)
     }
     catch (std::exception& e)
@@ -1418,10 +2219,29 @@ void Socket::run()
         log_error_m << "Unknown error";
     }
 
-    { //Block for QMutexLocker
-        QMutexLocker locker {&_socketLock}; (void) locker;
-        socketClose();
+    // Ответы на оставшиеся команды не будут отправлены
+    if (!meterCommands.isEmpty())
+        _loadMeter->discard(meterCommands.count());
+
+    abortFlights();
+    pendingAnswers.clear();
+
+    // Задания конвейера используют ключ шифрования, поэтому должны быть
+    // завершены до его освобождения
+    for (const FrameJob::Ptr& job : pipelineFrames)
+        job->wait();
+
+    if (!_memoryBudget.empty())
+        _memoryBudget->release(frameReserved + acceptReserved);
+
+    { //Block for SpinLocker
+        SpinLocker locker {_memoryUsageLock}; (void) locker;
+        _memoryUsage = MemoryUsage();
     }
+    _connectionContext = ConnectionContext::Ptr();
+
+    socketClose();
+    publishSocketState();
     _initSocketDescriptor = -1;
 
 #ifdef SODIUM_ENCRYPTION
@@ -1434,6 +2254,111 @@ void Socket::run()
 
 #pragma GCC diagnostic pop
 
+void Socket::busyPollInit()
+{
+#if defined(Q_OS_LINUX)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(_busyPollCpu, &cpuSet);
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    if (res != 0)
+        log_warn_m << "Failed bind socket thread to CPU " << _busyPollCpu
+                   << ": " << strerror(res);
+
+    // Время (в микросекундах) активного опроса сетевого устройства при
+    // чтении из сокета. Для значений выше значения net.core.busy_read
+    // требуются привилегии CAP_NET_ADMIN
+    int busyPollUsec = 50;
+    SocketDescriptor descr = socketDescriptorInternal();
+    if (descr != SocketDescriptor(-1)
+        && setsockopt(int(descr), SOL_SOCKET, SO_BUSY_POLL,
+                      &busyPollUsec, sizeof(busyPollUsec)) != 0)
+    {
+        log_debug_m << "Failed set SO_BUSY_POLL option: " << strerror(errno);
+    }
+    log_verbose_m << "Busy-poll mode is active. CPU: " << _busyPollCpu;
+#else
+    log_warn_m << "Busy-poll mode is supported only for Linux"
+               << ". Socket will not be bound to CPU " << _busyPollCpu;
+#endif
+}
+
+void Socket::socketWriteV(const QVector<QByteArray>& buffers)
+{
+    int index = 0;
+    qint64 offset = 0;
+
+#if defined(Q_OS_LINUX)
+    SocketDescriptor descr = socketDescriptorInternal();
+    if (descr != SocketDescriptor(-1) && socketBytesToWrite() == 0)
+    {
+        QVarLengthArray<iovec, 32> iov;
+        for (const QByteArray& buff : buffers)
+        {
+            if (iov.count() >= IOV_MAX)
+                break;
+            iov.append({(void*)buff.constData(), size_t(buff.size())});
+        }
+
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov.data();
+        msg.msg_iovlen = size_t(iov.count());
+
+        qint64 res = -1;
+#ifdef IO_URING_TRANSPORT
+        qint64 size = 0;
+        for (const iovec& v : iov)
+            size += qint64(v.iov_len);
+
+        if (_zeroCopySize > 0 && size >= _zeroCopySize)
+        {
+            if (!_ioUring)
+                _ioUring.reset(new IoUring);
+            res = _ioUring->sendmsg(int(descr), &msg, buffers);
+        }
+#endif
+        // При ошибке (в том числе EAGAIN) все данные будут переданы через
+        // буфер записи сокета, ошибка соединения будет обработана штатно
+        if (res < 0)
+            res = ::sendmsg(int(descr), &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        for (qint64 sent = (res > 0) ? res : 0; index < buffers.count(); ++index)
+        {
+            if (sent < buffers[index].size())
+            {
+                offset = sent;
+                break;
+            }
+            sent -= buffers[index].size();
+        }
+    }
+#endif
+
+    for (; index < buffers.count(); ++index)
+    {
+        const QByteArray& buff = buffers[index];
+        socketWrite(buff.constData() + offset, buff.size() - offset);
+        offset = 0;
+    }
+}
+
+void Socket::publishSocketState()
+{
+    _socketDescriptor = socketDescriptorInternal();
+    _socketLocal = isLocalInternal();
+    _socketConnected = socketIsConnectedInternal();
+}
+
+void Socket::messageInit(Message::Ptr& message)
+{
+    if (_connectionContext.empty())
+        _connectionContext = createConnectionContext();
+
+    message->setConnection(_connectionContext);
+    trace::receive(message.get());
+}
+
 void Socket::emitMessage(const pproto::Message::Ptr& m)
 {
     try
@@ -1442,6 +2367,8 @@ void Socket::emitMessage(const pproto::Message::Ptr& m)
             log_debug2_m << "Message emit"
                          << ". Id: " << m->id()
                          << ". Command: " << CommandNameLog(m->command());
+
+        PPROTO_PROBE_MESSAGE(emit_message, m, m->type(), m->socketDescriptor());
         emit message(m);
     }
     catch (std::exception& e)
@@ -1498,9 +2425,20 @@ int Listener::socketsCount() const
     return count;
 }
 
+Socket::MemoryUsage Listener::memoryUsage() const
+{
+    Socket::MemoryUsage memoryUsage;
+    Socket::List sockets = this->sockets();
+    for (Socket* s : sockets)
+        memoryUsage += s->memoryUsage();
+
+    return memoryUsage;
+}
+
 void Listener::send(const Message::Ptr& message,
                     const SocketDescriptorSet& excludeSockets) const
 {
+    addEventHistory(message);
     Socket::List sockets = this->sockets();
     pproto::transport::send(sockets, message, excludeSockets);
 }
@@ -1508,12 +2446,23 @@ void Listener::send(const Message::Ptr& message,
 void Listener::send(const Message::Ptr& message,
                     SocketDescriptor excludeSocket) const
 {
+    addEventHistory(message);
     Socket::List sockets = this->sockets();
     SocketDescriptorSet excludeSockets;
     excludeSockets << excludeSocket;
     pproto::transport::send(sockets, message, excludeSockets);
 }
 
+void Listener::addEventHistory(const Message::Ptr& message) const
+{
+    if (!_eventHistory.empty()
+        && message->type() == Message::Type::Event
+        && pproto::command::pool().eventHistory(message->command()))
+    {
+        _eventHistory->add(message);
+    }
+}
+
 Socket::Ptr Listener::socketByDescriptor(SocketDescriptor descr) const
 {
     QMutexLocker locker {&_socketsLock}; (void) locker;
@@ -1599,8 +2548,49 @@ void Listener::incomingConnectionInternal(Socket::Ptr socket, //NOLINT
     socket->setOnlyEncrypted(_onlyEncrypted);
     socket->setMessageWebFlags(_messageWebFlags);
     socket->setName(_name);
+    socket->setAnswerCache(_answerCache);
+    socket->setSingleFlight(_singleFlight);
+    socket->setPayloadDedupSize(_payloadDedupSize);
+    socket->setPayloadDedupCache(_payloadDedupCache);
+    socket->setDeltaKeyframe(_deltaKeyframe);
+    socket->setDictStore(_dictStore);
+    socket->setZeroCopySize(_zeroCopySize);
+    socket->setLoadMeter(_loadMeter);
+    socket->setTimestampingMode(_timestampingMode);
+    socket->setCapture(_capture);
+    socket->setMaxFrameSize(_maxFrameSize);
+    socket->setMaxUncompressedSize(_maxUncompressedSize);
+    socket->setConnectionMemory(_connectionMemory);
+    socket->setMemoryBudget(_memoryBudget);
+    socket->setPipeline(_pipeline);
+    socket->setPipelineSize(_pipelineSize);
     socket->setCheckUnknownCommands(_checkUnknownCommands);
 
+    // Ядро для режима busy-poll занимает только одно соединение листенера,
+    // остальные соединения работают в обычном режиме
+    if (_busyPollCpu >= 0)
+    {
+        bool busyPollOwned = false;
+        { //Block for QMutexLocker
+            QMutexLocker locker {&_socketsLock}; (void) locker;
+            for (Socket* s : _sockets)
+                if (s->busyPollCpu() >= 0 && s->isRunning())
+                {
+                    busyPollOwned = true;
+                    break;
+                }
+        }
+        if (!busyPollOwned)
+        {
+            socket->setBusyPollCpu(_busyPollCpu);
+            socket->setBusyPollSpin(_busyPollSpin);
+        }
+        else
+            log_warn_m << "CPU " << _busyPollCpu << " already used in busy-poll mode"
+                       << " by another connection. Socket descriptor: " << socketDescriptor
+                       << ". Connection will work in regular mode";
+    }
+
     connectSignals(socket.get());
 
     // Примечание: выход из функции start() происходит только тогда, когда
@@ -1634,6 +2624,10 @@ void send(const base::Socket::List& sockets,
         return;
     }
 
+    // Время отправки устанавливается до рассылки сообщения по сокетам,
+    // после чего сообщение не изменяется
+    trace::send(message.get());
+
     if (message->type() == Message::Type::Event)
     {
         for (base::Socket* s : sockets)
@@ -31,6 +31,18 @@
 
 #include "commands/base.h"
 #include "serialize/functions.h"
+#include "transport/answer_cache.h"
+#include "transport/single_flight.h"
+#include "transport/payload_dedup.h"
+#include "transport/delta_codec.h"
+#include "transport/dict_codec.h"
+#include "transport/io_uring.h"
+#include "transport/load_meter.h"
+#include "transport/timestamping.h"
+#include "transport/capture.h"
+#include "transport/memory_budget.h"
+#include "transport/pipeline.h"
+#include "transport/event_history.h"
 
 #include "shared/list.h"
 #include "shared/defmac.h"
@@ -40,6 +52,7 @@
 
 #include <QtCore>
 #include <atomic>
+#include <memory>
 
 namespace pproto::transport {
 
@@ -96,6 +109,150 @@ public:
     QString name() const {return _name;}
     void setName(const QString& val) {_name = val;}
 
+    // Кеш ответов для кешируемых команд (см. command::Pool::setCacheTtl()).
+    // Один экземпляр кеша может использоваться несколькими сокетами. Параметр
+    // должен быть задан до установки соединения.
+    // Значение параметра по умолчанию равно NULL (кеширование не выполняется)
+    AnswerCache::Ptr answerCache() const {return _answerCache;}
+    void setAnswerCache(const AnswerCache::Ptr& val) {_answerCache = val;}
+
+    // Механизм объединения идентичных одновременно выполняемых команд
+    // (см. command::Pool::setSingleFlight()). Один экземпляр должен исполь-
+    // зоваться всеми сокетами листенера. Параметр должен быть задан до уста-
+    // новки соединения.
+    // Значение параметра по умолчанию равно NULL (объединение не выполняется)
+    SingleFlight::Ptr singleFlight() const {return _singleFlight;}
+    void setSingleFlight(const SingleFlight::Ptr& val) {_singleFlight = val;}
+
+    // Определяет минимальный размер контента (в байтах) для  дедупликации
+    // (см. transport/payload_dedup.h). Дедупликация выполняется только для
+    // бинарного формата сериализации и только если она  включена  на обеих
+    // сторонах соединения.
+    // Значение параметра по умолчанию равно 0 (дедупликация не выполняется)
+    int payloadDedupSize() const {return _payloadDedupSize;}
+    void setPayloadDedupSize(int val) {_payloadDedupSize = val;}
+
+    // Размер кеша (в байтах) для принятого контента при дедупликации.
+    // Значение параметра по умолчанию равно 32 Мб
+    qint64 payloadDedupCache() const {return _payloadDedupCache;}
+    void setPayloadDedupCache(qint64 val) {_payloadDedupCache = val;}
+
+    // Определяет периодичность (в сообщениях) отправки опорных кадров при
+    // дельта-кодировании (см. transport/delta_codec.h). Дельта-кодирование
+    // выполняется только для бинарного формата сериализации и только если
+    // оно включено на обеих сторонах соединения.
+    // Значение параметра по умолчанию равно 0 (дельта-кодирование не выпол-
+    // няется)
+    int deltaKeyframe() const {return _deltaKeyframe;}
+    void setDeltaKeyframe(int val) {_deltaKeyframe = val;}
+
+    // Хранилище словарей для сжатия сообщений, размер которых не превышает
+    // compressionSize() (см. transport/dict_codec.h). Сжатие со словарями
+    // выполняется только для бинарного формата сериализации, только если
+    // оно включено на обеих сторонах соединения, и только при сборке с па-
+    // раметром ZSTD_DICTIONARY. Один экземпляр может использоваться несколь-
+    // кими сокетами. Параметр должен быть задан до установки соединения.
+    // Значение параметра по умолчанию равно NULL (сжатие со словарями
+    // не выполняется)
+    DictStore::Ptr dictStore() const {return _dictStore;}
+    void setDictStore(const DictStore::Ptr& val) {_dictStore = val;}
+
+    // Минимальный размер сообщения (в байтах), начиная с которого сообщение
+    // отправляется с нулевым копированием посредством io_uring (см. transport/
+    // io_uring.h). Параметр используется только при сборке с  параметром
+    // IO_URING_TRANSPORT. Значение 0 запрещает использование io_uring.
+    // Значение параметра по умолчанию равно 64 Кб
+    int zeroCopySize() const {return _zeroCopySize;}
+    void setZeroCopySize(int val) {_zeroCopySize = val;}
+
+    // Номер процессорного ядра для режима активного опроса (busy-poll). В этом
+    // режиме поток сокета привязывается к указанному ядру и никогда не засы-
+    // пает: очередь сообщений и сокет опрашиваются непрерывно, для сокета
+    // устанавливается опция SO_BUSY_POLL. Режим  предназначен  для  задач,
+    // требующих минимальной задержки, и полностью занимает одно ядро.
+    // Для листенера в режиме busy-poll работает только одно соединение
+    // (первое из установленных на данный момент), остальные соединения
+    // работают в обычном режиме. Режим поддерживается только для Linux.
+    // Значение параметра по умолчанию равно -1 (режим не используется)
+    int busyPollCpu() const {return _busyPollCpu;}
+    void setBusyPollCpu(int val) {_busyPollCpu = val;}
+
+    // Количество итераций ожидания (инструкция pause) между циклами опроса
+    // в режиме busy-poll, после которых поток уступает ядро (sched_yield).
+    // Значение 0 означает непрерывный опрос без пауз.
+    // Значение параметра по умолчанию равно 0
+    int busyPollSpin() const {return _busyPollSpin;}
+    void setBusyPollSpin(int val) {_busyPollSpin = val;}
+
+    // Измеритель загруженности обработчиков команд (см. transport/load_meter.h).
+    // Если параметр задан, то сведения о загруженности передаются клиенту
+    // в ответе на команду EchoConnection. Один экземпляр должен использоваться
+    // всеми сокетами листенера. Параметр должен быть задан до установки соеди-
+    // нения.
+    // Значение параметра по умолчанию равно NULL (загруженность не измеряется)
+    LoadMeter::Ptr loadMeter() const {return _loadMeter;}
+    void setLoadMeter(const LoadMeter::Ptr& val) {_loadMeter = val;}
+
+    // Режим использования меток времени ядра (SO_TIMESTAMPING) для измерения
+    // времени нахождения данных в очередях ядра и сетевой задержки (см.
+    // transport/timestamping.h). Параметр используется только для TCP-сокетов
+    // и поддерживается только для Linux. Параметр должен быть задан до уста-
+    // новки соединения.
+    // Значение параметра по умолчанию равно Timestamping::Mode::None
+    Timestamping::Mode timestampingMode() const {return _timestampingMode;}
+    void setTimestampingMode(Timestamping::Mode val) {_timestampingMode = val;}
+
+    // Запись трафика в файл (см. transport/capture.h).  Один экземпляр может
+    // использоваться несколькими сокетами. Параметр должен быть задан до уста-
+    // новки соединения.
+    // Значение параметра по умолчанию равно NULL (запись не выполняется)
+    Capture::Ptr capture() const {return _capture;}
+    void setCapture(const Capture::Ptr& val) {_capture = val;}
+
+    // Максимальный размер (в байтах) принимаемого кадра. Размер кадра прове-
+    // ряется до выделения памяти под него. При превышении размера соединение
+    // будет закрыто.
+    // Значение параметра по умолчанию равно 0 (размер не ограничивается)
+    qint32 maxFrameSize() const {return _maxFrameSize;}
+    void setMaxFrameSize(qint32 val) {_maxFrameSize = val;}
+
+    // Максимальный размер (в байтах) принятого кадра после декомпрессии.
+    // Размер проверяется по заголовку сжатых данных до выполнения декомпрес-
+    // сии. При превышении размера соединение будет закрыто.
+    // Значение параметра по умолчанию равно 0 (размер не ограничивается)
+    qint32 maxUncompressedSize() const {return _maxUncompressedSize;}
+    void setMaxUncompressedSize(qint32 val) {_maxUncompressedSize = val;}
+
+    // Бюджет памяти (в байтах) соединения для принятых кадров, сообщения
+    // которых еще не переданы в обработчики. При исчерпании бюджета чтение
+    // данных из сокета приостанавливается.
+    // Значение параметра по умолчанию равно 0 (бюджет не ограничивается)
+    qint64 connectionMemory() const {return _connectionMemory;}
+    void setConnectionMemory(qint64 val) {_connectionMemory = val;}
+
+    // Общий бюджет памяти для принятых кадров (см. transport/memory_budget.h).
+    // Один экземпляр должен использоваться всеми сокетами листенера. Параметр
+    // должен быть задан до установки соединения.
+    // Значение параметра по умолчанию равно NULL (бюджет не ограничивается)
+    MemoryBudget::Ptr memoryBudget() const {return _memoryBudget;}
+    void setMemoryBudget(const MemoryBudget::Ptr& val) {_memoryBudget = val;}
+
+    // Пул потоков для расшифровки и декомпрессии принятых кадров (см. trans-
+    // port/pipeline.h). Поток сокета в этом режиме только выделяет кадры из
+    // потока данных, порядок сообщений соединения сохраняется. Один экземпляр
+    // может использоваться несколькими сокетами. Параметр должен быть задан
+    // до установки соединения.
+    // Значение параметра по умолчанию равно NULL (кадры обрабатываются в по-
+    // токе сокета)
+    Pipeline::Ptr pipeline() const {return _pipeline;}
+    void setPipeline(const Pipeline::Ptr& val) {_pipeline = val;}
+
+    // Минимальный размер кадра (в байтах), для которого обработка выполняется
+    // в пуле потоков конвейера.
+    // Значение параметра по умолчанию равно 64 Кб
+    int pipelineSize() const {return _pipelineSize;}
+    void setPipelineSize(int val) {_pipelineSize = val;}
+
 protected:
     // Для публичного вызова метод доступен в листенере
     void setOnlyEncrypted(bool val) {_onlyEncrypted = val;}
@@ -107,6 +264,24 @@ protected:
     bool _onlyEncrypted = {false};
     bool _messageWebFlags = {false};
     QString _name;
+    AnswerCache::Ptr _answerCache;
+    SingleFlight::Ptr _singleFlight;
+    int _payloadDedupSize = {0};
+    qint64 _payloadDedupCache = {32*1024*1024};
+    int _deltaKeyframe = {0};
+    DictStore::Ptr _dictStore;
+    int _zeroCopySize = {64*1024};
+    int _busyPollCpu = {-1};
+    int _busyPollSpin = {0};
+    LoadMeter::Ptr _loadMeter;
+    Timestamping::Mode _timestampingMode = {Timestamping::Mode::None};
+    Capture::Ptr _capture;
+    qint32 _maxFrameSize = {0};
+    qint32 _maxUncompressedSize = {0};
+    qint64 _connectionMemory = {0};
+    MemoryBudget::Ptr _memoryBudget;
+    Pipeline::Ptr _pipeline;
+    int _pipelineSize = {64*1024};
 };
 
 /**
@@ -126,11 +301,24 @@ public:
     // для оценки загруженности очереди
     int messagesCount() const;
 
+    // Возвращает приблизительный объем памяти (в байтах), занимаемый сообще-
+    // ниями в очереди на отправку
+    qint64 messagesMemory() const;
+
     // Определяет нужно ли проверять, что входящая команда является неизвестной
     bool checkUnknownCommands() const {return _checkUnknownCommands;}
     void setCheckUnknownCommands(bool val) {_checkUnknownCommands = val;}
 
 protected:
+    // Добавляет в очередь на отправку уже сериализованное сообщение
+    void sendEncoded(const Message::Ptr&, const QByteArray& frame);
+
+protected:
+    // Сериализованные сообщения (ответы из кеша ответов, ответы на объеди-
+    // ненные команды и события из истории событий), отправляются в первую
+    // очередь
+    QList<QPair<Message::Ptr, QByteArray>> _messagesEncoded;
+
     Message::List _messagesHigh;
     Message::List _messagesNorm;
     Message::List _messagesLow;
@@ -145,6 +333,8 @@ protected:
     QSet<QUuidEx> _unknownCommands;
     mutable std::atomic_flag _unknownCommandsLock = ATOMIC_FLAG_INIT;
     bool _checkUnknownCommands = {true};
+
+    friend class pproto::transport::EventHistory;
 };
 
 /**
@@ -164,6 +354,35 @@ public:
     // Статус совместимости версий бинарного протокола
     enum class ProtocolCompatible {Unknown, Yes, No};
 
+    // Приблизительный объем памяти (в байтах), занимаемый сокетом
+    struct MemoryUsage
+    {
+        // Сообщения в очереди на отправку
+        qint64 sendQueue = {0};
+
+        // Данные в буфере записи сокета, еще не переданные в систему
+        qint64 writeBuffer = {0};
+
+        // Буфер чтения сообщения
+        qint64 readBuffer = {0};
+
+        // Учет команд, ответы на которые еще не отправлены (кеш ответов,
+        // объединение команд, измеритель загруженности)
+        qint64 pendingAnswers = {0};
+
+        // Кеш дедупликации контента и его зеркало
+        qint64 payloadDedup = {0};
+
+        // Базовые кадры дельта-кодирования
+        qint64 deltaCodec = {0};
+
+        // Словари, принятые от противоположной стороны
+        qint64 dictCodec = {0};
+
+        qint64 total() const;
+        MemoryUsage& operator+= (const MemoryUsage&);
+    };
+
     // Возвращает TRUE после выполнения двух условий:
     // 1) Установлено соединение с TCP/Local сокетом;
     // 2) Проверка совместимости версий протокола выполнена успешно
@@ -200,7 +419,7 @@ public:
     // лизации задается автоматически в зависимости от формата подключившегося
     // клиентского сокета. Формат сериализации должен быть задан до момента
     // установки TCP/Local соединения
-    SerializeFormat messageFormat() const {return _messageFormat;}
+    SerializeFormat messageFormat() const {return _socketMessageFormat;}
     void setMessageFormat(SerializeFormat);
 
     // Определяет  будет  ли  сообщение  зашифровано  перед отправкой в сокет.
@@ -220,6 +439,21 @@ public:
     int echoTimeout() const;
     void setEchoTimeout(int);
 
+    // Возвращает последние сведения о загруженности удаленной стороны, получен-
+    // ные в ответе на команду EchoConnection. Сведения передаются только если
+    // для удаленного листенера задан измеритель загруженности (см. Properties::
+    // loadMeter()) и только при значении echoTimeout() больше 0
+    data::LoadReport remoteLoad() const;
+
+    // Статистика, полученная с использованием меток времени ядра (см. Proper-
+    // ties::timestampingMode())
+    Timestamping::Stats timestampingStats() const;
+
+    // Возвращает сведения об объеме памяти, занимаемой сокетом. Размер очереди
+    // на отправку вычисляется в момент вызова,  остальные  значения  обновля-
+    // ются потоком сокета не чаще одного раза в 200 мс
+    MemoryUsage memoryUsage() const;
+
 signals:
     // Сигнал эмитируется при получении сообщения
     void message(const pproto::Message::Ptr&);
@@ -255,11 +489,28 @@ protected:
     virtual qint64 socketBytesToWrite() const = 0;
     virtual qint64 socketRead(char* data, qint64 maxlen) = 0;
     virtual qint64 socketWrite(const char* data, qint64 len) = 0;
+
+    // Записывает в сокет последовательность буферов. Для Linux, при пустом
+    // буфере записи сокета, данные передаются системным вызовом sendmsg()
+    // (scatter-gather) без объединения буферов, оставшиеся данные дописываются
+    // функцией socketWrite(). Буферы должны владеть своей памятью, так как
+    // при отправке с нулевым копированием они удерживаются до уведомления
+    // ядра (см. transport/io_uring.h)
+    virtual void socketWriteV(const QVector<QByteArray>& buffers);
+
+    // Выполняет привязку потока сокета к ядру и установку опции SO_BUSY_POLL
+    // для режима busy-poll (см. Properties::busyPollCpu())
+    void busyPollInit();
     virtual bool   socketWaitForReadyRead(int msecs) = 0;
     virtual bool   socketWaitForBytesWritten(int msecs) = 0;
     virtual void   socketClose() = 0;
 
-    virtual void messageInit(Message::Ptr&) = 0;
+    // Связывает принятое сообщение со сведениями о соединении. Сведения
+    // создаются функцией createConnectionContext() один раз за время
+    // существования соединения
+    void messageInit(Message::Ptr&);
+    virtual ConnectionContext::Ptr createConnectionContext() = 0;
+
     virtual void fillUnknownMessage(const Message::Ptr&, data::Unknown&) = 0;
 
     // Признак того, что сокет был создан  на стороне listener-а, используется
@@ -281,6 +532,11 @@ private:
     Q_OBJECT
     DISABLE_DEFAULT_FUNC(Socket)
 
+    // Публикует состояние сокета (дескриптор, признаки соединения и локаль-
+    // ности) для чтения из других потоков без блокировок. Вызывается в потоке
+    // сокета при изменении состояния соединения
+    void publishSocketState();
+
     const SocketType _type;
     volatile ProtocolCompatible _protocolCompatible = {ProtocolCompatible::Unknown};
 
@@ -303,11 +559,32 @@ private:
     bool _encryption = {false};
     int  _echoTimeout = {0};
 
+    Timestamping _timestamping;
+
+    // Используется только в потоке сокета
+    ConnectionContext::Ptr _connectionContext;
+
+    data::LoadReport _remoteLoad;
+    mutable std::atomic_flag _remoteLoadLock = ATOMIC_FLAG_INIT;
+
+    MemoryUsage _memoryUsage;
+    mutable std::atomic_flag _memoryUsageLock = ATOMIC_FLAG_INIT;
+
     bool _isListenerSide = {false};
     volatile bool _isInsideListener = {false};
 
     SocketDescriptor _initSocketDescriptor = {-1};
-    mutable QMutex _socketLock;
+
+    // Состояние сокета, опубликованное потоком сокета (см. publishSocketState())
+    std::atomic<SocketDescriptor> _socketDescriptor = {-1};
+    std::atomic_bool _socketConnected = {false};
+    std::atomic_bool _socketLocal = {false};
+    std::atomic<SerializeFormat> _socketMessageFormat = {SerializeFormat::QBinary};
+
+#ifdef IO_URING_TRANSPORT
+    // Создается в потоке сокета при первой отправке большого сообщения
+    std::unique_ptr<IoUring> _ioUring;
+#endif
 
     friend class Listener;
     friend class local::Socket;
@@ -333,6 +610,9 @@ public:
     // Возвращает количество подключенных сокетов
     int socketsCount() const;
 
+    // Возвращает суммарный объем памяти, занимаемой подключенными сокетами
+    Socket::MemoryUsage memoryUsage() const;
+
     // Функция отправки сообщений.
     // Параметр excludeSockets используется когда отправляемое сообщение имеет
     // тип Event. На сокеты содержащиеся в excludeSockets сообщение отправлено
@@ -355,6 +635,13 @@ public:
     bool checkUnknownCommands() const {return _checkUnknownCommands;}
     void setCheckUnknownCommands(bool val) {_checkUnknownCommands = val;}
 
+    // История отправленных событий (см. transport/event_history.h). В исто-
+    // рию сохраняются события, отправляемые функциями send() листенера.
+    // Один экземпляр может использоваться несколькими листенерами.
+    // Значение параметра по умолчанию равно NULL (история не сохраняется)
+    EventHistory::Ptr eventHistory() const {return _eventHistory;}
+    void setEventHistory(const EventHistory::Ptr& val) {_eventHistory = val;}
+
     // Определяет требование  для  клиента  использовать  только  зашифрованное
     // подключение. Если клиент попытается подключится к листенеру  без  исполь-
     // зования шифрования, соединение будет закрыто.
@@ -367,6 +654,9 @@ protected:
     void removeClosedSocketsInternal();
     void incomingConnectionInternal(Socket::Ptr, SocketDescriptor);
 
+    // Сохраняет событие в истории событий
+    void addEventHistory(const Message::Ptr&) const;
+
     virtual void connectSignals(Socket*) = 0;
     virtual void disconnectSignals(Socket*) = 0;
 
@@ -379,6 +669,7 @@ private:
     Socket::List _sockets;
     mutable QMutex _socketsLock;
     bool _checkUnknownCommands = {true};
+    EventHistory::Ptr _eventHistory;
 };
 
 } // namespace base
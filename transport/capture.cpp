@@ -0,0 +1,186 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/capture.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <cstring>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Capture")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Capture")
+#define log_info_m    alog::logger().info    (alog_line_location, "Capture")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Capture")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Capture")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Capture")
+
+namespace pproto::transport {
+
+Capture::~Capture()
+{
+    close();
+}
+
+bool Capture::open(const QString& filePath, qint64 maxSize)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (_active)
+    {
+        log_error_m << "Capture already started. File: " << _file.fileName();
+        return false;
+    }
+    if (maxSize < qint64(sizeof(FileHeader)))
+    {
+        log_error_m << "Too small size of capture file: " << maxSize;
+        return false;
+    }
+
+    _file.setFileName(filePath);
+    if (!_file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    {
+        log_error_m << "Failed open capture file " << filePath
+                    << ". Detail: " << _file.errorString();
+        return false;
+    }
+    if (!_file.resize(maxSize)
+        || (_data = _file.map(0, maxSize)) == nullptr)
+    {
+        log_error_m << "Failed map capture file " << filePath
+                    << ". Detail: " << _file.errorString();
+        _file.close();
+        return false;
+    }
+
+    FileHeader header;
+    memcpy(header.magic, "PPCAPTUR", sizeof(header.magic));
+    header.version = version;
+    header.headerSize = sizeof(FileHeader);
+    header.startTime = QDateTime::currentMSecsSinceEpoch();
+    memcpy(_data, &header, sizeof(header));
+
+    _size = maxSize;
+    _offset = qint64(sizeof(FileHeader));
+    _records = 0;
+    _bytes = 0;
+    _dropped = 0;
+    _timer.start();
+    _active = true;
+
+    log_info_m << "Capture started. File: " << filePath;
+    return true;
+}
+
+void Capture::close()
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (!_active)
+        return;
+
+    // Дожидаемся завершения операций записи, начатых до остановки
+    _active = false;
+    while (_writers != 0)
+        QThread::yieldCurrentThread();
+
+    const qint64 used = qMin(_offset.load(), _size);
+    _file.unmap(_data);
+    _data = nullptr;
+    _file.resize(used);
+    _file.close();
+
+    log_info_m << "Capture stopped. File: " << _file.fileName()
+               << ". Records: " << _records.load()
+               << ". Dropped: " << _dropped.load();
+}
+
+void Capture::write(Direction direction, SocketDescriptor socket, SerializeFormat format,
+                    const QByteArray& frame, const QVector<QByteArray>& segments)
+{
+    if (!_active)
+        return;
+
+    ++_writers;
+    if (!_active)
+    {
+        --_writers;
+        return;
+    }
+
+    qint64 frameSize = frame.size();
+    for (const QByteArray& segment : segments)
+        frameSize += segment.size();
+
+    const qint64 recordSize = (qint64(sizeof(RecordHeader)) + frameSize + 7) & ~qint64(7);
+    const qint64 offset = _offset.fetch_add(recordSize);
+    if (offset + recordSize > _size)
+    {
+        ++_dropped;
+        --_writers;
+        return;
+    }
+
+    uchar* record = _data + offset;
+
+    RecordHeader header;
+    header.size = 0;
+    header.frameSize = quint32(frameSize);
+    header.direction = quint8(direction);
+    header.format = quint8(format);
+    header.reserved = 0;
+    header.socket = qint32(socket);
+    header.time = _timer.nsecsElapsed();
+    memcpy(record, &header, sizeof(header));
+
+    uchar* data = record + sizeof(RecordHeader);
+    memcpy(data, frame.constData(), size_t(frame.size()));
+    data += frame.size();
+    for (const QByteArray& segment : segments)
+    {
+        memcpy(data, segment.constData(), size_t(segment.size()));
+        data += segment.size();
+    }
+
+    // Размер заполняется последним, запись становится видимой при чтении
+    __atomic_store_n(reinterpret_cast<quint32*>(record), quint32(recordSize),
+                     __ATOMIC_RELEASE);
+
+    ++_records;
+    _bytes += quint64(frameSize);
+    --_writers;
+}
+
+Capture::Stats Capture::stats() const
+{
+    Stats stats;
+    stats.records = _records;
+    stats.bytes = _bytes;
+    stats.dropped = _dropped;
+    return stats;
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,140 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Запись трафика соединений в файл для последующего воспроизведения (см.
+  transport/replay.h).
+
+  Записываются сериализованные сообщения (кадры) в том виде, в котором они
+  существуют до сжатия и шифрования потока: для исходящих сообщений - сразу
+  после сериализации, для входящих - после расшифровки и распаковки. Кадры
+  служебных механизмов дедупликации и дельта-кодирования записываются в
+  том виде, в котором они передаются, поэтому при записи трафика для после-
+  дующего воспроизведения эти механизмы рекомендуется отключать.
+
+  Файл отображается в память и заполняется только добавлением записей.
+  Место для записи резервируется атомарной операцией, поэтому один экземп-
+  ляр может использоваться сокетами нескольких потоков без блокировок. При
+  заполнении файла запись прекращается, количество отброшенных кадров
+  отражается в статистике.
+
+  Формат файла (порядок байт соответствует платформе):
+    FileHeader                 заголовок файла
+    RecordHeader + frame       записи, выровненные на 8 байт
+  Поле RecordHeader::size заполняется последним, поэтому при аварийном
+  завершении программы чтение файла прекращается на первой незаполненной
+  записи.
+*****************************************************************************/
+
+#pragma once
+
+#include "message.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+
+#include <QtCore>
+#include <atomic>
+
+namespace pproto::transport {
+
+class Capture : public clife_base
+{
+public:
+    typedef clife_ptr<Capture> Ptr;
+
+    enum class Direction : quint8
+    {
+        In  = 0, // Входящее сообщение
+        Out = 1  // Исходящее сообщение
+    };
+
+    struct FileHeader
+    {
+        char    magic[8];   // "PPCAPTUR"
+        quint32 version;
+        quint32 headerSize; // sizeof(FileHeader)
+        qint64  startTime;  // Время начала записи (UTC, в миллисекундах)
+    };
+
+    struct RecordHeader
+    {
+        quint32 size;       // Размер записи с учетом заголовка и выравнивания
+        quint32 frameSize;  // Размер кадра
+        quint8  direction;  // Направление (Direction)
+        quint8  format;     // Формат сериализации сообщения (SerializeFormat)
+        quint16 reserved;
+        qint32  socket;     // Дескриптор сокета
+        qint64  time;       // Время от начала записи (в наносекундах)
+    };
+
+    struct Stats
+    {
+        quint64 records = {0}; // Количество записанных кадров
+        quint64 bytes = {0};   // Объем записанных данных
+        quint64 dropped = {0}; // Количество кадров, не поместившихся в файл
+    };
+
+    static const quint32 version = 1;
+
+    Capture() = default;
+    ~Capture();
+
+    // Создает файл размером maxSize (в байтах) и начинает запись
+    bool open(const QString& filePath, qint64 maxSize = 256*1024*1024);
+
+    // Завершает запись, размер файла уменьшается до объема записанных данных
+    void close();
+
+    bool isOpen() const {return _active;}
+
+    // Записывает кадр. Сегменты контента (см. Message::appendContentSegment())
+    // дописываются к кадру
+    void write(Direction, SocketDescriptor, SerializeFormat, const QByteArray& frame,
+               const QVector<QByteArray>& segments = {});
+
+    Stats stats() const;
+
+private:
+    DISABLE_DEFAULT_COPY(Capture)
+
+private:
+    QFile _file;
+    uchar* _data = {nullptr};
+    qint64 _size = {0};
+
+    std::atomic<qint64> _offset = {0};
+    std::atomic<bool> _active = {false};
+    std::atomic<int>  _writers = {0};
+
+    std::atomic<quint64> _records = {0};
+    std::atomic<quint64> _bytes = {0};
+    std::atomic<quint64> _dropped = {0};
+
+    QElapsedTimer _timer;
+    mutable QMutex _lock;
+};
+
+} // namespace pproto::transport
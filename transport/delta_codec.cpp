@@ -0,0 +1,375 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/delta_codec.h"
+#include "commands/pool.h"
+#include "serialize/functions.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <cstring>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "DeltaCodec")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "DeltaCodec")
+#define log_info_m    alog::logger().info    (alog_line_location, "DeltaCodec")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "DeltaCodec")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "DeltaCodec")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "DeltaCodec")
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+
+namespace pproto::transport {
+
+namespace {
+
+// Минимальная длина последовательности совпадающих байт, которая  прерывает
+// литерал. Более короткие совпадения выгоднее передать в составе литерала
+const int minEqualRun = 8;
+
+// Максимальное количество потоков. При превышении состояние потоков сбрасы-
+// вается, и для каждого потока будет заново отправлен опорный кадр
+const int maxStreams = 1024;
+
+void writeVarint(QByteArray& buff, quint32 val)
+{
+    while (val >= 0x80)
+    {
+        buff.append(char((val & 0x7F) | 0x80));
+        val >>= 7;
+    }
+    buff.append(char(val));
+}
+
+bool readVarint(const char*& p, const char* end, quint32& val)
+{
+    val = 0;
+    for (int shift = 0; shift < 32; shift += 7)
+    {
+        if (p == end)
+            return false;
+
+        quint8 b = quint8(*p++);
+        val |= quint32(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+DeltaCodec::DeltaCodec(int keyframe)
+    : _keyframe(keyframe)
+{}
+
+Message::Ptr DeltaCodec::hello() const
+{
+    data::DeltaFrame deltaFrame;
+    deltaFrame.mode = data::DeltaFrame::Mode::Hello;
+
+    Message::Ptr message =
+        createMessage(deltaFrame, {Message::Type::Event, SerializeFormat::QBinary});
+    message->setPriority(Message::Priority::High);
+    return message;
+}
+
+QByteArray DeltaCodec::encode(const Message::Ptr& message, const QByteArray& frame)
+{
+    if (!_active
+        || !pproto::command::pool().deltaEncoding(message->command()))
+    {
+        return {};
+    }
+
+    // Сжатый контент  значительно изменяется  даже при  незначительном
+    // изменении исходных данных
+    if (message->compression() != Message::Compression::None
+        && message->compression() != Message::Compression::Disable)
+    {
+        return {};
+    }
+
+    const QVector<quint64> tags = message->tags();
+    const StreamKey streamKey {message->command(), tags.isEmpty() ? 0 : tags[0]};
+
+    if (!_sent.contains(streamKey) && _sent.count() >= maxStreams)
+    {
+        log_debug_m << "Streams limit exceeded. State of streams is reset";
+        _sent.clear();
+    }
+
+    SendStream& stream = _sent[streamKey];
+
+    data::DeltaFrame deltaFrame;
+    deltaFrame.command = streamKey.first;
+    deltaFrame.key = streamKey.second;
+    deltaFrame.checksum = checksum(frame);
+
+    if (!stream.base.isEmpty()
+        && !stream.needKey
+        && (_keyframe <= 0 || (stream.count % quint32(_keyframe)) != 0))
+    {
+        deltaFrame.payload = diff(stream.base, frame, frame.size() / 2);
+        if (!deltaFrame.payload.isEmpty())
+        {
+            deltaFrame.mode = data::DeltaFrame::Mode::Delta;
+            deltaFrame.baseChecksum = checksum(stream.base);
+        }
+    }
+    if (deltaFrame.payload.isEmpty())
+    {
+        deltaFrame.mode = data::DeltaFrame::Mode::Key;
+        deltaFrame.payload = frame;
+        stream.count = 0;
+        stream.needKey = false;
+        ++_stats.keyframes;
+    }
+    else
+    {
+        _stats.bytesSaved += frame.size() - deltaFrame.payload.size();
+        ++_stats.deltas;
+    }
+    stream.base = frame;
+    ++stream.count;
+
+    return serialize(deltaFrame);
+}
+
+void DeltaCodec::process(const Message::Ptr& message, QList<QByteArray>& frames,
+                         Message::List& internal)
+{
+    data::DeltaFrame deltaFrame;
+    readFromMessage(message, deltaFrame);
+    if (!deltaFrame.dataIsValid)
+        return;
+
+    const StreamKey streamKey {deltaFrame.command, deltaFrame.key};
+
+    auto keyRequest = [&](RecvStream& stream)
+    {
+        stream.base.clear();
+        if (stream.keyRequested)
+            return;
+
+        data::DeltaFrame request;
+        request.mode = data::DeltaFrame::Mode::KeyRequest;
+        request.command = deltaFrame.command;
+        request.key = deltaFrame.key;
+
+        Message::Ptr m =
+            createMessage(request, {Message::Type::Event, SerializeFormat::QBinary});
+        m->setPriority(Message::Priority::High);
+        internal.add(m.detach());
+        stream.keyRequested = true;
+    };
+
+    auto receivedStream = [this, &streamKey]() -> RecvStream&
+    {
+        if (!_received.contains(streamKey) && _received.count() >= maxStreams)
+            _received.clear();
+        return _received[streamKey];
+    };
+
+    switch (deltaFrame.mode)
+    {
+        case data::DeltaFrame::Mode::Hello:
+        {
+            _active = true;
+            log_verbose_m << "Delta encoding is active";
+            break;
+        }
+        case data::DeltaFrame::Mode::Key:
+        {
+            RecvStream& stream = receivedStream();
+            if (checksum(deltaFrame.payload) != deltaFrame.checksum)
+            {
+                log_error_m << "Keyframe checksum mismatch"
+                            << ". Command " << CommandNameLog(deltaFrame.command)
+                            << " discarded";
+                keyRequest(stream);
+                break;
+            }
+            stream.base = deltaFrame.payload;
+            stream.keyRequested = false;
+            frames.append(deltaFrame.payload);
+            break;
+        }
+        case data::DeltaFrame::Mode::Delta:
+        {
+            RecvStream& stream = receivedStream();
+            if (stream.base.isEmpty()
+                || checksum(stream.base) != deltaFrame.baseChecksum)
+            {
+                if (!stream.keyRequested)
+                    log_warn_m << "Base frame not found or mismatch"
+                               << ". Command " << CommandNameLog(deltaFrame.command)
+                               << " discarded, keyframe will be requested";
+                keyRequest(stream);
+                break;
+            }
+            QByteArray frame;
+            if (!patch(stream.base, deltaFrame.payload, frame)
+                || checksum(frame) != deltaFrame.checksum)
+            {
+                log_error_m << "Failed restore message from delta"
+                            << ". Command " << CommandNameLog(deltaFrame.command)
+                            << " discarded, keyframe will be requested";
+                keyRequest(stream);
+                break;
+            }
+            stream.base = frame;
+            frames.append(frame);
+            break;
+        }
+        case data::DeltaFrame::Mode::KeyRequest:
+        {
+            auto it = _sent.find(streamKey);
+            if (it != _sent.end())
+                it->needKey = true;
+            ++_stats.keyRequests;
+            break;
+        }
+        default:
+            log_error_m << "Unknown mode of delta encoding";
+    }
+}
+
+qint64 DeltaCodec::memory() const
+{
+    qint64 memory = 0;
+    for (const SendStream& stream : _sent)
+        memory += sizeof(StreamKey) + sizeof(SendStream) + stream.base.capacity();
+
+    for (const RecvStream& stream : _received)
+        memory += sizeof(StreamKey) + sizeof(RecvStream) + stream.base.capacity();
+
+    return memory;
+}
+
+QByteArray DeltaCodec::diff(const QByteArray& base, const QByteArray& frame, int limit)
+{
+    const char* b = base.constData();
+    const char* f = frame.constData();
+    const int size = frame.size();
+    const int common = qMin(base.size(), size);
+
+    QByteArray delta;
+    delta.reserve(limit);
+    writeVarint(delta, quint32(size));
+
+    int pos = 0;
+    while (pos < size)
+    {
+        int skip = pos;
+        while (skip < common && b[skip] == f[skip])
+            ++skip;
+
+        // Литерал завершается на последовательности совпадающих байт длиной
+        // не менее minEqualRun, или в конце кадра
+        int literalEnd = skip;
+        int equal = 0;
+        for (int i = skip; i < size; ++i)
+        {
+            if (i < common && b[i] == f[i])
+            {
+                if (++equal >= minEqualRun)
+                    break;
+            }
+            else
+            {
+                equal = 0;
+                literalEnd = i + 1;
+            }
+        }
+
+        writeVarint(delta, quint32(skip - pos));
+        writeVarint(delta, quint32(literalEnd - skip));
+        delta.append(f + skip, literalEnd - skip);
+
+        if (delta.size() > limit)
+            return {};
+
+        pos = literalEnd;
+    }
+    return delta;
+}
+
+bool DeltaCodec::patch(const QByteArray& base, const QByteArray& delta, QByteArray& frame)
+{
+    const char* p = delta.constData();
+    const char* end = p + delta.size();
+
+    // Каждый байт восстановленного кадра копируется либо из базового кадра,
+    // либо из литерала, что ограничивает размер восстановленного кадра
+    quint32 size;
+    if (!readVarint(p, end, size)
+        || qint64(size) > qint64(base.size()) + qint64(delta.size()))
+    {
+        return false;
+    }
+
+    frame.resize(int(size));
+    char* f = frame.data();
+
+    quint32 pos = 0;
+    while (pos < size)
+    {
+        quint32 skip, literal;
+        if (!readVarint(p, end, skip) || !readVarint(p, end, literal))
+            return false;
+
+        if (skip > size - pos || skip > quint32(base.size()) - qMin(pos, quint32(base.size())))
+            return false;
+
+        memcpy(f + pos, base.constData() + pos, skip);
+        pos += skip;
+
+        if (literal > size - pos || literal > quint32(end - p))
+            return false;
+
+        memcpy(f + pos, p, literal);
+        p += literal;
+        pos += literal;
+    }
+    return (p == end);
+}
+
+quint32 DeltaCodec::checksum(const QByteArray& frame)
+{
+    return quint32(qHashBits(frame.constData(), size_t(frame.size()), 0x9E3779B9));
+}
+
+QByteArray DeltaCodec::serialize(const data::DeltaFrame& deltaFrame)
+{
+    Message::Ptr message =
+        createMessage(deltaFrame, {Message::Type::Event, SerializeFormat::QBinary});
+    return message->toQBinary();
+}
+
+} // namespace pproto::transport
+
+#endif // PPROTO_QBINARY_SERIALIZE
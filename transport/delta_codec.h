@@ -0,0 +1,145 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Дельта-кодирование последовательных сообщений одной команды.
+
+  Для команд, которые периодически передают незначительно изменяющиеся
+  данные (например, снимки состояния), вместо сериализованного сообщения
+  передается его разность относительно предыдущего сообщения того же потока.
+  Поток определяется идентификатором команды и ключом (значение tag(0) сооб-
+  щения, или 0 если теги не заданы).
+
+  Разность вычисляется для сериализованного сообщения целиком и кодируется
+  как последовательность пар: количество совпадающих байт (пропуск) и
+  количество отличающихся байт (литерал), за которым следуют сами отличаю-
+  щиеся байты. Все длины записываются в формате varint.
+
+  Опорный кадр (сообщение целиком) отправляется для первого сообщения потока,
+  периодически (через каждые keyframe сообщений), в случае, когда размер
+  разности превышает половину размера сообщения, а также по запросу прини-
+  мающей стороны. Принимающая сторона проверяет контрольные суммы базового
+  и восстановленного сообщений,  при несовпадении сообщение отбрасывается
+  и отправляется запрос опорного кадра (режим KeyRequest).
+
+  Разрешение на дельта-кодирование задается в пуле команд,  см.
+  command::Pool::setDeltaEncoding(). Механизм работает только с бинарным
+  форматом сериализации сообщений. Экземпляр класса используется только
+  в потоке сокета и не является потокозащищенным.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/base.h"
+
+#include "shared/defmac.h"
+#include <QtCore>
+
+namespace pproto::transport {
+
+class DeltaCodec
+{
+public:
+    struct Stats
+    {
+        // Количество отправленных опорных кадров
+        quint64 keyframes = {0};
+
+        // Количество отправленных разностных кадров
+        quint64 deltas = {0};
+
+        // Количество байт, которые не были переданы благодаря дельта-кодированию
+        quint64 bytesSaved = {0};
+
+        // Количество запросов опорного кадра от принимающей стороны
+        quint64 keyRequests = {0};
+    };
+
+    // Параметр keyframe определяет периодичность отправки опорных кадров
+    DeltaCodec(int keyframe);
+
+    // Возвращает TRUE если противоположная сторона поддерживает дельта-коди-
+    // рование
+    bool active() const {return _active;}
+
+    // Сообщение для уведомления противоположной стороны о поддержке дельта-
+    // кодирования. Отправляется после проверки совместимости протоколов
+    Message::Ptr hello() const;
+
+    // Выполняет дельта-кодирование сериализованного сообщения frame. Возвра-
+    // щает сериализованное сообщение DeltaFrame, или пустой буфер, если
+    // дельта-кодирование для сообщения не выполняется
+    QByteArray encode(const Message::Ptr& message, const QByteArray& frame);
+
+    // Обрабатывает сообщение DeltaFrame. Восстановленные сериализованные
+    // сообщения добавляются в frames,  служебные сообщения для отправки
+    // противоположной стороне добавляются в internal
+    void process(const Message::Ptr&, QList<QByteArray>& frames,
+                 Message::List& internal);
+
+    Stats stats() const {return _stats;}
+
+    // Объем памяти (в байтах), занимаемый базовыми кадрами потоков
+    qint64 memory() const;
+
+private:
+    DISABLE_DEFAULT_COPY(DeltaCodec)
+
+    typedef QPair<QUuidEx, quint64> StreamKey;
+
+    struct SendStream
+    {
+        QByteArray base;
+        quint32 count = {0};
+        bool needKey = {false};
+    };
+
+    struct RecvStream
+    {
+        QByteArray base;
+        bool keyRequested = {false};
+    };
+
+    // Вычисляет разность между frame и base. Возвращает пустой буфер, если
+    // размер разности превышает limit
+    static QByteArray diff(const QByteArray& base, const QByteArray& frame, int limit);
+
+    // Восстанавливает сообщение по базовому кадру и разности. Возвращает
+    // FALSE если разность повреждена
+    static bool patch(const QByteArray& base, const QByteArray& delta, QByteArray& frame);
+
+    static quint32 checksum(const QByteArray&);
+    static QByteArray serialize(const data::DeltaFrame&);
+
+private:
+    const int _keyframe;
+    bool _active = {false};
+
+    QHash<StreamKey, SendStream> _sent;
+    QHash<StreamKey, RecvStream> _received;
+
+    Stats _stats;
+};
+
+} // namespace pproto::transport
@@ -0,0 +1,502 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/dict_codec.h"
+#include "commands/pool.h"
+#include "serialize/functions.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#ifdef ZSTD_DICTIONARY
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "DictCodec")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "DictCodec")
+#define log_info_m    alog::logger().info    (alog_line_location, "DictCodec")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "DictCodec")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "DictCodec")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "DictCodec")
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+
+namespace pproto::transport {
+
+namespace {
+
+// Минимальный размер сообщения (в байтах), для которого выполняется сжатие
+const int minFrameSize = 64;
+
+// Максимальный размер образца сообщения (в байтах)
+const int maxSampleSize = 64*1024;
+
+// Количество версий словаря команды, хранимых принимающей стороной
+const int receivedVersions = 4;
+
+#ifdef ZSTD_DICTIONARY
+struct CCtxDeleter {void operator()(ZSTD_CCtx* ctx) {ZSTD_freeCCtx(ctx);}};
+struct DCtxDeleter {void operator()(ZSTD_DCtx* ctx) {ZSTD_freeDCtx(ctx);}};
+
+// Контексты сжатия/распаковки создаются однократно для каждого потока
+ZSTD_CCtx* compressContext()
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> ctx {ZSTD_createCCtx()};
+    return ctx.get();
+}
+
+ZSTD_DCtx* decompressContext()
+{
+    thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx {ZSTD_createDCtx()};
+    return ctx.get();
+}
+#endif // ZSTD_DICTIONARY
+
+} // namespace
+
+//------------------------------ CompressionDict -----------------------------
+
+CompressionDict::CompressionDict(const QUuidEx& command, quint32 version,
+                                 const QByteArray& data, int level)
+    : _command(command),
+      _version(version),
+      _data(data)
+{
+#ifdef ZSTD_DICTIONARY
+    _cdict = ZSTD_createCDict(_data.constData(), size_t(_data.size()), level);
+    _ddict = ZSTD_createDDict(_data.constData(), size_t(_data.size()));
+#else
+    (void) level;
+#endif
+}
+
+CompressionDict::~CompressionDict()
+{
+#ifdef ZSTD_DICTIONARY
+    ZSTD_freeCDict(_cdict);
+    ZSTD_freeDDict(_ddict);
+#endif
+}
+
+QByteArray CompressionDict::compress(const QByteArray& data) const
+{
+#ifdef ZSTD_DICTIONARY
+    ZSTD_CCtx* ctx = compressContext();
+    if (ctx == nullptr || _cdict == nullptr)
+        return {};
+
+    QByteArray buff;
+    buff.resize(int(ZSTD_compressBound(size_t(data.size()))));
+    size_t res = ZSTD_compress_usingCDict(ctx, buff.data(), size_t(buff.size()),
+                                          data.constData(), size_t(data.size()), _cdict);
+    if (ZSTD_isError(res))
+        return {};
+
+    buff.resize(int(res));
+    return buff;
+#else
+    (void) data;
+    return {};
+#endif
+}
+
+bool CompressionDict::decompress(const QByteArray& data, int size, QByteArray& result) const
+{
+#ifdef ZSTD_DICTIONARY
+    ZSTD_DCtx* ctx = decompressContext();
+    if (ctx == nullptr || _ddict == nullptr || size < 0)
+        return false;
+
+    result.resize(size);
+    size_t res = ZSTD_decompress_usingDDict(ctx, result.data(), size_t(result.size()),
+                                            data.constData(), size_t(data.size()), _ddict);
+    return (!ZSTD_isError(res) && res == size_t(size));
+#else
+    (void) data;
+    (void) size;
+    (void) result;
+    return false;
+#endif
+}
+
+//--------------------------------- DictStore --------------------------------
+
+DictStore::DictStore(int dictSize, int maxSamples, int level)
+    : _dictSize(dictSize),
+      _maxSamples(qMax(maxSamples, 1)),
+      _level(level)
+{}
+
+void DictStore::sample(const QUuidEx& command, const QByteArray& frame)
+{
+    if (frame.size() > maxSampleSize)
+        return;
+
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    Samples& samples = _samples[command];
+    if (samples.frames.count() < _maxSamples)
+    {
+        samples.frames.append(frame);
+    }
+    else
+    {
+        samples.memory -= samples.frames[samples.next].size();
+        samples.frames[samples.next] = frame;
+        samples.next = (samples.next + 1) % _maxSamples;
+    }
+    samples.memory += frame.size();
+}
+
+int DictStore::train(int minSamples)
+{
+#ifdef ZSTD_DICTIONARY
+    QHash<QUuidEx, QVector<QByteArray>> samples;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        for (auto it = _samples.constBegin(); it != _samples.constEnd(); ++it)
+            if (it.value().frames.count() >= minSamples)
+                samples.insert(it.key(), it.value().frames);
+    }
+
+    int trained = 0;
+    for (auto it = samples.constBegin(); it != samples.constEnd(); ++it)
+    {
+        const QVector<QByteArray>& frames = it.value();
+
+        QByteArray buff;
+        std::vector<size_t> sizes;
+        sizes.reserve(size_t(frames.count()));
+        for (const QByteArray& frame : frames)
+        {
+            buff.append(frame);
+            sizes.push_back(size_t(frame.size()));
+        }
+
+        QByteArray dict;
+        dict.resize(_dictSize);
+        size_t res = ZDICT_trainFromBuffer(dict.data(), size_t(dict.size()),
+                                           buff.constData(), sizes.data(),
+                                           unsigned(sizes.size()));
+        if (ZDICT_isError(res))
+        {
+            log_error_m << "Failed train dictionary for command "
+                        << CommandNameLog(it.key())
+                        << ". Detail: " << ZDICT_getErrorName(res);
+            continue;
+        }
+        dict.resize(int(res));
+
+        CompressionDict::Ptr d = addDictionary(it.key(), dict);
+        if (!d.empty())
+        {
+            log_verbose_m << "Dictionary trained for command " << CommandNameLog(it.key())
+                          << ". Version: " << d->version()
+                          << ". Size: " << dict.size()
+                          << ". Samples: " << frames.count();
+            ++trained;
+        }
+    }
+    return trained;
+#else
+    (void) minSamples;
+    return 0;
+#endif
+}
+
+CompressionDict::Ptr DictStore::dictionary(const QUuidEx& command) const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _dicts.value(command);
+}
+
+bool DictStore::setDictionary(const QUuidEx& command, const QByteArray& data)
+{
+    return !addDictionary(command, data).empty();
+}
+
+CompressionDict::Ptr DictStore::addDictionary(const QUuidEx& command, const QByteArray& data)
+{
+    quint32 version;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        CompressionDict::Ptr current = _dicts.value(command);
+        version = current.empty() ? 1 : current->version() + 1;
+    }
+
+    CompressionDict::Ptr dict {new CompressionDict(command, version, data, _level)};
+    if (!dict->isValid())
+    {
+        log_error_m << "Failed create dictionary for command " << CommandNameLog(command);
+        return {};
+    }
+
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    // Версия могла измениться при одновременной установке словаря
+    CompressionDict::Ptr current = _dicts.value(command);
+    if (!current.empty() && current->version() >= version)
+        dict = CompressionDict::Ptr(new CompressionDict(command, current->version() + 1,
+                                                        data, _level));
+    _dicts.insert(command, dict);
+    return dict;
+}
+
+qint64 DictStore::memory() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    qint64 memory = 0;
+    for (const Samples& samples : _samples)
+        memory += samples.memory;
+
+    for (const CompressionDict::Ptr& dict : _dicts)
+        memory += dict->data().size();
+
+    return memory;
+}
+
+//--------------------------------- DictCodec --------------------------------
+
+DictCodec::DictCodec(const DictStore::Ptr& store, int maxSize, qint32 maxUncompressedSize)
+    : _store(store),
+      _maxSize(maxSize),
+      _maxUncompressedSize(maxUncompressedSize)
+{}
+
+bool DictCodec::supported()
+{
+#ifdef ZSTD_DICTIONARY
+    return true;
+#else
+    return false;
+#endif
+}
+
+Message::Ptr DictCodec::hello() const
+{
+    data::DictFrame dictFrame;
+    dictFrame.mode = data::DictFrame::Mode::Hello;
+
+    Message::Ptr message =
+        createMessage(dictFrame, {Message::Type::Event, SerializeFormat::QBinary});
+    message->setPriority(Message::Priority::High);
+    return message;
+}
+
+QByteArray DictCodec::encode(const Message::Ptr& message, const QByteArray& frame)
+{
+    if (!_active
+        || frame.size() > _maxSize
+        || !pproto::command::pool().dictCompression(message->command()))
+    {
+        return {};
+    }
+
+    // Сжатый контент не содержит повторяющихся фрагментов
+    if (message->compression() != Message::Compression::None
+        && message->compression() != Message::Compression::Disable)
+    {
+        return {};
+    }
+
+    _store->sample(message->command(), frame);
+
+    if (frame.size() < minFrameSize)
+        return {};
+
+    CompressionDict::Ptr dict = _store->dictionary(message->command());
+    if (dict.empty())
+        return {};
+
+    data::DictFrame dictFrame;
+    dictFrame.command = message->command();
+    dictFrame.version = dict->version();
+    dictFrame.size = quint32(frame.size());
+    dictFrame.payload = dict->compress(frame);
+    if (dictFrame.payload.isEmpty())
+        return {};
+
+    auto it = _sent.find(dictFrame.command);
+    const bool sendDict = (it == _sent.end() || it.value() != dictFrame.version);
+    if (sendDict)
+    {
+        dictFrame.mode = data::DictFrame::Mode::Dict;
+        dictFrame.dictionary = dict->data();
+    }
+    else
+        dictFrame.mode = data::DictFrame::Mode::Compressed;
+
+    QByteArray buff = serialize(dictFrame);
+
+    // Словарь передается независимо от выигрыша в размере, иначе для
+    // сообщений команды сжатие не будет выполняться никогда
+    if (!sendDict && buff.size() >= frame.size())
+        return {};
+
+    if (sendDict)
+    {
+        _sent[dictFrame.command] = dictFrame.version;
+        ++_stats.dictsSent;
+    }
+    else
+        _stats.bytesSaved += frame.size() - buff.size();
+
+    ++_stats.compressed;
+    return buff;
+}
+
+void DictCodec::process(const Message::Ptr& message, QList<QByteArray>& frames,
+                        Message::List& internal)
+{
+    data::DictFrame dictFrame;
+    readFromMessage(message, dictFrame);
+    if (!dictFrame.dataIsValid)
+        return;
+
+    auto decompress = [&](const CompressionDict::Ptr& dict)
+    {
+        if (_maxUncompressedSize > 0 && dictFrame.size > quint32(_maxUncompressedSize))
+        {
+            log_error_m << "Uncompressed message size " << dictFrame.size
+                        << " exceeds limit " << _maxUncompressedSize
+                        << ". Command " << CommandNameLog(dictFrame.command)
+                        << " discarded";
+            return;
+        }
+        QByteArray frame;
+        if (dictFrame.size > quint32(std::numeric_limits<int>::max())
+            || !dict->decompress(dictFrame.payload, int(dictFrame.size), frame))
+        {
+            log_error_m << "Failed decompress message"
+                        << ". Command " << CommandNameLog(dictFrame.command)
+                        << " discarded";
+            return;
+        }
+        frames.append(frame);
+    };
+
+    switch (dictFrame.mode)
+    {
+        case data::DictFrame::Mode::Hello:
+        {
+            if (supported())
+            {
+                _active = true;
+                log_verbose_m << "Dictionary compression is active";
+            }
+            break;
+        }
+        case data::DictFrame::Mode::Dict:
+        {
+            CompressionDict::Ptr dict {new CompressionDict(dictFrame.command,
+                                                           dictFrame.version,
+                                                           dictFrame.dictionary, 0)};
+            if (!dict->isValid())
+            {
+                log_error_m << "Failed create dictionary"
+                            << ". Command " << CommandNameLog(dictFrame.command)
+                            << " discarded";
+                break;
+            }
+            QList<CompressionDict::Ptr>& dicts = _received[dictFrame.command];
+            for (int i = 0; i < dicts.count(); ++i)
+                if (dicts[i]->version() == dictFrame.version)
+                    dicts.removeAt(i--);
+
+            dicts.prepend(dict);
+            while (dicts.count() > receivedVersions)
+                dicts.removeLast();
+
+            decompress(dict);
+            break;
+        }
+        case data::DictFrame::Mode::Compressed:
+        {
+            CompressionDict::Ptr dict;
+            for (const CompressionDict::Ptr& d : _received.value(dictFrame.command))
+                if (d->version() == dictFrame.version)
+                {
+                    dict = d;
+                    break;
+                }
+
+            if (dict.empty())
+            {
+                log_warn_m << "Dictionary version " << dictFrame.version
+                           << " not found. Command " << CommandNameLog(dictFrame.command)
+                           << " discarded, dictionary will be requested";
+                ++_stats.misses;
+
+                data::DictFrame request;
+                request.mode = data::DictFrame::Mode::DictRequest;
+                request.command = dictFrame.command;
+                request.version = dictFrame.version;
+
+                Message::Ptr m =
+                    createMessage(request, {Message::Type::Event, SerializeFormat::QBinary});
+                m->setPriority(Message::Priority::High);
+                internal.add(m.detach());
+                break;
+            }
+            decompress(dict);
+            break;
+        }
+        case data::DictFrame::Mode::DictRequest:
+        {
+            _sent.remove(dictFrame.command);
+            break;
+        }
+        default:
+            log_error_m << "Unknown mode of dictionary compression";
+    }
+}
+
+qint64 DictCodec::memory() const
+{
+    qint64 memory = 0;
+    for (const QList<CompressionDict::Ptr>& dicts : _received)
+        for (const CompressionDict::Ptr& dict : dicts)
+            memory += dict->data().size();
+
+    return memory;
+}
+
+QByteArray DictCodec::serialize(const data::DictFrame& dictFrame)
+{
+    Message::Ptr message =
+        createMessage(dictFrame, {Message::Type::Event, SerializeFormat::QBinary});
+    return message->toQBinary();
+}
+
+} // namespace pproto::transport
+
+#endif // PPROTO_QBINARY_SERIALIZE
@@ -0,0 +1,238 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Сжатие небольших сообщений с использованием словарей, обученных на сооб-
+  щениях отдельных команд.
+
+  Сообщения, размер которых не превышает Properties::compressionSize(), при
+  отправке не сжимаются: сжатие без контекста для них неэффективно. При этом
+  сообщения одной команды имеют одинаковую структуру и содержат повторяющиеся
+  фрагменты, поэтому словарь, обученный на сообщениях команды, позволяет
+  эффективно сжимать даже очень короткие сообщения.
+
+  Хранилище словарей (DictStore) собирает образцы сериализованных сообщений
+  команд, для которых разрешено сжатие со словарем (см. command::Pool::
+  setDictCompression()), и обучает словари при вызове функции train(). Обуче-
+  ние может выполняться периодически (например, по таймеру) или заранее:
+  обученный словарь сохраняется в приложении (CompressionDict::data())  и
+  загружается функцией setDictionary(). Каждое обучение или загрузка словаря
+  команды увеличивает версию словаря.
+
+  Словарь передается противоположной стороне вместе с первым сообщением,
+  сжатым этой версией словаря (режим Dict), последующие сообщения содержат
+  только команду и версию словаря (режим Compressed). Принимающая сторона
+  хранит несколько последних версий словаря каждой команды, поэтому смена
+  версии не нарушает обработку сообщений, уже находящихся в пути. Если сло-
+  варь не найден, принимающая сторона отправляет запрос DictRequest, и сло-
+  варь будет передан повторно со следующим сообщением команды; сообщение,
+  для которого словарь не найден, при этом теряется.
+
+  Сжатие со словарями используется только если обе стороны соединения обме-
+  нялись сообщениями Hello, поэтому узлы без поддержки словарей продолжают
+  работать без изменений. Для приема сжатых сообщений достаточно задать
+  хранилище без словарей.
+
+  Механизм доступен при сборке с параметром ZSTD_DICTIONARY (требуется
+  библиотека zstd) и работает только с бинарным форматом сериализации.
+  Экземпляр DictStore может использоваться сокетами нескольких потоков,
+  экземпляр DictCodec используется только в потоке сокета и не является
+  потокозащищенным.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/base.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+#include "shared/qt/quuidex.h"
+
+#include <QtCore>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace pproto::transport {
+
+/**
+  Словарь сжатия для команды. После создания не изменяется
+*/
+class CompressionDict : public clife_base
+{
+public:
+    typedef clife_ptr<CompressionDict> Ptr;
+
+    // Параметр level определяет уровень сжатия zstd
+    CompressionDict(const QUuidEx& command, quint32 version,
+                    const QByteArray& data, int level);
+    ~CompressionDict();
+
+    // Возвращает TRUE если словарь успешно подготовлен для сжатия
+    bool isValid() const {return _cdict && _ddict;}
+
+    const QUuidEx& command() const {return _command;}
+    quint32 version() const {return _version;}
+    const QByteArray& data() const {return _data;}
+
+    // Сжимает данные. Возвращает пустой буфер при ошибке
+    QByteArray compress(const QByteArray&) const;
+
+    // Распаковывает данные, size - размер данных до сжатия
+    bool decompress(const QByteArray&, int size, QByteArray& result) const;
+
+private:
+    DISABLE_DEFAULT_FUNC(CompressionDict)
+
+    const QUuidEx _command;
+    const quint32 _version;
+    const QByteArray _data;
+
+    ZSTD_CDict_s* _cdict = {nullptr};
+    ZSTD_DDict_s* _ddict = {nullptr};
+};
+
+class DictStore : public clife_base
+{
+public:
+    typedef clife_ptr<DictStore> Ptr;
+
+    // Параметр dictSize определяет размер (в байтах) обучаемого словаря,
+    // maxSamples - количество хранимых образцов сообщений для каждой команды,
+    // level - уровень сжатия zstd
+    DictStore(int dictSize = 16*1024, int maxSamples = 2000, int level = 3);
+
+    // Сохраняет образец сериализованного сообщения команды
+    void sample(const QUuidEx& command, const QByteArray& frame);
+
+    // Обучает словари для команд, накопивших не менее minSamples образцов.
+    // Накопленные образцы сохраняются для последующих обучений. Возвращает
+    // количество обученных словарей. Обучение может занимать значительное
+    // время, поэтому функцию не рекомендуется вызывать из потока сокета
+    int train(int minSamples = 100);
+
+    // Возвращает текущий словарь команды или NULL, если словаря нет
+    CompressionDict::Ptr dictionary(const QUuidEx& command) const;
+
+    // Устанавливает заранее обученный словарь для команды
+    bool setDictionary(const QUuidEx& command, const QByteArray& data);
+
+    // Объем памяти (в байтах), занимаемый образцами и словарями
+    qint64 memory() const;
+
+private:
+    DISABLE_DEFAULT_COPY(DictStore)
+
+    struct Samples
+    {
+        QVector<QByteArray> frames;
+        int next = {0};
+        qint64 memory = {0};
+    };
+
+    CompressionDict::Ptr addDictionary(const QUuidEx& command, const QByteArray& data);
+
+private:
+    const int _dictSize;
+    const int _maxSamples;
+    const int _level;
+
+    QHash<QUuidEx, Samples> _samples;
+    QHash<QUuidEx, CompressionDict::Ptr> _dicts;
+    mutable QMutex _lock;
+};
+
+class DictCodec
+{
+public:
+    struct Stats
+    {
+        // Количество сообщений, отправленных в сжатом виде
+        quint64 compressed = {0};
+
+        // Количество байт, которые не были переданы благодаря сжатию
+        qint64 bytesSaved = {0};
+
+        // Количество переданных словарей
+        quint64 dictsSent = {0};
+
+        // Количество сообщений, для которых не найден словарь
+        quint64 misses = {0};
+    };
+
+    // Параметр maxSize определяет максимальный размер (в байтах) сообщения,
+    // сжимаемого со словарем (сообщения большего размера сжимаются обычным
+    // способом), maxUncompressedSize - максимальный размер принятого сообщения
+    // после распаковки (0 - размер не ограничивается)
+    DictCodec(const DictStore::Ptr& store, int maxSize, qint32 maxUncompressedSize);
+
+    // Возвращает TRUE если сжатие со словарями доступно в текущей сборке
+    static bool supported();
+
+    // Возвращает TRUE если противоположная сторона поддерживает сжатие
+    // со словарями
+    bool active() const {return _active;}
+
+    // Сообщение для уведомления противоположной стороны о поддержке сжатия
+    // со словарями. Отправляется после проверки совместимости протоколов
+    Message::Ptr hello() const;
+
+    // Выполняет сжатие сериализованного сообщения frame. Возвращает сериали-
+    // зованное сообщение DictFrame, или пустой буфер, если сжатие для сооб-
+    // щения не выполняется
+    QByteArray encode(const Message::Ptr& message, const QByteArray& frame);
+
+    // Обрабатывает сообщение DictFrame. Восстановленные сериализованные
+    // сообщения добавляются в frames,  служебные сообщения для отправки
+    // противоположной стороне добавляются в internal
+    void process(const Message::Ptr&, QList<QByteArray>& frames,
+                 Message::List& internal);
+
+    Stats stats() const {return _stats;}
+
+    // Объем памяти (в байтах), занимаемый принятыми словарями
+    qint64 memory() const;
+
+private:
+    DISABLE_DEFAULT_COPY(DictCodec)
+
+    static QByteArray serialize(const data::DictFrame&);
+
+private:
+    const DictStore::Ptr _store;
+    const int _maxSize;
+    const qint32 _maxUncompressedSize;
+    bool _active = {false};
+
+    // Версии словарей, переданные противоположной стороне
+    QHash<QUuidEx, quint32> _sent;
+
+    // Принятые словари, последняя версия идет первой
+    QHash<QUuidEx, QList<CompressionDict::Ptr>> _received;
+
+    Stats _stats;
+};
+
+} // namespace pproto::transport
@@ -0,0 +1,457 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/event_history.h"
+#include "transport/base.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "EventHistory")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "EventHistory")
+#define log_info_m    alog::logger().info    (alog_line_location, "EventHistory")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "EventHistory")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "EventHistory")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "EventHistory")
+
+namespace pproto::transport {
+
+static_assert(sizeof(QUuidEx) == sizeof(EventHistory::RecordHeader::command),
+              "Unexpected size of QUuidEx");
+
+EventHistory::EventHistory(qint64 maxSize, qint32 maxDuration, SerializeFormat format)
+    : _maxSize(maxSize),
+      _maxDuration(maxDuration),
+      _format(format)
+{}
+
+EventHistory::~EventHistory()
+{
+    close();
+}
+
+bool EventHistory::open(const QString& filePath)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (_file.isOpen())
+    {
+        log_error_m << "History file already open: " << _file.fileName();
+        return false;
+    }
+    if (_maxSize < qint64(sizeof(RecordHeader)))
+    {
+        log_error_m << "Too small size of history buffer: " << _maxSize;
+        return false;
+    }
+
+    reset();
+    _buffer = QByteArray();
+    _data = nullptr;
+    _size = 0;
+
+    const qint64 fileSize = qint64(sizeof(FileHeader)) + _maxSize;
+
+    _file.setFileName(filePath);
+    if (!_file.open(QIODevice::ReadWrite))
+    {
+        log_error_m << "Failed open history file " << filePath
+                    << ". Detail: " << _file.errorString();
+        return false;
+    }
+    const bool sizeMatched = (_file.size() == fileSize);
+    uchar* map = nullptr;
+    if ((!sizeMatched && !_file.resize(fileSize))
+        || (map = _file.map(0, fileSize)) == nullptr)
+    {
+        log_error_m << "Failed map history file " << filePath
+                    << ". Detail: " << _file.errorString();
+        _file.close();
+        return false;
+    }
+
+    _header = reinterpret_cast<FileHeader*>(map);
+    _data = map + sizeof(FileHeader);
+    _size = _maxSize;
+
+    if (sizeMatched && restore())
+    {
+        log_info_m << "History restored from file " << filePath
+                   << ". Records: " << _stats.records;
+        return true;
+    }
+
+    reset();
+    memcpy(_header->magic, "PPEVHIST", sizeof(_header->magic));
+    _header->version = version;
+    _header->headerSize = sizeof(FileHeader);
+    _header->dataSize = _size;
+    syncHeader();
+
+    log_info_m << "History file created: " << filePath;
+    return true;
+}
+
+void EventHistory::close()
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (!_file.isOpen())
+        return;
+
+    syncHeader();
+    _file.unmap(reinterpret_cast<uchar*>(_header));
+    _file.close();
+
+    _header = nullptr;
+    _data = nullptr;
+    _size = 0;
+    reset();
+}
+
+bool EventHistory::add(const Message::Ptr& message)
+{
+    QByteArray frame;
+    switch (_format)
+    {
+#ifdef PPROTO_QBINARY_SERIALIZE
+        case SerializeFormat::QBinary:
+            frame = message->toQBinary();
+            break;
+#endif
+#ifdef PPROTO_JSON_SERIALIZE
+        case SerializeFormat::Json:
+            if (!message->contentIsEmpty()
+                && message->contentFormat() != SerializeFormat::Json)
+            {
+                log_error_m << "For json-history a message content format must be json"
+                            << ". Command: " << CommandNameLog(message->command());
+                return false;
+            }
+            frame = message->toJson();
+            break;
+#endif
+        default:
+            log_error_m << "Unsupported history serialize format: " << _format;
+            return false;
+    }
+
+    const qint64 recordSize =
+        (qint64(sizeof(RecordHeader)) + frame.size() + 7) & ~qint64(7);
+
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (!allocate() || recordSize > _size)
+    {
+        ++_stats.dropped;
+        return false;
+    }
+
+    // Время записей не должно убывать, иначе поиск по временному
+    // диапазону будет выполняться некорректно
+    const qint64 time = qMax(QDateTime::currentMSecsSinceEpoch(), _lastTime);
+    _lastTime = time;
+    evictExpired(time);
+
+    qint64 offset = -1;
+    while (offset < 0)
+    {
+        if (_stats.records == 0)
+            _head = _tail = 0;
+
+        if (_tail > _head || _stats.records == 0)
+        {
+            if (_size - _tail >= recordSize)
+            {
+                offset = _tail;
+            }
+            else if (_head >= recordSize)
+            {
+                // Переход в начало буфера
+                if (_size - _tail >= qint64(sizeof(RecordHeader)))
+                    reinterpret_cast<RecordHeader*>(_data + _tail)->size = 0;
+                offset = 0;
+            }
+            else
+                evict();
+        }
+        else
+        {
+            if (_head - _tail >= recordSize)
+                offset = _tail;
+            else
+                evict();
+        }
+    }
+
+    const QUuidEx command = message->command();
+
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(_data + offset);
+    header->size = quint32(recordSize);
+    header->frameSize = quint32(frame.size());
+    header->time = time;
+    memcpy(header->command, &command, sizeof(header->command));
+    memcpy(_data + offset + sizeof(RecordHeader), frame.constData(), size_t(frame.size()));
+
+    _records[command].push_back(
+        {time, offset + qint64(sizeof(RecordHeader)), qint32(frame.size())});
+
+    _tail = offset + recordSize;
+    _stats.bytes += recordSize;
+    ++_stats.records;
+    syncHeader();
+    return true;
+}
+
+QVector<QByteArray> EventHistory::query(const QUuidEx& command,
+                                        const data::TimeRange& range, int limit)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    evictExpired(QDateTime::currentMSecsSinceEpoch());
+
+    auto it = _records.constFind(command);
+    if (it == _records.constEnd())
+        return {};
+
+    const RecordList& records = it.value();
+    const qint64 begin = range.begin.isValid()
+                         ? range.begin.toMSecsSinceEpoch()
+                         : std::numeric_limits<qint64>::min();
+    const qint64 end = range.end.isValid()
+                       ? range.end.toMSecsSinceEpoch()
+                       : std::numeric_limits<qint64>::max();
+
+    auto first = std::lower_bound(records.begin(), records.end(), begin,
+        [](const Record& r, qint64 time) {return r.time < time;});
+    auto last = std::upper_bound(first, records.end(), end,
+        [](qint64 time, const Record& r) {return time < r.time;});
+
+    if (limit > 0 && (last - first) > limit)
+        first = last - limit;
+
+    QVector<QByteArray> frames;
+    frames.reserve(int(last - first));
+    for (auto r = first; r != last; ++r)
+        frames.append(QByteArray(reinterpret_cast<const char*>(_data + r->offset),
+                                 r->frameSize));
+    return frames;
+}
+
+int EventHistory::send(base::Socket* socket, const QUuidEx& command,
+                       const data::TimeRange& range, int limit)
+{
+    if (socket->messageFormat() != _format)
+    {
+        log_error_m << "Serialize format of socket does not match history format"
+                    << ". Command: " << CommandNameLog(command);
+        return -1;
+    }
+
+    const QVector<QByteArray> frames = query(command, range, limit);
+    if (frames.isEmpty())
+        return 0;
+
+    // Сообщение используется в потоке сокета только для журналирования и
+    // выбора механизмов кодирования кадра, поэтому контент не требуется
+    Message::Ptr message = Message::create(command, _format);
+    message->setType(Message::Type::Event);
+
+    for (const QByteArray& frame : frames)
+        socket->sendEncoded(message, frame);
+
+    log_debug_m << "Events sent from history: " << frames.count()
+                << ". Command: " << CommandNameLog(command);
+    return frames.count();
+}
+
+void EventHistory::clear()
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    reset();
+    syncHeader();
+}
+
+EventHistory::Stats EventHistory::stats() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _stats;
+}
+
+bool EventHistory::allocate()
+{
+    if (_data)
+        return true;
+
+    const qint64 size = qMin(_maxSize, qint64(std::numeric_limits<int>::max() - 1024));
+    if (size < qint64(sizeof(RecordHeader)))
+        return false;
+
+    _buffer.resize(int(size));
+    _data = reinterpret_cast<uchar*>(_buffer.data());
+    _size = size;
+    return true;
+}
+
+void EventHistory::reset()
+{
+    _records.clear();
+    _head = _tail = 0;
+    _lastTime = 0;
+    _stats.records = 0;
+    _stats.bytes = 0;
+}
+
+bool EventHistory::restore()
+{
+    if (memcmp(_header->magic, "PPEVHIST", sizeof(_header->magic)) != 0
+        || _header->version != version
+        || _header->headerSize != sizeof(FileHeader)
+        || _header->dataSize != _size
+        || _header->head < 0 || _header->head > _size
+        || _header->tail < 0 || _header->tail > _size)
+    {
+        return false;
+    }
+
+    reset();
+    _head = _header->head;
+    _tail = _header->tail;
+
+    // Записи восстанавливаются от наиболее старой к наиболее новой. Допуска-
+    // ется не более одного перехода в начало буфера
+    qint64 offset = _head;
+    bool wrapped = false;
+    while (_stats.records < _header->records)
+    {
+        RecordHeader* header = recordHeader(offset);
+        if (header == nullptr)
+        {
+            if (wrapped)
+                return false;
+            wrapped = true;
+            offset = 0;
+            continue;
+        }
+        if (header->size < sizeof(RecordHeader)
+            || qint64(header->size) > _size - offset
+            || header->frameSize > header->size - quint32(sizeof(RecordHeader))
+            || header->time < _lastTime)
+        {
+            return false;
+        }
+
+        QUuidEx command;
+        memcpy(&command, header->command, sizeof(header->command));
+        _records[command].push_back(
+            {header->time, offset + qint64(sizeof(RecordHeader)), qint32(header->frameSize)});
+
+        _lastTime = header->time;
+        _stats.bytes += header->size;
+        ++_stats.records;
+        offset += header->size;
+    }
+    if (offset != _tail)
+        return false;
+
+    if (_stats.records == 0)
+        _head = _tail = 0;
+
+    evictExpired(QDateTime::currentMSecsSinceEpoch());
+    return true;
+}
+
+void EventHistory::evict()
+{
+    RecordHeader* header = recordHeader(_head);
+    if (header == nullptr)
+    {
+        _head = 0;
+        header = recordHeader(_head);
+    }
+
+    QUuidEx command;
+    memcpy(&command, header->command, sizeof(header->command));
+
+    auto it = _records.find(command);
+    if (it != _records.end())
+    {
+        it->pop_front();
+        if (it->empty())
+            _records.erase(it);
+    }
+
+    _head += header->size;
+    _stats.bytes -= header->size;
+    --_stats.records;
+    ++_stats.evicted;
+
+    if (_stats.records == 0)
+        _head = _tail = 0;
+}
+
+void EventHistory::evictExpired(qint64 time)
+{
+    if (_maxDuration <= 0)
+        return;
+
+    const qint64 minTime = time - qint64(_maxDuration) * 1000;
+    while (_stats.records != 0)
+    {
+        RecordHeader* header = recordHeader(_head);
+        if (header == nullptr)
+            header = recordHeader(0);
+
+        if (header->time >= minTime)
+            break;
+        evict();
+    }
+}
+
+void EventHistory::syncHeader()
+{
+    if (_header)
+    {
+        _header->head = _head;
+        _header->tail = _tail;
+        _header->records = _stats.records;
+    }
+}
+
+EventHistory::RecordHeader* EventHistory::recordHeader(qint64 offset) const
+{
+    if (_size - offset < qint64(sizeof(RecordHeader)))
+        return nullptr;
+
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(_data + offset);
+    return (header->size != 0) ? header : nullptr;
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,182 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  История событий, отправленных сервером.
+
+  Сообщения с типом Event, отправляемые листенером (см. Listener::send()),
+  сохраняются в сериализованном виде в кольцевом буфере. Сохраняются только
+  сообщения команд, для которых разрешено ведение истории (см.  command::
+  Pool::setEventHistory()). Сообщения сериализуются один раз при добавлении
+  в историю, поэтому при запросе истории за временной диапазон кадры пере-
+  даются в сокет без повторной сериализации (см. SocketCommon::sendEncoded())
+  и без обращения к базе данных.
+
+  Размер истории ограничивается объемом буфера (в байтах) и длительностью
+  хранения (в секундах). При превышении любого из ограничений удаляются
+  наиболее старые записи. Буфер может размещаться  в  памяти  процесса,
+  либо в отображаемом в память файле (см. open()). Во втором случае  исто-
+  рия сохраняется при перезапуске программы.
+
+  Все кадры истории сериализованы в одном формате (см. format()), история
+  передается только сокетам с тем же форматом сериализации сообщений.
+  Класс является потокозащищенным.
+
+  Формат буфера (порядок байт соответствует платформе):
+    FileHeader                 заголовок (только для файла)
+    RecordHeader + frame       записи, выровненные на 8 байт
+  Запись с нулевым размером (RecordHeader::size) означает, что следующая
+  запись расположена в начале буфера.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/time_range.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+
+#include <QtCore>
+#include <deque>
+
+namespace pproto::transport {
+
+namespace base {class Socket;}
+
+class EventHistory : public clife_base
+{
+public:
+    typedef clife_ptr<EventHistory> Ptr;
+
+    struct FileHeader
+    {
+        char    magic[8];   // "PPEVHIST"
+        quint32 version;
+        quint32 headerSize; // sizeof(FileHeader)
+        qint64  dataSize;   // Размер области записей
+        qint64  head;       // Смещение наиболее старой записи
+        qint64  tail;       // Смещение для следующей записи
+        qint64  records;    // Количество записей
+    };
+
+    struct RecordHeader
+    {
+        quint32 size;       // Размер записи с учетом заголовка и выравнивания
+        quint32 frameSize;  // Размер кадра
+        qint64  time;       // Время добавления (UTC, в миллисекундах)
+        char    command[16];
+    };
+
+    struct Stats
+    {
+        int     records = {0}; // Количество записей в истории
+        qint64  bytes = {0};   // Объем буфера, занятый записями
+        quint64 evicted = {0}; // Количество удаленных записей
+        quint64 dropped = {0}; // Количество сообщений, не добавленных в историю
+    };
+
+    static const quint32 version = 1;
+
+    // Параметр maxSize определяет размер буфера (в байтах), параметр maxDura-
+    // tion - длительность хранения записей (в секундах), значение 0 не огра-
+    // ничивает длительность хранения
+    EventHistory(qint64 maxSize = 64*1024*1024, qint32 maxDuration = 3600,
+                 SerializeFormat format = SerializeFormat::QBinary);
+    ~EventHistory();
+
+    // Размещает буфер в отображаемом в память файле. Если файл содержит исто-
+    // рию с тем же размером буфера, то история восстанавливается, в против-
+    // ном случае файл создается заново. Записи, добавленные до вызова функции,
+    // удаляются
+    bool open(const QString& filePath);
+
+    // Закрывает файл, после чего буфер размещается в памяти процесса
+    void close();
+
+    SerializeFormat format() const {return _format;}
+
+    // Добавляет событие в историю
+    bool add(const Message::Ptr&);
+
+    // Возвращает сериализованные события команды command, добавленные в исто-
+    // рию в течении временного диапазона range. Невалидное значение начала
+    // или окончания диапазона означает отсутствие соответствующей границы.
+    // Параметр limit ограничивает количество возвращаемых событий (возвраща-
+    // ются наиболее новые), значение 0 не ограничивает количество событий
+    QVector<QByteArray> query(const QUuidEx& command, const data::TimeRange& range,
+                              int limit = 0);
+
+    // Передает в сокет события, выбранные аналогично функции query(), в по-
+    // рядке их добавления в историю.  Возвращает количество переданных
+    // событий, или -1 если формат сериализации сокета не совпадает с форма-
+    // том истории
+    int send(base::Socket*, const QUuidEx& command, const data::TimeRange& range,
+             int limit = 0);
+
+    // Удаляет все записи
+    void clear();
+
+    Stats stats() const;
+
+private:
+    DISABLE_DEFAULT_COPY(EventHistory)
+
+    struct Record
+    {
+        qint64 time;
+        qint64 offset;      // Смещение кадра
+        qint32 frameSize;
+    };
+    typedef std::deque<Record> RecordList;
+
+    bool allocate();
+    void reset();
+    bool restore();
+    void evict();
+    void evictExpired(qint64 time);
+    void syncHeader();
+    RecordHeader* recordHeader(qint64 offset) const;
+
+private:
+    const qint64 _maxSize;
+    const qint32 _maxDuration;
+    const SerializeFormat _format;
+
+    QFile _file;
+    FileHeader* _header = {nullptr};
+    QByteArray _buffer;
+
+    uchar* _data = {nullptr};
+    qint64 _size = {0};
+    qint64 _head = {0};
+    qint64 _tail = {0};
+    qint64 _lastTime = {0};
+
+    QHash<QUuidEx, RecordList> _records;
+    Stats _stats;
+    mutable QMutex _lock;
+};
+
+} // namespace pproto::transport
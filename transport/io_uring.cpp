@@ -0,0 +1,202 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/io_uring.h"
+
+#ifdef IO_URING_TRANSPORT
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <cerrno>
+#include <cstring>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "IoUring")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "IoUring")
+#define log_info_m    alog::logger().info    (alog_line_location, "IoUring")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "IoUring")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "IoUring")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "IoUring")
+
+namespace pproto::transport {
+
+namespace {
+
+// Максимальное количество операций, ожидающих освобождения буферов
+const int maxInflight = 64;
+
+// Время (в миллисекундах) ожидания уведомлений об освобождении буферов
+// при завершении работы io_uring
+const int notifTimeout = 1000;
+
+} // namespace
+
+IoUring::IoUring(unsigned entries)
+{
+    int res = io_uring_queue_init(entries, &_ring, 0);
+    if (res < 0)
+    {
+        log_verbose_m << "io_uring is not available: " << strerror(-res)
+                      << ". Regular socket write will be used";
+        return;
+    }
+    _valid = true;
+}
+
+IoUring::~IoUring()
+{
+    invalidate();
+}
+
+qint64 IoUring::sendmsg(int fd, const msghdr* msg, const QVector<QByteArray>& buffers)
+{
+    if (!_valid)
+        return -1;
+
+    // Ограничиваем количество удерживаемых буферов
+    reap(false);
+    while (_inflight.count() >= maxInflight)
+        if (!reap(true))
+            return -1;
+
+    io_uring_sqe* sqe = io_uring_get_sqe(&_ring);
+    if (sqe == nullptr)
+        return -1;
+
+    const quint64 id = _nextId++;
+    io_uring_prep_sendmsg_zc(sqe, fd, msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    io_uring_sqe_set_data64(sqe, id);
+
+    int res = io_uring_submit(&_ring);
+    if (res < 0)
+    {
+        log_error_m << "Failed submit of send operation: " << strerror(-res);
+        invalidate();
+        return -1;
+    }
+
+    _inflight.insert(id, buffers);
+    _sendId = id;
+    _sendDone = false;
+    while (!_sendDone)
+        if (!reap(true))
+            return -1;
+
+    if (_sendResult == -EINVAL || _sendResult == -EOPNOTSUPP)
+    {
+        log_verbose_m << "Zero-copy send is not supported: " << strerror(int(-_sendResult))
+                      << ". Regular socket write will be used";
+        invalidate();
+        return -1;
+    }
+
+    // При ошибке (в том числе EAGAIN) данные будут переданы через буфер
+    // записи сокета, ошибка соединения будет обработана штатно
+    return (_sendResult > 0) ? _sendResult : 0;
+}
+
+bool IoUring::reap(bool wait)
+{
+    io_uring_cqe* cqe = nullptr;
+    int res = (wait) ? io_uring_wait_cqe(&_ring, &cqe)
+                     : io_uring_peek_cqe(&_ring, &cqe);
+    while (res == 0 && cqe)
+    {
+        const quint64 id = io_uring_cqe_get_data64(cqe);
+        const unsigned flags = cqe->flags;
+        const int result = cqe->res;
+        io_uring_cqe_seen(&_ring, cqe);
+
+        if (id == _sendId && !(flags & IORING_CQE_F_NOTIF))
+        {
+            _sendResult = result;
+            _sendDone = true;
+        }
+
+        // Уведомление не будет получено, если в событии результата
+        // отсутствует флаг IORING_CQE_F_MORE
+        if ((flags & IORING_CQE_F_NOTIF) || !(flags & IORING_CQE_F_MORE))
+            _inflight.remove(id);
+
+        cqe = nullptr;
+        res = io_uring_peek_cqe(&_ring, &cqe);
+    }
+    if (res < 0 && res != -EAGAIN)
+    {
+        if (res == -EINTR)
+            return true;
+
+        log_error_m << "Failed wait of completion: " << strerror(-res);
+        invalidate();
+        return false;
+    }
+    return true;
+}
+
+void IoUring::invalidate()
+{
+    if (!_valid)
+        return;
+
+    _valid = false;
+
+    // Буферы не могут быть освобождены до получения уведомлений, даже после
+    // завершения работы io_uring ядро может обращаться к ним при повторной
+    // передаче данных. Ожидание уведомлений ограничено по времени
+    QElapsedTimer timer;
+    timer.start();
+    while (!_inflight.isEmpty() && !timer.hasExpired(notifTimeout))
+    {
+        __kernel_timespec ts {0, 10*1000*1000};
+        io_uring_cqe* cqe = nullptr;
+        int res = io_uring_wait_cqe_timeout(&_ring, &cqe, &ts);
+        if (res == -ETIME || res == -EINTR)
+            continue;
+        if (res < 0)
+            break;
+
+        const quint64 id = io_uring_cqe_get_data64(cqe);
+        const unsigned flags = cqe->flags;
+        io_uring_cqe_seen(&_ring, cqe);
+
+        if ((flags & IORING_CQE_F_NOTIF) || !(flags & IORING_CQE_F_MORE))
+            _inflight.remove(id);
+    }
+    io_uring_queue_exit(&_ring);
+
+    // Буферы операций, для которых уведомления не получены, намеренно
+    // не освобождаются
+    if (!_inflight.isEmpty())
+    {
+        log_warn_m << "Zero-copy notifications not received for "
+                   << _inflight.count() << " operations. Buffers are leaked";
+        new QHash<quint64, QVector<QByteArray>>(std::move(_inflight));
+        _inflight.clear();
+    }
+}
+
+} // namespace pproto::transport
+
+#endif // IO_URING_TRANSPORT
@@ -0,0 +1,103 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Отправка данных в сокет посредством io_uring с нулевым копированием
+  (IORING_OP_SENDMSG_ZC, Linux 6.1 и выше).
+
+  TCP и Local сокеты реализованы на базе QTcpSocket/QLocalSocket, которые
+  владеют файловым дескриптором и выполняют чтение данных в рамках своего
+  цикла обработки событий. Поэтому io_uring используется только для отправки
+  больших сообщений в тот момент, когда буфер записи Qt-сокета пуст (см.
+  base::Socket::socketWriteV()). Операция ожидает только результат отправки;
+  уведомления об освобождении буферов обрабатываются при последующих
+  вызовах, до этого момента буферы удерживаются экземпляром класса. Поэтому
+  все передаваемые буферы должны владеть своей памятью (не допускается
+  использование QByteArray::fromRawData() для временных данных).
+
+  Если io_uring недоступен (ядро не поддерживает io_uring или операцию
+  нулевого копирования), функция sendmsg() возвращает -1, и данные должны
+  быть отправлены обычным способом.
+
+  Механизм доступен при сборке с параметром IO_URING_TRANSPORT (требуется
+  библиотека liburing). Экземпляр класса используется только в потоке сокета
+  и не является потокозащищенным.
+*****************************************************************************/
+
+#pragma once
+
+#ifdef IO_URING_TRANSPORT
+
+#include "shared/defmac.h"
+
+#include <QtCore>
+#include <liburing.h>
+
+namespace pproto::transport {
+
+class IoUring
+{
+public:
+    IoUring(unsigned entries = 32);
+    ~IoUring();
+
+    // Возвращает TRUE если io_uring инициализирован и поддерживает отправку
+    // с нулевым копированием
+    bool isValid() const {return _valid;}
+
+    // Отправляет данные, описанные в msg, с нулевым копированием. Параметр
+    // buffers содержит буферы, на которые ссылается msg, они удерживаются
+    // до получения уведомления об их освобождении. Возвращает количество
+    // отправленных байт, или -1 если отправка с нулевым копированием
+    // невозможна
+    qint64 sendmsg(int fd, const msghdr* msg, const QVector<QByteArray>& buffers);
+
+private:
+    DISABLE_DEFAULT_COPY(IoUring)
+
+    // Обрабатывает уведомления об освобождении буферов. Если wait равен TRUE,
+    // то ожидает хотя бы одно событие
+    bool reap(bool wait);
+
+    // Завершает работу io_uring. Буферы удерживаются до получения уведом-
+    // лений об их освобождении, если уведомления не получены, то буферы
+    // не освобождаются
+    void invalidate();
+
+private:
+    io_uring _ring;
+    bool _valid = {false};
+
+    quint64 _nextId = {1};
+    QHash<quint64, QVector<QByteArray>> _inflight;
+
+    // Результат операции отправки, ожидаемой функцией sendmsg()
+    quint64 _sendId = {0};
+    qint64 _sendResult = {0};
+    bool _sendDone = {false};
+};
+
+} // namespace pproto::transport
+
+#endif // IO_URING_TRANSPORT
@@ -0,0 +1,70 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/load_meter.h"
+#include <climits>
+
+namespace pproto::transport {
+
+void LoadMeter::commandReceived()
+{
+    _inflight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadMeter::answerSent(qint64 latency)
+{
+    _inflight.fetch_sub(1, std::memory_order_relaxed);
+
+    const quint32 sample = quint32(qBound(qint64(0), latency, qint64(INT_MAX)));
+
+    // Экспоненциальное сглаживание с коэффициентом 1/8. Значение обновляется
+    // из потоков нескольких сокетов, поэтому используется CAS-цикл
+    quint32 value = _latency.load(std::memory_order_relaxed);
+    quint32 ewma;
+    do {
+        ewma = (value == 0) ? sample
+                            : quint32(qint64(value) + (qint64(sample) - qint64(value)) / 8);
+    } while (!_latency.compare_exchange_weak(value, ewma, std::memory_order_relaxed));
+}
+
+void LoadMeter::discard(int count)
+{
+    _inflight.fetch_sub(count, std::memory_order_relaxed);
+}
+
+quint32 LoadMeter::inflight() const
+{
+    return quint32(qMax(_inflight.load(std::memory_order_relaxed), 0));
+}
+
+data::LoadReport LoadMeter::report() const
+{
+    data::LoadReport loadReport;
+    loadReport.inflight = inflight();
+    loadReport.latency = latency();
+    return loadReport;
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,81 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Измеритель загруженности обработчиков команд на стороне сервера.
+
+  Сокет листенера учитывает команды, переданные в обработчики, и время от
+  получения команды до отправки ответа на нее. Сглаженное время обработки
+  и количество команд, ожидающих ответа, передаются клиенту в ответе на
+  команду EchoConnection (см. data::LoadReport) и используются балансиров-
+  щиком на клиентской стороне (см. transport/balancer.h).
+  Один экземпляр измерителя должен использоваться всеми сокетами листенера.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/base.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+
+#include <QtCore>
+#include <atomic>
+
+namespace pproto::transport {
+
+class LoadMeter : public clife_base
+{
+public:
+    typedef clife_ptr<LoadMeter> Ptr;
+
+    LoadMeter() = default;
+
+    // Команда передана в обработчик
+    void commandReceived();
+
+    // Отправлен ответ на команду, latency - время обработки (в микросекундах)
+    void answerSent(qint64 latency);
+
+    // Команды, ответ на которые не будет отправлен (например, при разрыве
+    // соединения)
+    void discard(int count);
+
+    // Количество команд, ожидающих ответа
+    quint32 inflight() const;
+
+    // Сглаженное время обработки команды (в микросекундах)
+    quint32 latency() const {return _latency.load(std::memory_order_relaxed);}
+
+    data::LoadReport report() const;
+
+private:
+    DISABLE_DEFAULT_COPY(LoadMeter)
+
+    std::atomic<qint32>  _inflight = {0};
+    std::atomic<quint32> _latency  = {0};
+};
+
+} // namespace pproto::transport
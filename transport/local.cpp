@@ -203,11 +203,12 @@ void Socket::socketClose()
     _socket.reset();
 }
 
-void Socket::messageInit(Message::Ptr& message)
+ConnectionContext::Ptr Socket::createConnectionContext()
 {
-    message->setSocketType(SocketType::Local);
-    message->setSocketDescriptor(_socket->socketDescriptor());
-    message->setSocketName(_socket->serverName());
+    return ConnectionContext::Ptr(new ConnectionContext(
+        SocketType::Local, _socket->socketDescriptor(),
+        HostPoint(), _socket->serverName(),
+        messageFormat(), encryption()));
 }
 
 void Socket::fillUnknownMessage(const Message::Ptr& message, data::Unknown& unknown)
@@ -78,7 +78,7 @@ private:
     bool   socketWaitForBytesWritten(int msecs) override;
     void   socketClose() override;
 
-    void messageInit(Message::Ptr&) override;
+    ConnectionContext::Ptr createConnectionContext() override;
     void fillUnknownMessage(const Message::Ptr&, data::Unknown&) override;
 
 private:
@@ -0,0 +1,55 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/memory_budget.h"
+
+namespace pproto::transport {
+
+MemoryBudget::MemoryBudget(qint64 limit)
+    : _limit(limit)
+{}
+
+bool MemoryBudget::acquire(qint64 size)
+{
+    qint64 used = _used.load(std::memory_order_relaxed);
+    do
+    {
+        if (used + size > _limit)
+        {
+            _rejects.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    while (!_used.compare_exchange_weak(used, used + size, std::memory_order_relaxed));
+
+    return true;
+}
+
+void MemoryBudget::release(qint64 size)
+{
+    _used.fetch_sub(size, std::memory_order_relaxed);
+}
+
+} // namespace pproto::transport
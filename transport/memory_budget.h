@@ -0,0 +1,79 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Общий бюджет памяти для буферов приема сообщений.
+
+  Сокет резервирует в бюджете размер каждого принимаемого кадра до выделе-
+  ния буфера под него и освобождает резерв после передачи сообщений кадра
+  в обработчики. Если бюджет исчерпан, то сокет приостанавливает чтение
+  данных до освобождения памяти другими сокетами, при этом ограничение
+  скорости передачи данных обеспечивается механизмами TCP. Один экземпляр
+  бюджета используется всеми сокетами листенера.
+*****************************************************************************/
+
+#pragma once
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+
+#include <QtCore>
+#include <atomic>
+
+namespace pproto::transport {
+
+class MemoryBudget : public clife_base
+{
+public:
+    typedef clife_ptr<MemoryBudget> Ptr;
+
+    // Параметр limit определяет размер бюджета (в байтах)
+    MemoryBudget(qint64 limit);
+
+    // Резервирует size байт. Возвращает FALSE если размер бюджета будет
+    // превышен, в этом случае резервирование не выполняется
+    bool acquire(qint64 size);
+
+    // Освобождает ранее зарезервированные size байт
+    void release(qint64 size);
+
+    // Размер бюджета
+    qint64 limit() const {return _limit;}
+
+    // Количество зарезервированных байт
+    qint64 used() const {return _used.load(std::memory_order_relaxed);}
+
+    // Количество отказов в резервировании
+    quint64 rejects() const {return _rejects.load(std::memory_order_relaxed);}
+
+private:
+    DISABLE_DEFAULT_FUNC(MemoryBudget)
+
+    const qint64 _limit;
+    std::atomic<qint64>  _used    = {0};
+    std::atomic<quint64> _rejects = {0};
+};
+
+} // namespace pproto::transport
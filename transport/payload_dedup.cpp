@@ -0,0 +1,334 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/payload_dedup.h"
+#include "serialize/functions.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+#include "shared/qt/stream_init.h"
+
+#include <QCryptographicHash>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "PayloadDedup")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "PayloadDedup")
+#define log_info_m    alog::logger().info    (alog_line_location, "PayloadDedup")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "PayloadDedup")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "PayloadDedup")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "PayloadDedup")
+
+#ifdef PPROTO_QBINARY_SERIALIZE
+
+namespace pproto::transport {
+
+namespace {
+
+// Количество обработанных сообщений Ref, после которого принимающая сторона
+// отправляет подтверждение RefAck
+const quint32 refAckBatch = 32;
+
+} // namespace
+
+//------------------------------ PayloadDedup::Cache -------------------------
+
+PayloadDedup::Entry* PayloadDedup::Cache::find(const QByteArray& hash)
+{
+    auto it = index.find(hash);
+    if (it == index.end())
+        return nullptr;
+
+    EntryList::iterator entry = it.value();
+    if (entry != entries.begin())
+        entries.splice(entries.begin(), entries, entry);
+
+    return &(*entry);
+}
+
+bool PayloadDedup::Cache::insert(const QByteArray& hash, const QByteArray& content)
+{
+    if (find(hash))
+        return true;
+
+    // Правило должно быть одинаковым для обеих сторон соединения,
+    // иначе кеши рассинхронизируются
+    qint64 size = hash.size() + content.size();
+    if (size > maxMemory / 4)
+        return false;
+
+    entries.push_front({hash, content, false});
+    index.insert(hash, entries.begin());
+    memory += size;
+
+    while (memory > maxMemory && !entries.empty())
+    {
+        const Entry& last = entries.back();
+        memory -= last.hash.size() + last.content.size();
+        index.remove(last.hash);
+        entries.pop_back();
+    }
+    return true;
+}
+
+//-------------------------------- PayloadDedup ------------------------------
+
+PayloadDedup::PayloadDedup(int threshold, qint64 cacheSize)
+    : _threshold(threshold),
+      _cacheSize(cacheSize)
+{
+    _received.maxMemory = _cacheSize;
+}
+
+Message::Ptr PayloadDedup::hello() const
+{
+    data::PayloadDedup payloadDedup;
+    payloadDedup.mode = data::PayloadDedup::Mode::Hello;
+    payloadDedup.cacheSize = quint64(_cacheSize);
+
+    Message::Ptr message =
+        createMessage(payloadDedup, {Message::Type::Event, SerializeFormat::QBinary});
+    message->setPriority(Message::Priority::High);
+    return message;
+}
+
+QByteArray PayloadDedup::encode(const Message::Ptr& message, const QByteArray& frame)
+{
+    const int contentSize = message->contentRawSize();
+    if (!_active
+        || message->type() != Message::Type::Event
+        || contentSize < _threshold
+        || frame.size() < contentSize + int(sizeof(quint32)))
+    {
+        return {};
+    }
+
+    // Контент является последним полем сериализованного сообщения
+    // (см. Message::toDataStream())
+    const int headerSize = frame.size() - contentSize - int(sizeof(quint32));
+    const char* content = frame.constData() + frame.size() - contentSize;
+
+    data::PayloadDedup payloadDedup;
+    payloadDedup.hash = contentHash(content, contentSize);
+    payloadDedup.header = frame.left(headerSize);
+
+    Entry* entry = _sent.find(payloadDedup.hash);
+    if (entry && entry->acked)
+    {
+        payloadDedup.mode = data::PayloadDedup::Mode::Ref;
+        ++_stats.refsSent;
+        _stats.bytesSaved += contentSize;
+
+        // Контент удерживается до подтверждения обработки сообщения,
+        // чтобы при промахе его можно было отправить повторно
+        Pinned& pinned = _pinned[payloadDedup.hash];
+        if (pinned.count++ == 0)
+        {
+            pinned.content = entry->content;
+            _pinnedMemory += payloadDedup.hash.size() + pinned.content.size();
+        }
+        _refs.push_back(payloadDedup.hash);
+    }
+    else
+    {
+        payloadDedup.mode = data::PayloadDedup::Mode::Store;
+        payloadDedup.content = frame.right(contentSize);
+        if (entry == nullptr)
+            _sent.insert(payloadDedup.hash, payloadDedup.content);
+    }
+    return serialize(payloadDedup);
+}
+
+void PayloadDedup::process(const Message::Ptr& message, QList<QByteArray>& frames,
+                           Message::List& internal)
+{
+    data::PayloadDedup payloadDedup;
+    readFromMessage(message, payloadDedup);
+    if (!payloadDedup.dataIsValid)
+        return;
+
+    auto internalMessage = [&internal](const data::PayloadDedup& data)
+    {
+        Message::Ptr m =
+            createMessage(data, {Message::Type::Event, SerializeFormat::QBinary});
+        m->setPriority(Message::Priority::High);
+        internal.add(m.detach());
+    };
+
+    switch (payloadDedup.mode)
+    {
+        case data::PayloadDedup::Mode::Hello:
+        {
+            _active = true;
+            _sent.maxMemory = qint64(payloadDedup.cacheSize);
+            log_verbose_m << "Payload deduplication is active"
+                          << ". Remote cache size: " << payloadDedup.cacheSize;
+            break;
+        }
+        case data::PayloadDedup::Mode::Store:
+        {
+            const QByteArray& content = payloadDedup.content;
+            if (contentHash(content.constData(), content.size()) != payloadDedup.hash)
+            {
+                log_error_m << "Content hash mismatch. Content not cached";
+            }
+            else if (_received.insert(payloadDedup.hash, content))
+            {
+                data::PayloadDedup ack;
+                ack.mode = data::PayloadDedup::Mode::Ack;
+                ack.hashes.append(payloadDedup.hash);
+                internalMessage(ack);
+            }
+            frames.append(makeFrame(payloadDedup.header, content));
+            break;
+        }
+        case data::PayloadDedup::Mode::Ref:
+        {
+            if (Entry* entry = _received.find(payloadDedup.hash))
+            {
+                frames.append(makeFrame(payloadDedup.header, entry->content));
+            }
+            else
+            {
+                log_warn_m << "Content not found in cache. Content will be requested";
+                ++_stats.misses;
+
+                data::PayloadDedup miss;
+                miss.mode = data::PayloadDedup::Mode::Miss;
+                miss.hash = payloadDedup.hash;
+                miss.header = payloadDedup.header;
+                internalMessage(miss);
+            }
+
+            // Подтверждение отправляется после уведомления Miss, поэтому
+            // отправляющая сторона получит его после обработки промаха
+            if (++_refsProcessed >= refAckBatch)
+            {
+                data::PayloadDedup refAck;
+                refAck.mode = data::PayloadDedup::Mode::RefAck;
+                refAck.refs = _refsProcessed;
+                internalMessage(refAck);
+                _refsProcessed = 0;
+            }
+            break;
+        }
+        case data::PayloadDedup::Mode::Ack:
+        {
+            // Поиск без изменения порядка элементов, порядок изменяется
+            // только при отправке сообщений
+            for (const QByteArray& hash : payloadDedup.hashes)
+            {
+                auto it = _sent.index.find(hash);
+                if (it != _sent.index.end())
+                    it.value()->acked = true;
+            }
+            break;
+        }
+        case data::PayloadDedup::Mode::Miss:
+        {
+            QByteArray content;
+            auto pinned = _pinned.constFind(payloadDedup.hash);
+            if (pinned != _pinned.constEnd())
+            {
+                content = pinned->content;
+            }
+            else
+            {
+                auto it = _sent.index.find(payloadDedup.hash);
+                if (it == _sent.index.end())
+                {
+                    log_error_m << "Content for remote side not found"
+                                << ". Message cannot be restored";
+                    break;
+                }
+                content = it.value()->content;
+            }
+
+            data::PayloadDedup store;
+            store.mode = data::PayloadDedup::Mode::Store;
+            store.hash = payloadDedup.hash;
+            store.header = payloadDedup.header;
+            store.content = content;
+
+            // Принимающая сторона выполнит вставку при получении сообщения
+            // Store, поэтому зеркало обновляется сейчас же той же операцией
+            _sent.insert(store.hash, store.content);
+            internalMessage(store);
+            break;
+        }
+        case data::PayloadDedup::Mode::RefAck:
+        {
+            for (quint32 i = 0; i < payloadDedup.refs && !_refs.empty(); ++i)
+            {
+                auto it = _pinned.find(_refs.front());
+                if (it != _pinned.end() && --it->count == 0)
+                {
+                    _pinnedMemory -= it.key().size() + it->content.size();
+                    _pinned.erase(it);
+                }
+                _refs.pop_front();
+            }
+            break;
+        }
+        default:
+            log_error_m << "Unknown mode of payload deduplication";
+    }
+}
+
+PayloadDedup::Stats PayloadDedup::stats() const
+{
+    Stats stats = _stats;
+    stats.refsInFlight = int(_refs.size());
+    return stats;
+}
+
+QByteArray PayloadDedup::contentHash(const char* data, int size)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, size),
+                                    QCryptographicHash::Sha1);
+}
+
+QByteArray PayloadDedup::makeFrame(const QByteArray& header, const QByteArray& content)
+{
+    QByteArray frame;
+    frame.reserve(header.size() + int(sizeof(quint32)) + content.size());
+    frame.append(header);
+    { //Block for QDataStream
+        QDataStream stream {&frame, QIODevice::WriteOnly | QIODevice::Append};
+        STREAM_INIT(stream);
+        stream << content;
+    }
+    return frame;
+}
+
+QByteArray PayloadDedup::serialize(const data::PayloadDedup& payloadDedup)
+{
+    Message::Ptr message =
+        createMessage(payloadDedup, {Message::Type::Event, SerializeFormat::QBinary});
+    return message->toQBinary();
+}
+
+} // namespace pproto::transport
+
+#endif // PPROTO_QBINARY_SERIALIZE
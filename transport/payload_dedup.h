@@ -0,0 +1,169 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Дедупликация контента сообщений в рамках одного соединения.
+
+  Отправляющая сторона вычисляет хеш контента сообщений, размер  которого
+  превышает заданный порог. Если принимающая сторона ранее  подтвердила
+  сохранение контента с таким хешем, то вместо  контента  отправляется
+  только ссылка на него  (режим Ref).  В противном случае контент переда-
+  ется полностью с требованием сохранить его в кеше (режим Store).
+
+  Кеш принимающей стороны и его "зеркало" на отправляющей стороне  имеют
+  одинаковый размер и одинаковую LRU-политику,  а  обращения  к  кешу
+  выполняются в одном и том же порядке (порядок сообщений в TCP/Local
+  соединении сохраняется). Поэтому промахи при обращении  к  кешу  на
+  принимающей стороне возникают только в исключительных ситуациях.
+  При промахе принимающая сторона отправляет уведомление Miss, и отправ-
+  ляющая сторона повторно передает сообщение с контентом. Контент сообще-
+  ний, отправленных со ссылкой, удерживается отправляющей стороной  до
+  подтверждения их обработки (уведомление RefAck), поэтому на уведомление
+  Miss всегда может быть отправлен ответ.
+
+  Восстановленное после промаха сообщение поступает в обработку позже
+  сообщений, отправленных вслед за ним. Поэтому ссылки на контент исполь-
+  зуются только для сообщений с типом Event, для которых порядок следо-
+  вания не гарантируется. Команды и ответы передаются без дедупликации.
+
+  Механизм работает только с бинарным форматом сериализации сообщений.
+  Экземпляр класса используется только в потоке сокета и не является
+  потокозащищенным.
+*****************************************************************************/
+
+#pragma once
+
+#include "commands/base.h"
+
+#include "shared/defmac.h"
+#include <QtCore>
+#include <deque>
+#include <list>
+
+namespace pproto::transport {
+
+class PayloadDedup
+{
+public:
+    struct Stats
+    {
+        // Количество сообщений отправленных со ссылкой на контент
+        quint64 refsSent = {0};
+
+        // Количество байт, которые не были переданы благодаря дедупликации
+        quint64 bytesSaved = {0};
+
+        // Количество промахов на принимающей стороне
+        quint64 misses = {0};
+
+        // Количество сообщений со ссылкой, обработка которых еще не подтвер-
+        // ждена принимающей стороной
+        int refsInFlight = {0};
+    };
+
+    // Параметр threshold определяет минимальный размер контента (в байтах),
+    // для которого выполняется дедупликация. Параметр cacheSize определяет
+    // размер кеша (в байтах) на принимающей стороне
+    PayloadDedup(int threshold, qint64 cacheSize);
+
+    // Возвращает TRUE если противоположная сторона поддерживает дедупликацию
+    bool active() const {return _active;}
+
+    // Сообщение для уведомления противоположной стороны о поддержке дедупли-
+    // кации. Отправляется после проверки совместимости протоколов
+    Message::Ptr hello() const;
+
+    // Выполняет дедупликацию сериализованного сообщения frame. Возвращает
+    // сериализованное сообщение PayloadDedup, или пустой буфер, если дедуп-
+    // ликация для сообщения не выполняется
+    QByteArray encode(const Message::Ptr& message, const QByteArray& frame);
+
+    // Обрабатывает сообщение PayloadDedup. Восстановленные сериализованные
+    // сообщения добавляются в frames,  служебные сообщения для отправки
+    // противоположной стороне добавляются в internal
+    void process(const Message::Ptr&, QList<QByteArray>& frames,
+                 Message::List& internal);
+
+    Stats stats() const;
+
+    // Объем памяти (в байтах), занимаемый кешем контента, его зеркалом
+    // и контентом сообщений со ссылкой, обработка которых не подтверждена
+    qint64 memory() const {return _sent.memory + _received.memory + _pinnedMemory;}
+
+private:
+    DISABLE_DEFAULT_COPY(PayloadDedup)
+
+    struct Entry
+    {
+        QByteArray hash;
+        QByteArray content;
+        bool acked = {false};
+    };
+    typedef std::list<Entry> EntryList;
+
+    // LRU-кеш контента. На отправляющей стороне является зеркалом кеша
+    // принимающей стороны
+    struct Cache
+    {
+        EntryList entries;
+        QHash<QByteArray, EntryList::iterator> index;
+        qint64 memory = {0};
+        qint64 maxMemory = {0};
+
+        Entry* find(const QByteArray& hash);
+        bool insert(const QByteArray& hash, const QByteArray& content);
+    };
+
+    static QByteArray contentHash(const char* data, int size);
+    static QByteArray makeFrame(const QByteArray& header, const QByteArray& content);
+    static QByteArray serialize(const data::PayloadDedup&);
+
+    // Контент, удерживаемый до подтверждения обработки сообщений Ref
+    struct Pinned
+    {
+        QByteArray content;
+        int count = {0};
+    };
+
+private:
+    const int _threshold;
+    const qint64 _cacheSize;
+    bool _active = {false};
+
+    Cache _sent;     // Зеркало кеша противоположной стороны
+    Cache _received; // Кеш принятого контента
+
+    // Хеши контента отправленных сообщений Ref в порядке отправки
+    std::deque<QByteArray> _refs;
+    QHash<QByteArray, Pinned> _pinned;
+    qint64 _pinnedMemory = {0};
+
+    // Количество обработанных сообщений Ref, для которых не отправлено
+    // подтверждение
+    quint32 _refsProcessed = {0};
+
+    Stats _stats;
+};
+
+} // namespace pproto::transport
@@ -0,0 +1,86 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/pipeline.h"
+
+namespace pproto::transport {
+
+namespace {
+
+class Runnable : public QRunnable
+{
+public:
+    Runnable(const Pipeline::Job::Ptr& job) : _job(job) {}
+    void run() override {_job->run();}
+
+private:
+    Pipeline::Job::Ptr _job;
+};
+
+} // namespace
+
+//------------------------------ Pipeline::Job -------------------------------
+
+bool Pipeline::Job::wait(unsigned long time)
+{
+    if (done())
+        return true;
+
+    QMutexLocker locker {&_lock}; (void) locker;
+    if (!done())
+        _cond.wait(&_lock, time);
+
+    return done();
+}
+
+void Pipeline::Job::run()
+{
+    process();
+
+    QMutexLocker locker {&_lock}; (void) locker;
+    _done.store(true, std::memory_order_release);
+    _cond.wakeAll();
+}
+
+//--------------------------------- Pipeline ---------------------------------
+
+Pipeline::Pipeline(int threads)
+{
+    _pool.setMaxThreadCount(qMax(threads, 1));
+}
+
+Pipeline::~Pipeline()
+{
+    _pool.waitForDone();
+}
+
+void Pipeline::submit(const Job::Ptr& job)
+{
+    QRunnable* runnable = new Runnable(job);
+    runnable->setAutoDelete(true);
+    _pool.start(runnable);
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,97 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Пул потоков для параллельного выполнения ресурсоемких этапов обработки
+  принятых кадров (расшифровка, декомпрессия).
+
+  Поток сокета только выделяет кадры из потока байт и передает их в пул.
+  Задания сокета хранятся в порядке приема кадров, результат задания
+  извлекается только после завершения всех предшествующих заданий, поэтому
+  порядок сообщений в рамках соединения сохраняется. Один экземпляр пула
+  может использоваться несколькими сокетами.
+*****************************************************************************/
+
+#pragma once
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+
+#include <QtCore>
+#include <atomic>
+
+namespace pproto::transport {
+
+class Pipeline : public clife_base
+{
+public:
+    typedef clife_ptr<Pipeline> Ptr;
+
+    // Задание для выполнения в пуле потоков
+    class Job : public clife_base
+    {
+    public:
+        typedef clife_ptr<Job> Ptr;
+
+        Job() = default;
+        virtual ~Job() = default;
+
+        // Возвращает TRUE после завершения задания
+        bool done() const {return _done.load(std::memory_order_acquire);}
+
+        // Ожидает (в миллисекундах) завершения задания. Возвращает TRUE если
+        // задание завершено
+        bool wait(unsigned long time = ULONG_MAX);
+
+        // Выполняет задание в текущем потоке
+        void run();
+
+    protected:
+        virtual void process() = 0;
+
+    private:
+        DISABLE_DEFAULT_COPY(Job)
+
+        std::atomic_bool _done = {false};
+        QMutex _lock;
+        QWaitCondition _cond;
+    };
+
+    // Параметр threads определяет количество потоков пула
+    Pipeline(int threads = QThread::idealThreadCount());
+    ~Pipeline();
+
+    // Передает задание на выполнение в пул потоков
+    void submit(const Job::Ptr&);
+
+    int threads() const {return _pool.maxThreadCount();}
+
+private:
+    DISABLE_DEFAULT_COPY(Pipeline)
+
+    QThreadPool _pool;
+};
+
+} // namespace pproto::transport
@@ -0,0 +1,348 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/replay.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Replay")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Replay")
+#define log_info_m    alog::logger().info    (alog_line_location, "Replay")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Replay")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Replay")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Replay")
+
+namespace pproto::transport {
+
+namespace {
+
+// Ограничение очереди сокета при воспроизведении без пауз
+const int maxQueue = 1000;
+
+} // namespace
+
+Replay::Replay()
+{}
+
+Replay::~Replay()
+{
+    stop();
+    if (!_socket.empty())
+        QObject::disconnect(_socket.get(), nullptr, this, nullptr);
+}
+
+bool Replay::load(const QString& filePath)
+{
+    if (isRunning())
+    {
+        log_error_m << "Impossible load capture file while replay is active";
+        return false;
+    }
+
+    QFile file {filePath};
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        log_error_m << "Failed open capture file " << filePath
+                    << ". Detail: " << file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const uchar* data = (size > 0) ? file.map(0, size) : nullptr;
+    if (data == nullptr)
+    {
+        log_error_m << "Failed map capture file " << filePath;
+        return false;
+    }
+
+    Capture::FileHeader header;
+    if (size < qint64(sizeof(header)))
+    {
+        log_error_m << "Capture file is corrupted: " << filePath;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, "PPCAPTUR", sizeof(header.magic)) != 0
+        || header.version != Capture::version
+        || header.headerSize != sizeof(Capture::FileHeader))
+    {
+        log_error_m << "Unsupported format of capture file: " << filePath;
+        return false;
+    }
+
+    _records.clear();
+    qint64 offset = header.headerSize;
+    while (offset + qint64(sizeof(Capture::RecordHeader)) <= size)
+    {
+        Capture::RecordHeader recordHeader;
+        memcpy(&recordHeader, data + offset, sizeof(recordHeader));
+
+        // Незаполненная запись (запись трафика была прервана)
+        if (recordHeader.size == 0)
+            break;
+
+        if (recordHeader.size < sizeof(Capture::RecordHeader) + recordHeader.frameSize
+            || offset + qint64(recordHeader.size) > size)
+        {
+            log_error_m << "Capture file is corrupted at offset " << offset;
+            break;
+        }
+
+        Record record;
+        record.direction = Capture::Direction(recordHeader.direction);
+        record.format = SerializeFormat(recordHeader.format);
+        record.socket = SocketDescriptor(recordHeader.socket);
+        record.time = recordHeader.time;
+        record.frame = QByteArray((const char*)data + offset + sizeof(Capture::RecordHeader),
+                                  int(recordHeader.frameSize));
+        _records.append(record);
+
+        offset += recordHeader.size;
+    }
+
+    // Записи разных потоков резервируются в произвольном порядке
+    std::stable_sort(_records.begin(), _records.end(),
+                     [](const Record& r1, const Record& r2) {return r1.time < r2.time;});
+
+    log_verbose_m << "Capture file loaded: " << filePath
+                  << ". Records: " << _records.count();
+    return true;
+}
+
+bool Replay::start(const base::Socket::Ptr& socket)
+{
+    if (isRunning())
+    {
+        log_error_m << "Replay already started";
+        return false;
+    }
+    if (socket.empty() || !socket->isConnected())
+    {
+        log_error_m << "Socket for replay is not connected";
+        return false;
+    }
+    if (!_socket.empty())
+        QObject::disconnect(_socket.get(), nullptr, this, nullptr);
+
+    _socket = socket;
+    chk_connect_d(_socket.get(), &base::Socket::message,
+                  this,          &Replay::socketMessage)
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+        _pending.clear();
+        _latencies.clear();
+        _lastAnswer = 0;
+        _stats = Stats();
+        _timer.start();
+    }
+    QThreadEx::start();
+    return true;
+}
+
+Replay::Stats Replay::stats() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _stats;
+}
+
+Message::Ptr Replay::decode(const Record& record) const
+{
+    Message::Ptr message;
+    switch (record.format)
+    {
+#ifdef PPROTO_QBINARY_SERIALIZE
+        case SerializeFormat::QBinary:
+            message = Message::fromQBinary(record.frame);
+            break;
+#endif
+#ifdef PPROTO_JSON_SERIALIZE
+        case SerializeFormat::Json:
+            message = Message::fromJson(record.frame);
+            break;
+#endif
+        default:
+            break;
+    }
+    return message;
+}
+
+void Replay::run()
+{
+    log_info_m << "Replay started. Records: " << _records.count()
+               << ". Speed: " << _speed;
+
+    qint64 firstTime = -1;
+    qint64 lastSend = 0;
+
+    for (const Record& record : _records)
+    {
+        if (threadStop())
+            break;
+
+        if (record.direction != _direction
+            || (_socketFilter != SocketDescriptor(-1) && record.socket != _socketFilter))
+        {
+            continue;
+        }
+
+        Message::Ptr message = decode(record);
+        if (message.empty())
+        {
+            QMutexLocker locker {&_lock}; (void) locker;
+            ++_stats.errors;
+            continue;
+        }
+
+        // Служебные сообщения формируются сокетом самостоятельно
+        const QUuidEx& commandId = message->command();
+        if (commandId == command::ProtocolCompatible
+            || commandId == command::CloseConnection
+            || commandId == command::EchoConnection
+            || commandId == command::Unknown
+            || commandId == command::PayloadDedup
+            || commandId == command::DeltaFrame
+            || commandId == command::DictFrame)
+        {
+            continue;
+        }
+
+        if (firstTime < 0)
+            firstTime = record.time;
+
+        // Соблюдение интервалов между сообщениями
+        if (_speed > 0)
+        {
+            const qint64 due = qint64((record.time - firstTime) / _speed);
+            while (!threadStop())
+            {
+                const qint64 wait = (due - _timer.nsecsElapsed()) / 1000;
+                if (wait <= 0)
+                    break;
+                if (wait > 1000)
+                    msleep(1);
+                else
+                    usleep(ulong(wait));
+            }
+        }
+        else
+        {
+            while (_socket->messagesCount() > maxQueue && !threadStop())
+                usleep(100);
+        }
+
+        if (!_socket->isConnected())
+        {
+            log_error_m << "Socket is disconnected. Replay interrupted";
+            break;
+        }
+
+        { //Block for QMutexLocker
+            QMutexLocker locker {&_lock}; (void) locker;
+            if (message->type() == Message::Type::Command)
+                _pending.insert(message->id(), _timer.nsecsElapsed());
+
+            ++_stats.messages;
+            _stats.bytes += quint64(record.frame.size());
+        }
+        _socket->send(message);
+        lastSend = _timer.nsecsElapsed();
+    }
+
+    // Ожидание ответов на отправленные команды
+    QElapsedTimer answerTimer;
+    answerTimer.start();
+    while (!threadStop() && !answerTimer.hasExpired(_answerTimeout))
+    {
+        { //Block for QMutexLocker
+            QMutexLocker locker {&_lock}; (void) locker;
+            if (_pending.isEmpty())
+                break;
+        }
+        msleep(10);
+    }
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        const qint64 lastTime = qMax(lastSend, _lastAnswer);
+
+        _stats.lost = quint64(_pending.count());
+        _stats.duration = lastTime / 1000000;
+        if (lastTime > 0)
+            _stats.throughput = double(_stats.messages) * 1e9 / double(lastTime);
+
+        if (!_latencies.isEmpty())
+        {
+            std::sort(_latencies.begin(), _latencies.end());
+            qint64 sum = 0;
+            for (qint64 latency : _latencies)
+                sum += latency;
+
+            const int count = _latencies.count();
+            _stats.latencyAvg = sum / count;
+            _stats.latencyP50 = _latencies[count / 2];
+            _stats.latencyP99 = _latencies[qMin(count - 1, count * 99 / 100)];
+            _stats.latencyMax = _latencies.last();
+        }
+        _pending.clear();
+
+        log_info_m << "Replay finished"
+                   << ". Messages: " << _stats.messages
+                   << ". Answers: " << _stats.answers
+                   << ". Lost: " << _stats.lost
+                   << ". Duration: " << _stats.duration << " ms"
+                   << ". Throughput: " << _stats.throughput << " msg/s"
+                   << ". Latency avg/p50/p99/max: "
+                   << _stats.latencyAvg << "/" << _stats.latencyP50 << "/"
+                   << _stats.latencyP99 << "/" << _stats.latencyMax << " us";
+    }
+}
+
+void Replay::socketMessage(const Message::Ptr& message)
+{
+    if (message->type() != Message::Type::Answer)
+        return;
+
+    const qint64 now = _timer.nsecsElapsed();
+
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    auto it = _pending.find(message->id());
+    if (it == _pending.end())
+        return;
+
+    _latencies.append((now - it.value()) / 1000);
+    _lastAnswer = now;
+    _pending.erase(it);
+    ++_stats.answers;
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,150 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Воспроизведение трафика, записанного посредством transport::Capture.
+
+  Кадры выбранного направления декодируются в сообщения и отправляются
+  через заданный сокет с сохранением порядка и интервалов между  ними
+  (с учетом коэффициента скорости). Для воспроизведения нагрузки на сервер
+  используется клиентский tcp::Socket, подключенный к tcp::Listener, и
+  входящие (Capture::Direction::In) кадры записи,  сделанной на стороне
+  сервера. Для воспроизведения нагрузки на клиента используется  сокет
+  листенера и исходящие (Capture::Direction::Out) кадры. Сокет должен
+  использовать тот же формат сериализации, что и записанное соединение.
+
+  Служебные сообщения протокола (ProtocolCompatible, EchoConnection и т.п.)
+  не воспроизводятся. Для команд измеряется время получения ответа.
+  По завершении воспроизведения формируется статистика:  пропускная
+  способность и распределение времени ответа на команды.
+*****************************************************************************/
+
+#pragma once
+
+#include "transport/base.h"
+#include "transport/capture.h"
+
+#include "shared/defmac.h"
+#include "shared/qt/qthreadex.h"
+
+#include <QtCore>
+
+namespace pproto::transport {
+
+class Replay : public QThreadEx
+{
+public:
+    struct Record
+    {
+        Capture::Direction direction = {Capture::Direction::In};
+        SerializeFormat format = {SerializeFormat::QBinary};
+        SocketDescriptor socket = {-1};
+        qint64 time = {0}; // Время от начала записи (в наносекундах)
+        QByteArray frame;
+    };
+
+    struct Stats
+    {
+        quint64 messages = {0}; // Количество отправленных сообщений
+        quint64 bytes = {0};    // Объем отправленных кадров
+        quint64 answers = {0};  // Количество полученных ответов на команды
+        quint64 lost = {0};     // Количество команд без ответа
+        quint64 errors = {0};   // Количество кадров, которые не удалось декодировать
+
+        qint64 duration = {0};  // Время воспроизведения (в миллисекундах)
+        double throughput = {0}; // Сообщений в секунду
+
+        // Время ответа на команды (в микросекундах)
+        qint64 latencyAvg = {0};
+        qint64 latencyP50 = {0};
+        qint64 latencyP99 = {0};
+        qint64 latencyMax = {0};
+    };
+
+    Replay();
+    ~Replay();
+
+    // Загружает файл записи
+    bool load(const QString& filePath);
+
+    // Количество загруженных записей
+    int count() const {return _records.count();}
+
+    // Направление воспроизводимых кадров.
+    // Значение параметра по умолчанию равно Capture::Direction::In
+    Capture::Direction direction() const {return _direction;}
+    void setDirection(Capture::Direction val) {_direction = val;}
+
+    // Воспроизводятся только кадры соединения с указанным дескриптором.
+    // Значение параметра по умолчанию равно -1 (воспроизводятся все кадры)
+    SocketDescriptor socketFilter() const {return _socketFilter;}
+    void setSocketFilter(SocketDescriptor val) {_socketFilter = val;}
+
+    // Коэффициент скорости воспроизведения: 1 - исходная скорость, 2 - в два
+    // раза быстрее и т.д. Значение 0 - воспроизведение без пауз.
+    // Значение параметра по умолчанию равно 1
+    double speed() const {return _speed;}
+    void setSpeed(double val) {_speed = val;}
+
+    // Время ожидания (в миллисекундах) ответов на команды после отправки
+    // последнего сообщения. Значение параметра по умолчанию равно 5 сек
+    int answerTimeout() const {return _answerTimeout;}
+    void setAnswerTimeout(int val) {_answerTimeout = val;}
+
+    // Начинает воспроизведение через сокет socket. Сокет должен быть подклю-
+    // чен. Завершение воспроизведения можно ожидать функцией wait()
+    bool start(const base::Socket::Ptr& socket);
+
+    // Статистика воспроизведения
+    Stats stats() const;
+
+private:
+    DISABLE_DEFAULT_COPY(Replay)
+
+    void run() override;
+
+    // Обработчик сообщений сокета, вызывается в потоке сокета
+    void socketMessage(const pproto::Message::Ptr&);
+
+    Message::Ptr decode(const Record&) const;
+
+private:
+    QVector<Record> _records;
+    Capture::Direction _direction = {Capture::Direction::In};
+    SocketDescriptor _socketFilter = {-1};
+    double _speed = {1};
+    int _answerTimeout = {5*1000};
+
+    base::Socket::Ptr _socket;
+    QElapsedTimer _timer;
+
+    // Время отправки команд, ожидающих ответа (в наносекундах)
+    QHash<QUuidEx, qint64> _pending;
+    QVector<qint64> _latencies;
+    qint64 _lastAnswer = {0};
+    Stats _stats;
+    mutable QMutex _lock;
+};
+
+} // namespace pproto::transport
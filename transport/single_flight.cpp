@@ -0,0 +1,175 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/single_flight.h"
+#include "transport/base.h"
+#include "serialize/functions.h"
+#include "logger_operators.h"
+
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#define log_error_m   alog::logger().error   (alog_line_location, "SingleFlight")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "SingleFlight")
+#define log_info_m    alog::logger().info    (alog_line_location, "SingleFlight")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "SingleFlight")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "SingleFlight")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "SingleFlight")
+
+namespace pproto::transport {
+
+SingleFlight::SingleFlight(int timeout)
+    : _timeout(timeout)
+{
+    _timer.start();
+}
+
+SingleFlight::~SingleFlight()
+{}
+
+bool SingleFlight::join(const AnswerCache::Key& key, base::Socket* socket,
+                        const Message::Ptr& command)
+{
+    bool joined = false;
+    Waiters expired;
+
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        const qint64 elapsed = _timer.elapsed();
+
+        // Удаление команд, ответы на которые не получены в течении timeout.
+        // Ключи таких команд могут больше не запрашиваться
+        if ((_sweepTime + _timeout) < elapsed)
+        {
+            for (auto f = _flights.begin(); f != _flights.end(); )
+            {
+                if ((f->start + _timeout) <= elapsed && f.key() != key)
+                {
+                    _stats.expired += f->waiters.count() + 1;
+                    expired += f->waiters;
+                    f = _flights.erase(f);
+                    --_stats.inflight;
+                }
+                else
+                    ++f;
+            }
+            _sweepTime = elapsed;
+        }
+
+        auto it = _flights.find(key);
+        if (it == _flights.end())
+        {
+            Flight flight;
+            flight.start = elapsed;
+            flight.leader = socket;
+            _flights.insert(key, flight);
+
+            ++_stats.leaders;
+            ++_stats.inflight;
+        }
+        else if ((it->start + _timeout) > elapsed)
+        {
+            it->waiters.append({clife_ptr<base::Socket>(socket),
+                                command->cloneForAnswer()});
+            ++_stats.followers;
+            joined = true;
+        }
+        else
+        {
+            // Ответ на выполняющуюся команду не получен, ожидающим запросам
+            // отправляется ответ с ошибкой, текущая команда передается в об-
+            // работчик
+            log_warn_m << "Answer for command " << CommandNameLog(key.command)
+                       << " not received within " << _timeout << " ms"
+                       << ". Rejected waiting requests: " << it->waiters.count();
+
+            _stats.expired += it->waiters.count() + 1;
+            expired += it->waiters;
+            it->waiters.clear();
+            it->start = elapsed;
+            it->leader = socket;
+            ++_stats.leaders;
+        }
+    }
+    reject(expired);
+    return joined;
+}
+
+SingleFlight::Waiters SingleFlight::complete(const AnswerCache::Key& key)
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    auto it = _flights.find(key);
+    if (it == _flights.end())
+        return {};
+
+    Waiters waiters = std::move(it->waiters);
+    _flights.erase(it);
+    --_stats.inflight;
+    return waiters;
+}
+
+void SingleFlight::abort(const AnswerCache::Key& key, base::Socket* socket)
+{
+    Waiters waiters;
+    { //Block for QMutexLocker
+        QMutexLocker locker {&_lock}; (void) locker;
+
+        auto it = _flights.find(key);
+        if (it == _flights.end() || it->leader != socket)
+            return;
+
+        waiters = std::move(it->waiters);
+        _flights.erase(it);
+        --_stats.inflight;
+        _stats.aborted += waiters.count();
+    }
+    if (waiters.isEmpty())
+        return;
+
+    log_warn_m << "Command " << CommandNameLog(key.command)
+               << " was not completed"
+               << ". Rejected waiting requests: " << waiters.count();
+    reject(waiters);
+}
+
+void SingleFlight::reject(const Waiters& waiters)
+{
+    for (const Waiter& w : waiters)
+    {
+        Message::Ptr answer = w.answer;
+        writeToMessage(error::single_flight_abort, answer, answer->contentFormat());
+        w.socket->send(answer);
+    }
+}
+
+SingleFlight::Stats SingleFlight::stats() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _stats;
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,130 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Объединение идентичных одновременно выполняемых команд (single-flight).
+
+  Если в момент получения команды уже выполняется идентичная команда (тот же
+  идентификатор команды, тот же контент и параметры сериализации), то новая
+  команда не передается в обработчик, а ставится в очередь ожидания. Ответ
+  на первую команду сериализуется один раз и рассылается всем ожидающим за-
+  просам, при этом в сериализованном ответе заменяется только идентификатор
+  сообщения. Разрешение на объединение задается  в пуле  команд,  см.
+  command::Pool::setSingleFlight()
+*****************************************************************************/
+
+#pragma once
+
+#include "transport/answer_cache.h"
+
+#include "shared/defmac.h"
+#include "shared/clife_base.h"
+#include "shared/clife_ptr.h"
+
+#include <QtCore>
+
+namespace pproto::transport {
+
+namespace base {class Socket;}
+
+class SingleFlight : public clife_base
+{
+public:
+    typedef clife_ptr<SingleFlight> Ptr;
+
+    // Запрос, ожидающий ответ
+    struct Waiter
+    {
+        clife_ptr<base::Socket> socket;
+        Message::Ptr answer;
+    };
+    typedef QVector<Waiter> Waiters;
+
+    struct Stats
+    {
+        // Количество команд переданных в обработчик
+        quint64 leaders = {0};
+
+        // Количество команд, для которых обработчик не вызывался
+        quint64 followers = {0};
+
+        // Количество команд, ответ на которые не был получен в течении timeout
+        quint64 expired = {0};
+
+        // Количество ожидающих запросов, которым отправлен ответ с ошибкой
+        // из-за того, что выполнение идентичной команды не было завершено
+        quint64 aborted = {0};
+
+        // Количество выполняющихся команд
+        int inflight = {0};
+    };
+
+    // Параметр timeout определяет время (в миллисекундах) ожидания ответа
+    // на выполняющуюся команду. По истечении этого времени  идентичная
+    // команда будет передана в обработчик, а запросам, ожидающим ответ,
+    // будет отправлен ответ с ошибкой error::single_flight_abort
+    SingleFlight(int timeout = 30*1000);
+    ~SingleFlight();
+
+    // Возвращает TRUE если идентичная команда уже выполняется, в этом случае
+    // команда добавляется в список ожидающих. Если возвращено FALSE, то
+    // команда должна быть передана в обработчик
+    bool join(const AnswerCache::Key&, base::Socket*, const Message::Ptr& command);
+
+    // Завершает выполнение команды и возвращает список ожидающих запросов
+    Waiters complete(const AnswerCache::Key&);
+
+    // Прерывает выполнение команды, ответ на которую не будет отправлен
+    // (например, при закрытии соединения). Команда прерывается только если
+    // ее обработчику передана команда из сокета socket. Ожидающим запросам
+    // отправляется ответ с ошибкой error::single_flight_abort
+    void abort(const AnswerCache::Key&, base::Socket* socket);
+
+    Stats stats() const;
+
+    int timeout() const {return _timeout;}
+    void setTimeout(int val) {_timeout = val;}
+
+private:
+    DISABLE_DEFAULT_COPY(SingleFlight)
+
+    // Отправляет ожидающим запросам ответ с ошибкой
+    void reject(const Waiters&);
+
+    struct Flight
+    {
+        qint64 start = {0};
+        const base::Socket* leader = {nullptr};
+        Waiters waiters;
+    };
+    QHash<AnswerCache::Key, Flight> _flights;
+    mutable QMutex _lock;
+
+    QElapsedTimer _timer;
+    qint64 _sweepTime = {0};
+    int _timeout;
+    Stats _stats;
+};
+
+} // namespace pproto::transport
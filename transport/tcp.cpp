@@ -257,11 +257,12 @@ void Socket::socketClose()
     _socket.reset();
 }
 
-void Socket::messageInit(Message::Ptr& message)
+ConnectionContext::Ptr Socket::createConnectionContext()
 {
-    message->setSocketType(SocketType::Tcp);
-    message->setSocketDescriptor(_socket->socketDescriptor());
-    message->setSourcePoint({_socket->peerAddress(), _socket->peerPort()});
+    return ConnectionContext::Ptr(new ConnectionContext(
+        SocketType::Tcp, _socket->socketDescriptor(),
+        {_socket->peerAddress(), _socket->peerPort()}, QString(),
+        messageFormat(), encryption()));
 }
 
 void Socket::fillUnknownMessage(const Message::Ptr& message, data::Unknown& unknown)
@@ -376,4 +377,170 @@ Listener& listener()
     return safe::singleton<Listener>();
 }
 
+//-------------------------------- SocketGroup -------------------------------
+
+SocketGroup::SocketGroup(int size, int spare)
+    : _size(qMax(size, 1)),
+      _spare(qMax(spare, 0))
+{
+    registrationQtMetatypes();
+    chk_connect_q(&_reconnectTimer, &QTimer::timeout,
+                  this, &SocketGroup::reconnect)
+}
+
+SocketGroup::~SocketGroup()
+{
+    disconnect();
+    for (const Socket::Ptr& socket : _sockets)
+        QObject::disconnect(socket.get(), nullptr, this, nullptr);
+}
+
+bool SocketGroup::init(const HostPoint& peerPoint)
+{
+    if (!_sockets.isEmpty())
+    {
+        log_error_m << "Impossible execute a initialization "
+                       "because SocketGroup already initialized";
+        return false;
+    }
+    _peerPoint = peerPoint;
+
+    for (int i = 0; i < (_size + _spare); ++i)
+    {
+        Socket::Ptr socket {new Socket};
+        if (!socket->init(_peerPoint))
+        {
+            _sockets.clear();
+            return false;
+        }
+        if (_socketSetup)
+            _socketSetup(socket.get());
+
+        chk_connect_d(socket.get(), &base::Socket::message,
+                      this,         &SocketGroup::message)
+
+        chk_connect_d(socket.get(), &base::Socket::connected,
+                      this,         &SocketGroup::socketConnected)
+
+        chk_connect_d(socket.get(), &base::Socket::disconnected,
+                      this,         &SocketGroup::socketDisconnected)
+
+        _sockets.append(socket);
+    }
+    return true;
+}
+
+void SocketGroup::connect()
+{
+    for (const Socket::Ptr& socket : _sockets)
+        socket->connect();
+
+    _reconnectTimer.start(_reconnectInterval * 1000);
+}
+
+void SocketGroup::disconnect(unsigned long time)
+{
+    _reconnectTimer.stop();
+    for (const Socket::Ptr& socket : _sockets)
+        socket->disconnect(time);
+
+    QMutexLocker locker {&_lock}; (void) locker;
+    _active.clear();
+}
+
+bool SocketGroup::isConnected() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return !_active.isEmpty();
+}
+
+int SocketGroup::activeCount() const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+    return _active.count();
+}
+
+bool SocketGroup::send(const Message::Ptr& message)
+{
+    if (message->type() == Message::Type::Answer)
+    {
+        // Ответ должен быть отправлен через соединение, из которого
+        // была получена команда
+        for (const Socket::Ptr& socket : _sockets)
+            if (socket->socketDescriptor() == message->socketDescriptor())
+                return socket->send(message);
+
+        log_error_m << "Socket for answer not found"
+                    << ". Command " << CommandNameLog(message->command())
+                    << " discarded";
+        return false;
+    }
+    return send(message, _roundRobin++);
+}
+
+bool SocketGroup::send(const Message::Ptr& message, quint64 orderKey)
+{
+    Socket::Ptr socket = activeSocket(orderKey);
+    if (socket.empty())
+    {
+        log_error_m << "No active connections to host " << _peerPoint
+                    << ". Command " << CommandNameLog(message->command())
+                    << " discarded";
+        return false;
+    }
+    return socket->send(message);
+}
+
+Socket::Ptr SocketGroup::activeSocket(quint64 key) const
+{
+    QMutexLocker locker {&_lock}; (void) locker;
+
+    if (_active.isEmpty())
+        return {};
+
+    return _active[int(key % quint64(_active.count()))];
+}
+
+void SocketGroup::updateActive()
+{
+    // Активными являются первые size подключенных сокетов. Резервный сокет
+    // становится активным при разрыве соединения одним из активных сокетов
+    QVector<Socket::Ptr> active;
+    for (const Socket::Ptr& socket : _sockets)
+    {
+        if (active.count() >= _size)
+            break;
+        if (socket->isConnected())
+            active.append(socket);
+    }
+
+    QMutexLocker locker {&_lock}; (void) locker;
+    _active = active;
+}
+
+void SocketGroup::reconnect()
+{
+    for (const Socket::Ptr& socket : _sockets)
+        if (!socket->isRunning())
+        {
+            log_debug_m << "Reconnect to host " << _peerPoint;
+            socket->connect();
+        }
+
+    if (_reconnectTimer.interval() != _reconnectInterval * 1000)
+        _reconnectTimer.start(_reconnectInterval * 1000);
+}
+
+void SocketGroup::socketConnected(SocketDescriptor socketDescriptor)
+{
+    updateActive();
+    emit connected(socketDescriptor);
+}
+
+void SocketGroup::socketDisconnected(SocketDescriptor socketDescriptor)
+{
+    updateActive();
+    emit disconnected(socketDescriptor);
+}
+
 } // namespace pproto::transport::tcp
@@ -37,6 +37,8 @@
 #include <QTcpSocket>
 #include <QTcpServer>
 #include <QHostAddress>
+#include <atomic>
+#include <functional>
 
 namespace pproto::transport::tcp {
 
@@ -79,7 +81,7 @@ private:
     bool   socketWaitForBytesWritten(int msecs) override;
     void   socketClose() override;
 
-    void messageInit(Message::Ptr&) override;
+    ConnectionContext::Ptr createConnectionContext() override;
     void fillUnknownMessage(const Message::Ptr&, data::Unknown&) override;
 
     void printHostInfo(alog::Line&);
@@ -141,4 +143,98 @@ private:
 
 Listener& listener();
 
+/**
+  Группа клиентских сокетов, устанавливающих несколько TCP-соединений с одним
+  удаленным хостом. Используется для увеличения пропускной способности канала
+  между клиентом и сервером: каждое соединение обслуживается отдельным потоком
+  и имеет собственное TCP-окно.
+
+  Группа состоит из size активных соединений и spare резервных. Резервные
+  соединения устанавливаются заранее, но сообщения через них не передаются до
+  тех пор, пока одно из активных соединений не будет разорвано. Каждое соеди-
+  нение восстанавливается независимо от остальных.
+
+  Ответы на команды отправляются через соединение, из которого  была  полу-
+  чена команда. Сообщения с ключом упорядочивания передаются через одно и то
+  же соединение, что сохраняет порядок их доставки до момента  изменения
+  набора активных соединений. Остальные сообщения распределяются по активным
+  соединениям циклически
+*/
+class SocketGroup : public QObject
+{
+public:
+    typedef std::function<void (Socket*)> SocketSetup;
+
+    SocketGroup(int size = 4, int spare = 1);
+    ~SocketGroup();
+
+    // Функция вызывается для каждого сокета группы при инициализации, исполь-
+    // зуется для задания параметров сокетов (формат сериализации, шифрование
+    // и т.д.). Должна быть задана до вызова init()
+    void setSocketSetup(const SocketSetup& val) {_socketSetup = val;}
+
+    // Определяет параметры подключения к удаленному хосту
+    bool init(const HostPoint&);
+
+    // Выполняет подключение всех сокетов группы
+    void connect();
+
+    // Разрывает все соединения группы
+    void disconnect(unsigned long time = ULONG_MAX);
+
+    // Возвращает TRUE если установлено хотя бы одно соединение
+    bool isConnected() const;
+
+    // Количество активных соединений
+    int activeCount() const;
+
+    // Отправляет сообщение. Ответы отправляются через соединение, из которого
+    // была получена команда, остальные сообщения распределяются по активным
+    // соединениям циклически
+    bool send(const Message::Ptr&);
+
+    // Отправляет сообщение через соединение, определяемое ключом упорядочивания
+    bool send(const Message::Ptr&, quint64 orderKey);
+
+    // Интервал (в секундах) между попытками восстановления соединений.
+    // Значение параметра по умолчанию равно 1
+    int reconnectInterval() const {return _reconnectInterval;}
+    void setReconnectInterval(int val) {_reconnectInterval = val;}
+
+signals:
+    // Сигнал эмитируется при получении сообщения любым сокетом группы
+    void message(const pproto::Message::Ptr&);
+
+    // Сигналы эмитируются при установке и разрыве соединения сокетом группы
+    void connected(pproto::SocketDescriptor);
+    void disconnected(pproto::SocketDescriptor);
+
+private slots:
+    void reconnect();
+    void socketConnected(pproto::SocketDescriptor);
+    void socketDisconnected(pproto::SocketDescriptor);
+
+private:
+    Q_OBJECT
+    DISABLE_DEFAULT_COPY(SocketGroup)
+
+    void updateActive();
+    Socket::Ptr activeSocket(quint64 key) const;
+
+private:
+    const int _size;
+    const int _spare;
+    HostPoint _peerPoint;
+    SocketSetup _socketSetup;
+
+    QVector<Socket::Ptr> _sockets;
+    QVector<Socket::Ptr> _active;
+    mutable QMutex _lock;
+
+    std::atomic<quint64> _roundRobin = {0};
+
+    QTimer _reconnectTimer;
+    int _reconnectInterval = {1};
+};
+
 } // namespace pproto::transport::tcp
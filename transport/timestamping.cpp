@@ -0,0 +1,336 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "transport/timestamping.h"
+
+#include "shared/spin_locker.h"
+#include "shared/logger/logger.h"
+#include "shared/qt/logger_operators.h"
+
+#if defined(Q_OS_LINUX)
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <linux/sockios.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#define log_error_m   alog::logger().error   (alog_line_location, "Timestamping")
+#define log_warn_m    alog::logger().warn    (alog_line_location, "Timestamping")
+#define log_info_m    alog::logger().info    (alog_line_location, "Timestamping")
+#define log_verbose_m alog::logger().verbose (alog_line_location, "Timestamping")
+#define log_debug_m   alog::logger().debug   (alog_line_location, "Timestamping")
+#define log_debug2_m  alog::logger().debug2  (alog_line_location, "Timestamping")
+
+namespace pproto::transport {
+
+namespace {
+
+// Ограничение количества кадров, ожидающих метку отправки
+const size_t maxPending = 1024;
+
+// Размер буфера для управляющих сообщений
+const int controlSize = 512;
+
+} // namespace
+
+void Timestamping::reset(Mode mode)
+{
+    _mode = mode;
+    _fd = -1;
+    _failed = false;
+    _stream = false;
+    _counter = 0;
+    _pending.clear();
+    _receiveStamp = 0;
+
+    SpinLocker locker {_statsLock}; (void) locker;
+    _stats = Stats();
+}
+
+bool Timestamping::enable(int fd, bool stream)
+{
+    if (_fd >= 0)
+        return true;
+
+    if (_failed || _mode == Mode::None || fd < 0)
+        return false;
+
+#if defined(Q_OS_LINUX)
+    if (stream)
+    {
+        // Для TCP счетчик SOF_TIMESTAMPING_OPT_ID отсчитывается от первого
+        // неподтвержденного байта, поэтому метки включаются только  после
+        // подтверждения всех отправленных данных
+        int outq = 0;
+        if (ioctl(fd, SIOCOUTQ, &outq) != 0 || outq != 0)
+            return false;
+    }
+
+    unsigned flags = SOF_TIMESTAMPING_SOFTWARE
+                   | SOF_TIMESTAMPING_TX_SOFTWARE
+                   | SOF_TIMESTAMPING_RX_SOFTWARE
+                   | SOF_TIMESTAMPING_OPT_ID
+                   | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (stream)
+        flags |= SOF_TIMESTAMPING_TX_ACK;
+
+    if (_mode == Mode::Hardware)
+        flags |= SOF_TIMESTAMPING_RAW_HARDWARE
+               | SOF_TIMESTAMPING_TX_HARDWARE
+               | SOF_TIMESTAMPING_RX_HARDWARE;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0)
+    {
+        log_warn_m << "Failed set SO_TIMESTAMPING option: " << strerror(errno);
+        _failed = true;
+        return false;
+    }
+    _fd = fd;
+    _stream = stream;
+
+    log_verbose_m << "Kernel timestamping is active"
+                  << ". Mode: " << ((_mode == Mode::Hardware) ? "hardware" : "software");
+    return true;
+#else
+    _failed = true;
+    log_warn_m << "Kernel timestamping is supported only for Linux";
+    return false;
+#endif
+}
+
+void Timestamping::frameSent(qint64 bytes, qint64 time)
+{
+    if (_fd < 0 || bytes <= 0)
+        return;
+
+    Pending pending;
+    if (_stream)
+    {
+        _counter += quint32(bytes);
+        pending.key = _counter - 1;
+    }
+    else
+        pending.key = _counter++;
+
+    pending.sent = time;
+    _pending.push_back(pending);
+
+    if (_pending.size() > maxPending)
+        _pending.pop_front();
+}
+
+void Timestamping::processErrorQueue()
+{
+#if defined(Q_OS_LINUX)
+    if (_fd < 0)
+        return;
+
+    char control[controlSize];
+    while (true)
+    {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        qint64 stamp = 0;
+        bool hardware = false;
+        sock_extended_err serr;
+        bool serrFound = false;
+
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+            {
+                stamp = controlStamp(CMSG_DATA(cm), hardware);
+            }
+            else if ((cm->cmsg_level == SOL_IP   && cm->cmsg_type == IP_RECVERR)
+                  || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+            {
+                memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+                serrFound = true;
+            }
+        }
+        if (stamp != 0
+            && serrFound
+            && serr.ee_errno == ENOMSG
+            && serr.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+        {
+            if (hardware)
+            {
+                SpinLocker locker {_statsLock}; (void) locker;
+                _stats.hardware = true;
+            }
+            sendStamp(serr.ee_info, serr.ee_data, stamp);
+        }
+    }
+#endif
+}
+
+void Timestamping::sendStamp(quint32 type, quint32 key, qint64 stamp)
+{
+#if defined(Q_OS_LINUX)
+    if (type == SCM_TSTAMP_SND)
+    {
+        for (Pending& pending : _pending)
+        {
+            // Сравнение с учетом переполнения счетчика
+            if (qint32(pending.key - key) > 0)
+                break;
+
+            if (pending.driver == 0)
+            {
+                pending.driver = stamp;
+                if (stamp >= pending.sent)
+                {
+                    SpinLocker locker {_statsLock}; (void) locker;
+                    ewma(_stats.sendQueue, (stamp - pending.sent) / 1000);
+                    ++_stats.sendSamples;
+                }
+            }
+        }
+        // Для UDP подтверждения не ожидаются
+        if (!_stream)
+            while (!_pending.empty() && qint32(_pending.front().key - key) <= 0)
+                _pending.pop_front();
+    }
+    else if (type == SCM_TSTAMP_ACK)
+    {
+        while (!_pending.empty() && qint32(_pending.front().key - key) <= 0)
+        {
+            const Pending& pending = _pending.front();
+            if (pending.driver != 0 && stamp >= pending.driver)
+            {
+                SpinLocker locker {_statsLock}; (void) locker;
+                ewma(_stats.wireRtt, (stamp - pending.driver) / 1000);
+                ++_stats.ackSamples;
+            }
+            _pending.pop_front();
+        }
+    }
+#else
+    (void) type; (void) key; (void) stamp;
+#endif
+}
+
+void Timestamping::peekReceive()
+{
+#if defined(Q_OS_LINUX)
+    if (_fd < 0)
+        return;
+
+    char byte;
+    iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    char control[controlSize];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(_fd, &msg, MSG_PEEK | MSG_DONTWAIT) < 0)
+        return;
+
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+        {
+            bool hardware = false;
+            qint64 stamp = controlStamp(CMSG_DATA(cm), hardware);
+            if (stamp != 0)
+                _receiveStamp = stamp;
+        }
+#endif
+}
+
+void Timestamping::frameReceived()
+{
+    if (_fd < 0 || _receiveStamp == 0)
+        return;
+
+    const qint64 stamp = now();
+    if (stamp >= _receiveStamp)
+    {
+        SpinLocker locker {_statsLock}; (void) locker;
+        ewma(_stats.receiveDelay, (stamp - _receiveStamp) / 1000);
+        ++_stats.receiveSamples;
+    }
+    // Метка относится только к первому кадру прочитанных данных
+    _receiveStamp = 0;
+}
+
+Timestamping::Stats Timestamping::stats() const
+{
+    SpinLocker locker {_statsLock}; (void) locker;
+    return _stats;
+}
+
+qint64 Timestamping::now()
+{
+#if defined(Q_OS_LINUX)
+    // Программные метки ядра формируются по часам CLOCK_REALTIME
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+void Timestamping::ewma(qint64& value, qint64 sample)
+{
+    value = (value == 0) ? sample : value + (sample - value) / 8;
+}
+
+qint64 Timestamping::controlStamp(const void* data, bool& hardware) const
+{
+#if defined(Q_OS_LINUX)
+    // Структура scm_timestamping: ts[0] - программная метка,
+    // ts[2] - аппаратная метка
+    timespec ts[3];
+    memcpy(ts, data, sizeof(ts));
+
+    hardware = (_mode == Mode::Hardware) && (ts[2].tv_sec || ts[2].tv_nsec);
+    const timespec& t = hardware ? ts[2] : ts[0];
+    return qint64(t.tv_sec) * 1000000000 + t.tv_nsec;
+#else
+    (void) data;
+    hardware = false;
+    return 0;
+#endif
+}
+
+} // namespace pproto::transport
@@ -0,0 +1,160 @@
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2024 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Метки времени ядра для сокетов (SO_TIMESTAMPING, только Linux).
+
+  Механизм позволяет отделить время обработки сообщений в приложении от
+  времени, которое данные проводят в ядре и в сетевом интерфейсе. Для
+  соединения вычисляются сглаженные (EWMA) значения:
+    - sendQueue    - время от записи кадра в сокет до передачи данных
+                     драйверу сетевого интерфейса (метка SND);
+    - wireRtt      - время от передачи данных драйверу до получения под-
+                     тверждения (метка ACK, только для TCP);
+    - receiveDelay - время от получения данных ядром до окончания чтения
+                     кадра в потоке сокета.
+
+  Метки отправки читаются из очереди ошибок сокета (MSG_ERRQUEUE) и сопо-
+  ставляются с кадрами по счетчику SOF_TIMESTAMPING_OPT_ID: для TCP это
+  смещение последнего байта кадра в потоке, для UDP - порядковый номер
+  датаграммы. Метка получения определяется чтением из сокета с флагом
+  MSG_PEEK до того, как данные будут прочитаны Qt-сокетом. Для UDP метка
+  относится к конкретной датаграмме, для TCP - к первому сегменту данных,
+  ожидающих чтения, поэтому значение receiveDelay для TCP является оценкой
+  сверху.
+
+  В режиме Hardware дополнительно запрашиваются аппаратные метки сетевого
+  интерфейса. Аппаратные метки используются только если часы интерфейса
+  синхронизированы с системными часами (например, посредством phc2sys), а
+  аппаратные метки включены для интерфейса (SIOCSHWTSTAMP, hwstamp_ctl).
+  Для loopback-интерфейса доступны только программные метки.
+
+  Экземпляр класса используется в потоке сокета, функция stats() может
+  вызываться из любого потока. Режим задается параметром сокета (см.
+  Properties::timestamping(), udp::Socket::timestamping()).
+*****************************************************************************/
+
+#pragma once
+
+#include "shared/defmac.h"
+
+#include <QtCore>
+#include <atomic>
+#include <deque>
+
+namespace pproto::transport {
+
+class Timestamping
+{
+public:
+    enum class Mode
+    {
+        None     = 0, // Метки времени не используются
+        Software = 1, // Программные метки ядра
+        Hardware = 2  // Аппаратные метки (если доступны) и программные метки
+    };
+
+    struct Stats
+    {
+        // Количество полученных меток отправки, подтверждения и получения
+        quint64 sendSamples = {0};
+        quint64 ackSamples = {0};
+        quint64 receiveSamples = {0};
+
+        // Сглаженные значения интервалов (в микросекундах)
+        qint64 sendQueue = {0};
+        qint64 wireRtt = {0};
+        qint64 receiveDelay = {0};
+
+        // Были получены аппаратные метки
+        bool hardware = {false};
+    };
+
+    Timestamping() = default;
+
+    // Сбрасывает состояние и статистику, вызывается в потоке сокета перед
+    // установкой соединения
+    void reset(Mode mode);
+
+    // Возвращает TRUE если метки времени включены для сокета
+    bool active() const {return _fd >= 0;}
+
+    // Включает метки времени для сокета. Параметр stream определяет тип
+    // сокета (TCP или UDP). Для TCP-сокета метки включаются только при
+    // отсутствии неподтвержденных данных, иначе функция возвращает FALSE
+    // и вызов нужно повторить позднее
+    bool enable(int fd, bool stream);
+
+    // Регистрирует отправку кадра размером bytes (для UDP - одной датаграммы),
+    // time - время (см. now()), полученное до записи кадра в сокет
+    void frameSent(qint64 bytes, qint64 time);
+
+    // Обрабатывает метки из очереди ошибок сокета
+    void processErrorQueue();
+
+    // Запоминает метку получения данных, ожидающих чтения из сокета
+    void peekReceive();
+
+    // Регистрирует окончание чтения кадра
+    void frameReceived();
+
+    Stats stats() const;
+
+    // Текущее время (в наносекундах) в шкале программных меток ядра
+    static qint64 now();
+
+private:
+    DISABLE_DEFAULT_COPY(Timestamping)
+
+    static void ewma(qint64& value, qint64 sample);
+
+    // Извлекает метку из управляющего сообщения SCM_TIMESTAMPING
+    qint64 controlStamp(const void* data, bool& hardware) const;
+
+    struct Pending
+    {
+        quint32 key  = {0}; // Значение счетчика SOF_TIMESTAMPING_OPT_ID
+        qint64  sent = {0}; // Время записи в сокет
+        qint64  driver = {0}; // Метка SND (передача драйверу)
+    };
+
+    // Обрабатывает метку отправки типа type для счетчика key
+    void sendStamp(quint32 type, quint32 key, qint64 stamp);
+
+    Mode _mode = {Mode::None};
+    int  _fd = {-1};
+    bool _failed = {false};
+    bool _stream = {false};
+
+    quint32 _counter = {0};
+    std::deque<Pending> _pending;
+
+    // Метка получения данных, ожидающих чтения
+    qint64 _receiveStamp = {0};
+
+    Stats _stats;
+    mutable std::atomic_flag _statsLock = ATOMIC_FLAG_INIT;
+};
+
+} // namespace pproto::transport
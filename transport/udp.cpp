@@ -28,6 +28,8 @@
 #include "commands/pool.h"
 #include "logger_operators.h"
 #include "utils.h"
+#include "probes.h"
+#include "trace.h"
 
 #include "shared/break_point.h"
 #include "shared/spin_locker.h"
@@ -93,26 +95,12 @@ void Socket::waitBinding(int timeout)
 
 bool Socket::isBound() const
 {
-    bool res = false;
-    if (_socketLock.tryLock(10))
-    {
-        if (_socket)
-            res = (_socket->state() == QAbstractSocket::BoundState);
-        _socketLock.unlock();
-    }
-    return res;
+    return _bound;
 }
 
 SocketDescriptor Socket::socketDescriptor() const
 {
-    SocketDescriptor res = -1;
-    if (_socketLock.tryLock(10))
-    {
-        if (_socket)
-            res = _socket->socketDescriptor();
-        _socketLock.unlock();
-    }
-    return res;
+    return _socketDescriptor;
 }
 
 QList<QHostAddress> Socket::discardAddresses() const
@@ -127,25 +115,43 @@ void Socket::setDiscardAddresses(const QList<QHostAddress>& val)
     _discardAddresses = val;
 }
 
-void Socket::run()
+void Socket::writeDatagram(const QByteArray& buff, const HostPoint& point)
 {
-    { //Block for QMutexLocker
-        QMutexLocker locker {&_socketLock}; (void) locker;
+    if (!_timestamping.active())
+    {
+        _socket->writeDatagram(buff, point.address(), point.port());
+        return;
+    }
+    const qint64 writeTime = Timestamping::now();
+    if (_socket->writeDatagram(buff, point.address(), point.port()) >= 0)
+        _timestamping.frameSent(buff.size(), writeTime);
+}
 
-        _socket = simple_ptr<QUdpSocket>(new QUdpSocket(nullptr));
-        if (!_socket->bind(_bindPoint.address(), _bindPoint.port(), _bindMode))
-        {
-            log_error_m << "Failed bind UDP socket"
-                        << ". Error code: " << int(_socket->error())
-                        << ". Detail: " << _socket->errorString();
-            return;
-        }
+void Socket::run()
+{
+    _socket = simple_ptr<QUdpSocket>(new QUdpSocket(nullptr));
+    if (!_socket->bind(_bindPoint.address(), _bindPoint.port(), _bindMode))
+    {
+        log_error_m << "Failed bind UDP socket"
+                    << ". Error code: " << int(_socket->error())
+                    << ". Detail: " << _socket->errorString();
+        return;
     }
+    _socketDescriptor = _socket->socketDescriptor();
+    _bound = (_socket->state() == QAbstractSocket::BoundState);
     log_debug_m << "UDP socket is successfully bound to point " << _bindPoint;
 
+    _timestamping.reset(_timestampingMode);
+    if (_timestampingMode != Timestamping::Mode::None)
+        _timestamping.enable(int(_socket->socketDescriptor()), false);
+
     Message::List internalMessages;
     Message::List acceptMessages;
 
+    // Сведения о последнем удаленном хосте. Повторно используются для
+    // последовательности датаграмм, полученных с одного хоста
+    ConnectionContext::Ptr connection;
+
     QElapsedTimer timer;
     bool loopBreak = false;
     const int delay = 50;
@@ -263,11 +269,13 @@ void Socket::run()
                     stream << udpSignature;
                     message->toDataStream(stream);
                 }
+                PPROTO_PROBE_MESSAGE(udp_send, message, buff.size(),
+                                     message->destinationPoints().count());
 
                 if (!message->destinationPoints().isEmpty())
                 {
                     for (const HostPoint& dp : message->destinationPoints())
-                        _socket->writeDatagram(buff, dp.address(), dp.port());
+                        writeDatagram(buff, dp);
 
                     CHECK_SOCKET_ERROR
                     if (alog::logger().level() == alog::Level::Debug2)
@@ -282,9 +290,7 @@ void Socket::run()
                 }
                 else if (!message->sourcePoint().isNull())
                 {
-                    _socket->writeDatagram(buff,
-                                           message->sourcePoint().address(),
-                                           message->sourcePoint().port());
+                    writeDatagram(buff, message->sourcePoint());
                     CHECK_SOCKET_ERROR
                     if (alog::logger().level() == alog::Level::Debug2)
                     {
@@ -309,6 +315,9 @@ void Socket::run()
                 break;
 
             //--- Прием сообщений ---
+            if (_timestamping.active())
+                _timestamping.processErrorQueue();
+
             timer.start();
             while (_socket->hasPendingDatagrams())
             {
@@ -330,8 +339,16 @@ void Socket::run()
                 quint16 port;
                 QByteArray datagram;
                 datagram.resize(datagramSize);
+
+                // Метка получения датаграммы, ожидающей чтения
+                if (_timestamping.active())
+                    _timestamping.peekReceive();
+
                 qint64 res = _socket->readDatagram((char*)datagram.constData(),
                                                    datagramSize, &addr, &port);
+                if (res != -1 && _timestamping.active())
+                    _timestamping.frameReceived();
+
                 if (res == -1)
                 {
                     log_error_m << "Failed read datagram"
@@ -388,6 +405,7 @@ void Socket::run()
                     }
                     message = Message::fromDataStream(stream);
                 }
+                PPROTO_PROBE_MESSAGE(udp_receive, message, datagram.size(), port);
                 if (alog::logger().level() == alog::Level::Debug2)
                 {
                     log_debug2_m << "Message received"
@@ -395,9 +413,14 @@ void Socket::run()
                                  << ". Command: " << CommandNameLog(message->command())
                                  << ". Source: " << addr << ":" << port;
                 }
-                message->setSocketType(SocketType::Udp);
-                message->setSocketDescriptor(SocketDescriptor(-1));
-                message->setSourcePoint({addr, port});
+                HostPoint sourcePoint {addr, port};
+                if (connection.empty() || !(connection->peerPoint() == sourcePoint))
+                    connection = ConnectionContext::Ptr(new ConnectionContext(
+                        SocketType::Udp, SocketDescriptor(-1), sourcePoint, QString(),
+                        SerializeFormat::QBinary, false));
+
+                message->setConnection(connection);
+                trace::receive(message.get());
                 acceptMessages.add(message.detach());
                 CHECK_SOCKET_ERROR
             }
@@ -479,11 +502,8 @@ void Socket::run()
             }
         } // while (true)
 
-        { //Block for QMutexLocker
-            QMutexLocker locker {&_socketLock}; (void) locker;
-            _socket->close();
-            _socket.reset();
-        }
+        _socket->close();
+        _socket.reset();
     }
     catch (std::exception& e)
     {
@@ -493,6 +513,8 @@ void Socket::run()
     {
         log_error_m << "Unknown error";
     }
+    _bound = false;
+    _socketDescriptor = -1;
 
     #undef CHECK_SOCKET_ERROR
 }
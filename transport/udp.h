@@ -74,6 +74,14 @@ public:
     QList<QHostAddress> discardAddresses() const;
     void setDiscardAddresses(const QList<QHostAddress>&);
 
+    // Режим использования меток времени ядра (SO_TIMESTAMPING), см. transport/
+    // timestamping.h. Параметр должен быть задан до вызова init()
+    Timestamping::Mode timestampingMode() const {return _timestampingMode;}
+    void setTimestampingMode(Timestamping::Mode val) {_timestampingMode = val;}
+
+    // Статистика, полученная с использованием меток времени ядра
+    Timestamping::Stats timestampingStats() const {return _timestamping.stats();}
+
 signals:
     // Сигнал эмитируется при получении сообщения
     void message(const pproto::Message::Ptr&);
@@ -84,15 +92,25 @@ private:
 
     void run() override;
 
+    // Отправляет датаграмму, при включенных метках времени регистрирует
+    // отправку датаграммы
+    void writeDatagram(const QByteArray& buff, const HostPoint& point);
+
 private:
     simple_ptr<QUdpSocket> _socket;
-    mutable QMutex _socketLock;
+
+    // Состояние сокета, опубликованное потоком сокета
+    std::atomic<SocketDescriptor> _socketDescriptor = {-1};
+    std::atomic_bool _bound = {false};
 
     HostPoint _bindPoint;
     QUdpSocket::BindMode _bindMode;
     QList<QHostAddress> _discardAddresses;
     mutable std::atomic_flag _discardAddressesLock = ATOMIC_FLAG_INIT;
 
+    Timestamping::Mode _timestampingMode = {Timestamping::Mode::None};
+    Timestamping _timestamping;
+
     template<typename T> friend T* allocator_ptr<T>::create();
 };
 